@@ -0,0 +1,77 @@
+// share of a training step spent in the activation, libm sigmoid / exp-based sigmoid' against
+// the polynomial kernels with sigmoid' taken from the cached activations
+#include <time.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../tests/fixtures.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// what the step used to do per activation: 1 / (1 + exp(-z)) forward, e / (1 + e)^2 backward
+static void libm_activation(real_t *a, real_t *d, const real_t *z, size_t n) {
+	for (size_t i = 0; i < n; ++i) a[i] = 1 / (1 + real_exp(-z[i]));
+	for (size_t i = 0; i < n; ++i) {
+		real_t e = real_exp(-z[i]);
+		d[i] *= e / ((1 + e) * (1 + e));
+	}
+}
+
+static void kernel_activation(real_t *a, real_t *d, const real_t *z, size_t n) {
+	nn_kernels.sigmoid(a, z, n);
+	nn_kernels.sigmoid_grad(d, a, n);
+}
+
+// time of the activations of one step: every layer, batch rows of sizes[l] units
+static double time_activation(void (*act)(real_t *, real_t *, const real_t *, size_t), size_t *sizes, size_t batch, size_t reps) {
+	size_t n = 0;
+	for (size_t l = 1; l < arrlen(sizes); ++l) n += batch * sizes[l];
+	real_t *z = (real_t*)malloc(n * sizeof(real_t)), *a = (real_t*)malloc(n * sizeof(real_t)), *d = (real_t*)malloc(n * sizeof(real_t));
+	for (size_t i = 0; i < n; ++i) z[i] = (real_t)((i % 97) - 48) / 8, d[i] = 1;
+	double start = now();
+	for (size_t r = 0; r < reps; ++r) act(a, d, z, n);
+	double took = (now() - start) / reps;
+	free(z), free(a), free(d);
+	return took;
+}
+
+static void bench(size_t hidden, size_t batch) {
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, hidden); arrpush(sizes, Y_SIZE);
+	Network *net = network_create(sizes);
+	Dataset *set = pattern_set(batch, 28 * 28, Y_SIZE);
+	size_t *idx = NULL;
+	for (size_t e = 0; e < batch; ++e) arrpush(idx, e);
+
+	size_t reps = 1 + (size_t)(2e8 / (batch * hidden * 28 * 28));
+	network_update_batch(net, set, idx, 0.1);
+	double start = now();
+	for (size_t r = 0; r < reps; ++r) network_update_batch(net, set, idx, 0.1);
+	double step = (now() - start) / reps;
+	double old_act = time_activation(libm_activation, sizes, batch, reps);
+	double new_act = time_activation(kernel_activation, sizes, batch, reps);
+	// the step measured runs the kernels, the old one ran libm instead
+	double old_step = step - new_act + old_act;
+	printf("784-%-4zu batch %-4zu step %8.1fus  activation before %7.2fus (%4.1f%%)  after %6.2fus (%4.1f%%)\n",
+		hidden, batch, step * 1e6, old_act * 1e6, 100 * old_act / old_step, new_act * 1e6, 100 * new_act / step);
+
+	arrfree(idx);
+	dataset_destroy(set);
+	network_destroy(net);
+}
+
+int main(void) {
+	printf("isa: %s\n", nn_kernels.isa);
+	bench(30, 10);
+	bench(100, 32);
+	bench(256, 128);
+	bench(1024, 128);
+	return 0;
+}
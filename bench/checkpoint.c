@@ -0,0 +1,82 @@
+// checkpoints: writing one, mapping one with and without the checksum, and one training
+// epoch over 10k samples with and without a checkpoint every 100 batches in the background
+#include <time.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../tests/fixtures.h"
+
+#define PATH "/tmp/nn_checkpoint_bench.bin"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double epoch(Network *net, Dataset *set, const char *checkpoint) {
+	// the epoch prints its own progress, keep it off the table
+	fflush(stdout);
+	int out = dup(1);
+	freopen("/dev/null", "w", stdout);
+	TrainConfig cfg = { .epochs = 1, .batch_size = 10, .lrate = 0.01, .threads = 1, .seed = 1, .checkpoint = checkpoint, .checkpoint_every = 100 };
+	// later epochs run at another speed, every trial starts from the same weights
+	network_init(net, 1, 1);
+	double start = now();
+	network_SGD(net, &cfg, set, NULL);
+	double took = now() - start;
+	fflush(stdout);
+	dup2(out, 1);
+	close(out);
+	return took;
+}
+
+static void bench(size_t hidden) {
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, hidden); arrpush(sizes, hidden); arrpush(sizes, Y_SIZE);
+	Network *net = network_create(sizes);
+	net->optimizer = (Optimizer){ .kind = OPT_ADAM };
+	double save = 1e9, map = 1e9, verify = 1e9;
+	for (size_t trial = 0; trial < 5; ++trial) {
+		double start = now();
+		network_save(net, PATH);
+		save = fmin(save, now() - start);
+		start = now();
+		Network *loaded = network_load(PATH, false);
+		map = fmin(map, now() - start);
+		network_destroy(loaded);
+		start = now();
+		loaded = network_load(PATH, true);
+		verify = fmin(verify, now() - start);
+		network_destroy(loaded);
+	}
+	struct stat st;
+	stat(PATH, &st);
+	printf("784-%zu-%zu-10 %6.1f MB  save %7.2fms  load %6.3fms  load+verify %6.2fms\n",
+		hidden, hidden, st.st_size / 1e6, save * 1e3, map * 1e3, verify * 1e3);
+
+	Dataset *set = pattern_set(10000, 28 * 28, Y_SIZE);
+	double plain = 1e9, ckpt = 1e9;
+	for (size_t trial = 0; trial < 5; ++trial) {
+		plain = fmin(plain, epoch(net, set, NULL));
+		ckpt = fmin(ckpt, epoch(net, set, PATH));
+	}
+	stat(PATH, &st);
+	printf("    epoch %7.1fms  with a checkpoint every 100 batches %7.1fms (%+.1f%%), %.1f MB each\n",
+		plain * 1e3, ckpt * 1e3, 100 * (ckpt - plain) / plain, st.st_size / 1e6);
+	remove(PATH);
+	dataset_destroy(set);
+	network_destroy(net);
+}
+
+int main(void) {
+	printf("isa: %s\n", nn_kernels.isa);
+	bench(100);
+	bench(256);
+	bench(512);
+	return 0;
+}
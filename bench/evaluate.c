@@ -0,0 +1,65 @@
+// a test pass over 10k samples: network_test one sample at a time against network_evaluate,
+// next to the time of one training epoch over 60k samples
+#include <time.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../tests/fixtures.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(size_t hidden, size_t threads) {
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, hidden); arrpush(sizes, Y_SIZE);
+	Network *net = network_create(sizes);
+	Dataset *train = pattern_set(60000, 28 * 28, Y_SIZE), *test = pattern_set(10000, 28 * 28, Y_SIZE);
+
+	// the epoch prints its own progress, keep it off the table
+	fflush(stdout);
+	int out = dup(1);
+	freopen("/dev/null", "w", stdout);
+	TrainConfig cfg = { .epochs = 1, .batch_size = 10, .lrate = 0.1, .threads = threads, .seed = 1 };
+	double start = now();
+	network_SGD(net, &cfg, train, NULL);
+	double epoch = now() - start;
+	fflush(stdout);
+	dup2(out, 1);
+	close(out);
+
+	start = now();
+	size_t ok = 0;
+	for (size_t t = 0; t < test->count; ++t) ok += network_test(net, test, t);
+	double per_sample = now() - start;
+	start = now();
+	Evaluation ev = network_evaluate(net, test, &(EvalOptions){ .threads = threads });
+	double batched = now() - start;
+	assert(ev.correct == ok);
+	evaluation_destroy(&ev);
+	printf("784-%-4zu %zu threads  epoch %7.1fms  network_test %6.1fms (%4.1f%%)  network_evaluate %6.1fms (%4.1f%%)\n",
+		hidden, threads, epoch * 1e3, per_sample * 1e3, 100 * per_sample / epoch, batched * 1e3, 100 * batched / epoch);
+
+	dataset_destroy(train);
+	dataset_destroy(test);
+	network_destroy(net);
+}
+
+int main(void) {
+	printf("isa: %s\n", nn_kernels.isa);
+	size_t cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	bench(30, 1);
+	bench(100, 1);
+	bench(256, 1);
+	if (cpus > 1) {
+		bench(100, cpus);
+		bench(256, cpus);
+	}
+	return 0;
+}
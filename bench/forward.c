@@ -0,0 +1,73 @@
+// forward pass of one layer: the former product into Z, bias pass and activation pass against
+// the product finished by the bias + activation epilogue, for a batch (gemm) and one sample (gemv)
+#include <time.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(size_t in, size_t out, size_t batch) {
+	mat_t w = mat_new(out, in), x = mat_new(batch, in), z = mat_new(batch, out), a = mat_new(batch, out);
+	vec_t bias = vec_new(out), xv = vec_new(in), zv = vec_new(out), av = vec_new(out);
+	for (size_t i = 0; i < out; ++i) {
+		bias[i] = (real_t)(i % 5) / 10;
+		for (size_t j = 0; j < in; ++j) MAT_AT(w, i, j) = (real_t)((i + j) % 7) / 100 - (real_t)0.03;
+	}
+	for (size_t i = 0; i < batch; ++i) {
+		for (size_t j = 0; j < in; ++j) MAT_AT(x, i, j) = xv[j] = (real_t)((i * j) % 9) / 9;
+	}
+	// best of a few trials, the passes being removed are small next to the product
+	double gemm_old = 1e9, gemm_new = 1e9, gemv_old = 1e9, gemv_new = 1e9;
+	for (size_t trial = 0; trial < 5; ++trial) {
+		size_t reps = 1 + (size_t)(4e8 / (batch * in * out));
+		double start = now();
+		for (size_t r = 0; r < reps; ++r) {
+			mat_matT_dot(z, x, w);
+			for (size_t i = 0; i < batch; ++i) {
+				nn_kernels.operate[ADD](mat_row(z, i), bias, out);
+				nn_kernels.sigmoid(mat_row(a, i), mat_row(z, i), out);
+			}
+		}
+		gemm_old = fmin(gemm_old, (now() - start) / reps);
+		start = now();
+		for (size_t r = 0; r < reps; ++r) mat_gemm_epilogue(a, GEMM_NT, x, w, 1, 0, &(Epilogue){ .bias = bias, .act = ACT_SIGMOID });
+		gemm_new = fmin(gemm_new, (now() - start) / reps);
+
+		reps = 1 + (size_t)(4e7 / (in * out));
+		start = now();
+		for (size_t r = 0; r < reps; ++r) {
+			mat_vec_dot(zv, w, xv);
+			vec_operate(zv, 1, (VecOp){ ADD, bias });
+			nn_kernels.sigmoid(av, zv, out);
+		}
+		gemv_old = fmin(gemv_old, (now() - start) / reps);
+		start = now();
+		for (size_t r = 0; r < reps; ++r) mat_vec_dot_epilogue(av, w, xv, &(Epilogue){ .bias = bias, .act = ACT_SIGMOID });
+		gemv_new = fmin(gemv_new, (now() - start) / reps);
+	}
+	printf("%4zu-%-4zu batch %-4zu gemm %8.1fus -> %8.1fus (%.2fx)  gemv %7.2fus -> %7.2fus (%.2fx)\n", in, out, batch,
+		gemm_old * 1e6, gemm_new * 1e6, gemm_old / gemm_new, gemv_old * 1e6, gemv_new * 1e6, gemv_old / gemv_new);
+
+	mat_destroy(w), mat_destroy(x), mat_destroy(z), mat_destroy(a);
+	vec_destroy(bias), vec_destroy(xv), vec_destroy(zv), vec_destroy(av);
+}
+
+int main(void) {
+	printf("isa: %s\n", nn_kernels.isa);
+	bench(784, 30, 10);
+	bench(784, 100, 32);
+	bench(784, 256, 128);
+	bench(256, 256, 512);
+	bench(784, 1024, 128);
+	bench(32, 1024, 512);
+	bench(16, 2048, 1024);
+	return 0;
+}
@@ -0,0 +1,48 @@
+// GFLOP/s of mat_gemm for the shapes training hits and a few square ones
+#include <time.h>
+#define STB_DS_IMPLEMENTATION
+#define NN_MATH_IMPLEMENTATION
+#include "nn_math.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(const char *name, GemmOp op, size_t M, size_t N, size_t K) {
+	mat_t a = op == GEMM_TN ? mat_new(K, M) : mat_new(M, K);
+	mat_t b = op == GEMM_NT ? mat_new(N, K) : mat_new(K, N);
+	mat_t c = mat_new(M, N);
+	for (size_t i = 0; i < a.rows; ++i) for (size_t j = 0; j < a.cols; ++j) MAT_AT(a, i, j) = 1e-3 * (i + j);
+	for (size_t i = 0; i < b.rows; ++i) for (size_t j = 0; j < b.cols; ++j) MAT_AT(b, i, j) = 1e-3 * (i - j);
+
+	double flops = 2.0 * M * N * K;
+	size_t reps = 1 + (size_t)(2e9 / flops);
+	mat_gemm(c, op, a, b, 1, 0);
+	double start = now();
+	for (size_t r = 0; r < reps; ++r) mat_gemm(c, op, a, b, 1, 0);
+	double took = now() - start;
+	printf("%-10s %5zux%-5zux%-5zu %8.2f GFLOP/s\n", name, M, N, K, flops * reps / took * 1e-9);
+
+	mat_destroy(a);
+	mat_destroy(b);
+	mat_destroy(c);
+}
+
+int main(void) {
+	printf("isa: %s\n", nn_kernels.isa);
+	// batch 10, 784-30-10 network
+	bench("fwd NT", GEMM_NT, 10, 30, 784);
+	bench("delta NN", GEMM_NN, 10, 30, 10);
+	bench("grad TN", GEMM_TN, 30, 784, 10);
+	// batch 128
+	bench("fwd NT", GEMM_NT, 128, 256, 784);
+	bench("grad TN", GEMM_TN, 256, 784, 128);
+	for (size_t n = 256; n <= 1024; n *= 2) {
+		bench("square NN", GEMM_NN, n, n, n);
+		bench("square NT", GEMM_NT, n, n, n);
+		bench("square TN", GEMM_TN, n, n, n);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+// time-to-accuracy of synchronous data-parallel training against hogwild,
+// on MNIST when the images are in data/, otherwise on a synthetic stand-in
+#include <time.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../tests/fixtures.h"
+
+#define EPOCHS 5
+#define TARGET 0.85
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double accuracy(Network *net, Dataset *set) {
+	size_t ok = 0;
+	for (size_t t = 0; t < set->count; ++t) ok += network_test(net, set, t);
+	return (double)ok / set->count;
+}
+
+static void run(const char *name, size_t *sizes, TrainConfig cfg, Dataset *train, Dataset *test) {
+	Network *net = network_create(sizes);
+	// every configuration starts from the same weights
+	network_init(net, 1, cfg.threads);
+	cfg.epochs = 1;
+	double elapsed = 0, reached = -1;
+	for (size_t e = 0; e < EPOCHS; ++e) {
+		double start = now();
+		cfg.seed = e; // a fresh order every epoch
+		network_SGD(net, &cfg, train, NULL);
+		elapsed += now() - start;
+		double acc = accuracy(net, test);
+		fprintf(stderr, "%s epoch %zu: %.4f after %.2fs\n", name, e, acc, elapsed);
+		if (reached < 0 && acc >= TARGET) reached = elapsed;
+	}
+	if (reached < 0) {
+		printf("%-8s %2zu threads: %.2f target not reached in %.2fs\n", name, cfg.threads, TARGET, elapsed);
+	} else {
+		printf("%-8s %2zu threads: %.2f reached after %.2fs\n", name, cfg.threads, TARGET, reached);
+	}
+	network_destroy(net);
+}
+
+int main(void) {
+	Dataset *train, *test;
+	if (access(TRAIN_SET_IMAGE, R_OK) == 0 && access(TEST_SET_IMAGE, R_OK) == 0) {
+		train = load_training_set();
+		test = load_test_set();
+		if (train == NULL || test == NULL) return 1;
+	} else {
+		printf("mnist images not found, using a synthetic set\n");
+		srand(1);
+		train = digit_set(6000);
+		test = digit_set(1000);
+	}
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, 30); arrpush(sizes, Y_SIZE);
+	size_t cores = sysconf(_SC_NPROCESSORS_ONLN);
+	for (size_t threads = 1; threads <= cores; threads *= 2) {
+		TrainConfig cfg = { .batch_size = 10, .lrate = 3, .threads = threads };
+		run("sync", sizes, cfg, train, test);
+		cfg.hogwild = true;
+		run("hogwild", sizes, cfg, train, test);
+	}
+	return 0;
+}
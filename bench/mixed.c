@@ -0,0 +1,64 @@
+// one training epoch over 10k samples in full precision against the bf16 and fp16 mixed
+// modes, on the detected instruction set and on avx2, where bf16 has no dot products
+#include <time.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../tests/fixtures.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double epoch(Network *net, Dataset *set, TrainPrecision precision) {
+	// the epoch prints its own progress, keep it off the table
+	fflush(stdout);
+	int out = dup(1);
+	freopen("/dev/null", "w", stdout);
+	TrainConfig cfg = { .epochs = 1, .batch_size = 64, .lrate = 0.01, .threads = 1, .seed = 1, .precision = precision };
+	network_init(net, 1, 1);
+	double start = now();
+	network_SGD(net, &cfg, set, NULL);
+	double took = now() - start;
+	fflush(stdout);
+	dup2(out, 1);
+	close(out);
+	return took;
+}
+
+static void bench(size_t hidden, Dataset *set) {
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, hidden); arrpush(sizes, hidden); arrpush(sizes, Y_SIZE);
+	Network *net = network_create(sizes);
+	net->activations[0] = net->activations[1] = ACT_RELU;
+	net->activations[2] = ACT_SOFTMAX;
+	net->loss = LOSS_CROSS_ENTROPY;
+	double t[TRAIN_FP16 + 1];
+	for (TrainPrecision p = TRAIN_FULL; p <= TRAIN_FP16; ++p) {
+		t[p] = 1e9;
+		for (size_t trial = 0; trial < 3; ++trial) t[p] = fmin(t[p], epoch(net, set, p));
+	}
+	printf("784-%zu-%zu-10  %-6s %-10s full %7.1fms  bf16 %7.1fms (%.2fx)  fp16 %7.1fms (%.2fx)\n", hidden, hidden, nn_kernels.isa, nn_kernels.hisa,
+		t[TRAIN_FULL] * 1e3, t[TRAIN_BF16] * 1e3, t[TRAIN_FULL] / t[TRAIN_BF16], t[TRAIN_FP16] * 1e3, t[TRAIN_FULL] / t[TRAIN_FP16]);
+	network_destroy(net);
+}
+
+int main(void) {
+	Dataset *set = pattern_set(10000, 28 * 28, Y_SIZE);
+	const char *detected = nn_kernels.isa;
+	const char *isas[] = { "avx512", "avx2" };
+	for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+		if (!nn_kernels_use(isas[i])) continue;
+		bench(256, set);
+		bench(1024, set);
+	}
+	nn_kernels_use(detected);
+	dataset_destroy(set);
+	return 0;
+}
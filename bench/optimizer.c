@@ -0,0 +1,50 @@
+// parameter update of one step: the former scale-then-add sgd (grad *= -lr/n, w += grad, two
+// passes over the gradient and one over the weights) against the fused kernel of every rule
+#include <time.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(size_t rows, size_t cols) {
+	mat_t w = mat_new(rows, cols), g = mat_new(rows, cols), m = mat_new(rows, cols), v = mat_new(rows, cols);
+	for (size_t i = 0; i < rows; ++i) {
+		for (size_t j = 0; j < cols; ++j) MAT_AT(w, i, j) = (real_t)((i + j) % 7), MAT_AT(g, i, j) = (real_t)((i * j) % 5) - 2;
+	}
+	size_t n = rows * w.stride, reps = 1 + (size_t)(2e9 / (n * sizeof(real_t) * 4));
+	double start = now();
+	// a scale of 1 keeps g as it is and does the same work
+	for (size_t r = 0; r < reps; ++r) {
+		mat_scale(g, 1);
+		mat_operate(w, 1, (MatOp){ ADD, g });
+	}
+	double old = (now() - start) / reps;
+	printf("%5zux%-5zu %6.1f MB  scale+add sgd %8.1fus", rows, cols, n * sizeof(real_t) / 1e6, old * 1e6);
+	const char *names[] = { "sgd", "momentum", "nesterov", "rmsprop", "adam", "adamw" };
+	OptStep s = { .lr = 1e-9, .grad_scale = 1, .l2 = 1e-4, .beta1 = 0.9, .beta2 = 0.999, .eps = 1e-8, .bias1 = 1, .bias2 = 1 };
+	for (OptimizerKind k = OPT_SGD; k <= OPT_ADAM; ++k) {
+		start = now();
+		for (size_t r = 0; r < reps; ++r) nn_kernels.optimize[k](w.data, g.data, m.data, v.data, n, &s);
+		double took = (now() - start) / reps;
+		printf("  %s %7.1fus", names[k], took * 1e6);
+	}
+	printf("\n");
+	mat_destroy(w), mat_destroy(g), mat_destroy(m), mat_destroy(v);
+}
+
+int main(void) {
+	printf("isa: %s\n", nn_kernels.isa);
+	bench(30, 784);
+	bench(256, 784);
+	bench(1024, 784);
+	bench(4096, 1024);
+	return 0;
+}
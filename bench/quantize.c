@@ -0,0 +1,60 @@
+// classifying 10k samples on one thread: network_evaluate in real_t against the int8 copy
+// from network_quantize, for every int8 product path the cpu has
+#include <time.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../tests/fixtures.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(size_t hidden, Dataset *set) {
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, hidden); arrpush(sizes, hidden); arrpush(sizes, Y_SIZE);
+	Network *net = network_create(sizes);
+	net->activations[0] = net->activations[1] = ACT_RELU;
+	net->activations[2] = ACT_SOFTMAX;
+	network_init(net, 1, 1);
+	QuantNetwork *q = network_quantize(net, set, 1000);
+	const char *detected = nn_kernels.isa;
+	double fp = 1e9;
+	for (size_t trial = 0; trial < 3; ++trial) {
+		double start = now();
+		Evaluation ev = network_evaluate(net, set, NULL);
+		fp = fmin(fp, now() - start);
+		evaluation_destroy(&ev);
+	}
+	printf("784-%zu-%zu-10  %s %8.0f samples/s", hidden, hidden, nn_kernels.isa, set->count / fp);
+	const char *isas[] = { "generic", "avx2", "avx512" };
+	for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+		if (!nn_kernels_use(isas[i])) continue;
+		double took = 1e9;
+		for (size_t trial = 0; trial < 3; ++trial) {
+			double start = now();
+			Evaluation ev = quant_network_evaluate(q, set, NULL);
+			took = fmin(took, now() - start);
+			evaluation_destroy(&ev);
+		}
+		printf("  int8 %s %8.0f (%.2fx)", nn_kernels.qisa, set->count / took, fp / took);
+	}
+	printf("\n");
+	nn_kernels_use(detected);
+	quant_network_destroy(q);
+	network_destroy(net);
+}
+
+int main(void) {
+	Dataset *set = pattern_set(10000, 28 * 28, Y_SIZE);
+	bench(100, set);
+	bench(256, set);
+	bench(1024, set);
+	dataset_destroy(set);
+	return 0;
+}
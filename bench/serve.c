@@ -0,0 +1,61 @@
+// requests answered per second by the inference server with 32 clients sending back to back,
+// one forward pass per request against micro-batches of up to 64
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define NN_SERVE_IMPLEMENTATION
+#include "nn_serve.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+#define PATH "/tmp/nn_serve_bench.sock"
+#define CLIENTS 32
+#define REQUESTS 500
+
+static void *client(void *arg) {
+	size_t id = (size_t)arg;
+	int fd = serve_connect(PATH);
+	assert(fd != -1);
+	float x[28 * 28];
+	for (size_t r = 0; r < REQUESTS; ++r) {
+		for (size_t i = 0; i < 28 * 28; ++i) x[i] = (float)(((id * REQUESTS + r) * 31 + i * 7) % 256) / 255;
+		assert(serve_classify(fd, x, 28 * 28, NULL, 0) < Y_SIZE);
+	}
+	close(fd);
+	return NULL;
+}
+
+static ServeStats run(Network *net, size_t max_batch, double max_wait) {
+	Server *s = server_start(net, &(ServeConfig){ .path = PATH, .max_batch = max_batch, .max_wait = max_wait });
+	assert(s != NULL);
+	pthread_t threads[CLIENTS];
+	for (size_t t = 0; t < CLIENTS; ++t) assert(pthread_create(&threads[t], NULL, client, (void*)t) == 0);
+	for (size_t t = 0; t < CLIENTS; ++t) pthread_join(threads[t], NULL);
+	return server_stop(s);
+}
+
+static void bench(size_t hidden) {
+	size_t *sizes = NULL;
+	arrpush(sizes, 28 * 28); arrpush(sizes, hidden); arrpush(sizes, hidden); arrpush(sizes, Y_SIZE);
+	Network *net = network_create(sizes);
+	net->activations[0] = net->activations[1] = ACT_RELU;
+	net->activations[2] = ACT_SOFTMAX;
+	network_init(net, 1, 1);
+	ServeStats one = run(net, 1, 0);
+	printf("784-%zu-%zu-10  batch 1   %8.0f requests/s  p50 %7.3fms  p99 %7.3fms\n", hidden, hidden, one.throughput, one.p50 * 1e3, one.p99 * 1e3);
+	double waits[] = { 0, 1e-3 };
+	for (size_t w = 0; w < sizeof(waits) / sizeof(waits[0]); ++w) {
+		ServeStats st = run(net, 64, waits[w]);
+		printf("784-%zu-%zu-10  batch 64, wait %.0fms  %8.0f requests/s (%.2fx)  p50 %7.3fms  p99 %7.3fms  %.1f per batch\n", hidden, hidden,
+			waits[w] * 1e3, st.throughput, st.throughput / one.throughput, st.p50 * 1e3, st.p99 * 1e3, st.mean_batch);
+	}
+	network_destroy(net);
+}
+
+int main(void) {
+	bench(256);
+	bench(1024);
+	return 0;
+}
@@ -1,21 +1,204 @@
 #ifndef NN_H
 #define NN_H
 
+#include <stdbool.h>
+#include <stdatomic.h>
 #include "nn_math.h"
+#include "nn_rng.h"
 #include "nn_data_loader.h"
 
+// buffers reused by every training and test step, one entry per layer
+typedef struct {
+	size_t batch; // rows the batch buffers can hold
+	mat_t X;      // batch inputs, one sample per row
+	uint8_t *labels; // class index of every row of X
+	mat_t *Z, *A, *D;
+	mat_t *grad_weights;
+	vec_t *grad_biases;
+	vec_t x;          // single sample input
+	vec_t *z, *a, *d; // single sample
+	Rng rng;          // private to the thread using the workspace
+	// 16-bit copies of X, A and D for mixed-precision training, grown on first use
+	size_t half_batch;
+	hmat_t X16, *A16, *D16;
+	real_t loss_scale; // the deltas of the last batch were multiplied by it
+	bool overflow;     // and one of them did not fit fp16
+} Workspace;
+
+typedef enum {
+	LOSS_QUADRATIC,     // 1/2 |a - y|^2
+	LOSS_CROSS_ENTROPY, // -log a[label], the output layer must be softmax or sigmoid
+} Loss;
+
+// update rule of network_update_batch and network_SGD, the zero value is plain sgd
+typedef struct {
+	OptimizerKind kind;
+	double beta1;        // momentum of the sgd variants, adam's first moment decay. 0 picks 0.9
+	double beta2;        // second moment decay of rmsprop and adam, 0 picks 0.999
+	double eps;          // 0 picks 1e-8
+	double weight_decay; // of the weights, not the biases: an l2 penalty, decoupled for adamw
+} Optimizer;
+
+// storage of the products of network_SGD. the mixed modes round the weights, activations and
+// deltas to 16 bits for every matrix product, which accumulates in real_t; the elementwise
+// passes, the gradients and the master weights the optimizer updates stay in real_t
+typedef enum {
+	TRAIN_FULL, // real_t throughout
+	TRAIN_BF16,
+	TRAIN_FP16, // with dynamic loss scaling against its narrow range
+} TrainPrecision;
+
+// state of mixed-precision training, kept by the network between runs
+typedef struct {
+	TrainPrecision precision; // of the matrix products, full unless set otherwise
+	hmat_t *weights; // the master weights rounded after every step, NULL in full precision
+	// fp16: the output deltas are multiplied by the scale and the gradients divided by it. a
+	// step whose deltas overflow is dropped and the scale halved, LOSS_SCALE_WINDOW good steps
+	// in a row double it again
+	_Atomic double loss_scale;
+	_Atomic uint64_t good_steps;
+	_Atomic uint64_t skipped;
+} MixedState;
+
+// moments of the optimizer, laid out like the weights and biases they belong to
+typedef struct {
+	mat_t *m, *v;   // NULL until the optimizer needs them
+	vec_t *mb, *vb;
+	_Atomic uint64_t steps; // updates applied so far, for adam's bias correction
+} OptimizerState;
+
 typedef struct {
 	size_t *sizes;
 	mat_t *weights;
 	vec_t *biases;
+	Activation *activations; // one per layer, sigmoid unless set otherwise
+	Loss loss;               // quadratic unless set otherwise
+	Optimizer optimizer;
+	OptimizerState opt;
+	Workspace ws;
+	MixedState mixed;
+	void *map;       // checkpoint the sizes, weights and biases live in, NULL when allocated
+	size_t map_size;
 } Network;
 
+// rewrites the normalized sample x in place, may run on any training or loader thread
+typedef void (*AugmentFn)(real_t *x, size_t features, Rng *rng, void *ctx);
+
+typedef struct {
+	size_t epochs;
+	size_t batch_size;
+	double lrate;   // learning rate
+	size_t threads; // workers splitting each batch, 0 or 1 trains on the calling thread
+	bool hogwild;   // workers take whole batches and update the weights without locks
+	size_t prefetch; // batches a loader thread gathers ahead of the ones being trained on, 0 gathers inline
+	AugmentFn augment; // optional, applied to every sample as it is gathered
+	void *augment_ctx;
+	uint64_t seed;  // shuffling and augmentation streams, the same seed replays the same run
+	TrainPrecision precision; // of the matrix products, full unless set otherwise
+	// when set, the parameters, optimizer moments, rng streams and position in the run are
+	// written here every checkpoint_every batches, or after every epoch when it is 0, and
+	// once more when training ends. the writes happen on a background thread, a checkpoint
+	// falling due while the previous one is still being written waits for the next batch
+	const char *checkpoint;
+	size_t checkpoint_every;
+	// continue from checkpoint when it exists: the network must have the same sizes, and
+	// the dataset and batch_size must be the ones it was written with. the optimizer,
+	// activations and loss are taken from the checkpoint. with the same
+	// threads and prefetch the run ends exactly as if it had never stopped. hogwild runs
+	// are only checkpointed between epochs. a checkpoint that cannot be resumed from is
+	// reported on stderr and network_SGD returns false without training
+	bool resume;
+} TrainConfig;
+
+typedef struct {
+	size_t batch_size; // samples per forward pass, 0 picks 256
+	size_t threads;    // 0 or 1 evaluates on the calling thread
+	bool loss;         // also compute the loss, which needs the output activation argmax does without
+} EvalOptions;
+
+typedef struct {
+	size_t count, correct;
+	double accuracy;
+	double loss;        // mean per sample, 0 unless asked for
+	size_t classes;     // the confusion matrix is classes x classes
+	size_t *confusion;  // row major, [label * classes + prediction], free with evaluation_destroy
+} Evaluation;
+
+// a layer of a QuantNetwork. weights are quantized per output channel, w = s[c] * q with
+// |q| <= QUANT_WEIGHT_MAX, and the inputs to unsigned bytes, x = in_scale * (q - in_zero).
+// the products accumulate in int32 and go back to real_t as scale[c] * acc + offset[c]
+typedef struct {
+	size_t rows, cols;
+	size_t stride;   // bytes of a weight row and of a quantized input, a multiple of NN_ALIGN
+	int8_t *weights; // rows x stride, zero padded
+	real_t *scale;   // in_scale * s[c]
+	real_t *offset;  // the bias less what the input zero point adds to the product
+	Activation act;
+	real_t in_scale;
+	int32_t in_zero;
+} QuantLayer;
+
+// buffers of the int8 forward pass of one thread
+typedef struct {
+	size_t batch; // rows the buffers can hold
+	mat_t X;      // gathered inputs
+	mat_t A;      // real_t outputs of a layer, as wide as the widest layer
+	uint8_t *Xq;  // quantized inputs of a layer
+	int32_t *acc;
+} QuantScratch;
+
+// int8 inference copy of a network, see network_quantize
+typedef struct {
+	size_t *sizes; // owned, unlike a Network's
+	QuantLayer *layers;
+	QuantScratch scratch; // of the thread calling quant_network_classify
+} QuantNetwork;
+
+// weights and biases start out N(0, 1), seeded from the clock
 Network *network_create(size_t *sizes);
+// redraws every weight and bias N(0, 1) from seed, the result does not depend on threads.
+// weights of relu layers and of the layer after one are drawn N(0, 2 / inputs), so call it
+// after choosing activations
+void network_init(Network *net, uint64_t seed, size_t threads);
 void network_destroy(Network *net);
-// lrate: learning rate
-void network_SGD(Network *net, size_t epochs, size_t batch_size, double lrate, DataEntry *training_set, DataEntry *test_set);
-void network_update_batch(Network *net, DataEntry *batch, double lrate);
-void network_backprop(Network *net, DataEntry entry, mat_t *grad_weights, vec_t *grad_biases);
-int network_test(Network *net, DataEntry entry);
+// grows the workspace to fit batches of batch_size and allocates the moments of the
+// optimizer, steady-state steps then never allocate
+void network_reserve(Network *net, size_t batch_size);
+bool network_SGD(Network *net, TrainConfig *cfg, Dataset *training_set, Dataset *test_set);
+// batch is an stb_ds array of sample indices into the dataset
+void network_update_batch(Network *net, Dataset *set, size_t *batch, double lrate);
+// adds the gradients of sample i into grad_weights, grad_biases
+void network_backprop(Network *net, Dataset *set, size_t i, mat_t *grad_weights, vec_t *grad_biases);
+// writes the summed gradients of the whole batch into grad_weights, grad_biases, in the
+// precision of the network's last network_SGD run
+void network_backprop_batch(Network *net, Dataset *set, size_t *batch, mat_t *grad_weights, vec_t *grad_biases);
+// 1 when the network classifies sample i correctly
+int network_test(Network *net, Dataset *set, size_t i);
+// the output activations of every row of X into the same row of Y, one forward pass over all
+// of them on the network's workspace. inputs are normalized like dataset_load_x leaves them
+void network_predict(Network *net, mat_t X, mat_t Y);
+// writes sizes, activations, loss, weights and biases to a checkpoint, see src/nn.c for the format.
+// returns false with a message on stderr when it cannot be written, path is then left as it was
+bool network_save(Network *net, const char *path);
+// maps a checkpoint written by network_save with the same real_t. sizes, weights and biases are
+// used in place: the pages are shared by every process loading the file until one writes to
+// them, and must not be grown or freed. verify checks the checksum of the whole file, which
+// reads every page. returns NULL with a message on stderr when the file is not a checkpoint
+Network *network_load(const char *path, bool verify);
+// classifies the whole dataset in batches spread over threads, opts may be NULL. the result
+// does not depend on the number of threads
+Evaluation network_evaluate(Network *net, Dataset *set, const EvalOptions *opts);
+void evaluation_destroy(Evaluation *ev);
+// post-training int8 copy of a trained network. the range of every layer's inputs is
+// calibrated on up to `samples` samples spread evenly over the calibration set, the
+// weights of every output channel get a scale of their own
+QuantNetwork *network_quantize(Network *net, Dataset *calibration, size_t samples);
+void quant_network_destroy(QuantNetwork *q);
+// the class of every row of X, inputs normalized like dataset_load_x leaves them
+void quant_network_classify(QuantNetwork *q, mat_t X, size_t *classes);
+// network_evaluate of the int8 network, which leaves the loss at 0
+Evaluation quant_network_evaluate(QuantNetwork *q, Dataset *set, const EvalOptions *opts);
+// bytes of the quantized weights with their row padding, scales and offsets
+size_t quant_network_size(QuantNetwork *q);
 
 #endif//NN_H
@@ -11,29 +11,126 @@ wget https://systemds.apache.org/assets/datasets/mnist/t10k-labels-idx1-ubyte.gz
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "stb_ds.h"
 #include "assert.h"
+#include "nn_math.h"
 
 #define PREFIX "data"
 #define TRAIN_SET_IMAGE PREFIX "/train-images-idx3-ubyte"
 #define TRAIN_SET_LABEL PREFIX "/train-labels-idx1-ubyte"
 #define TEST_SET_IMAGE PREFIX "/t10k-images-idx3-ubyte"
 #define TEST_SET_LABEL PREFIX "/t10k-labels-idx1-ubyte"
-#define TRAIN_SET_SIZE 6e4
-#define TEST_SET_SIZE 1e4
-#define Y_SIZE 10
+#define Y_SIZE 10 // mnist digits
 
+// element type byte of the idx magic number
+typedef enum {
+	IDX_U8 = 0x08,
+	IDX_I8 = 0x09,
+	IDX_I16 = 0x0B,
+	IDX_I32 = 0x0C,
+	IDX_F32 = 0x0D,
+	IDX_F64 = 0x0E,
+} IdxType;
+
+// samples stay as the raw elements of the idx file, they are converted and normalized when a batch is gathered
 typedef struct {
-	double *x;
-	double *y;
-} DataEntry;
+	size_t count;    // samples
+	size_t features; // elements per sample, the product of every dimension after the first
+	size_t classes;  // largest label + 1
+	IdxType type;    // element type of pixels, wider than a byte they stay big-endian
+	uint8_t *pixels; // count x features elements
+	uint8_t *labels; // class index of every sample
+	// read-only file mappings pixels and labels point into, NULL when they are heap buffers
+	void *maps[2];
+	size_t map_sizes[2];
+} Dataset;
+
+typedef enum { DATASET_SEQUENTIAL, DATASET_RANDOM } DatasetAccess;
+
+Dataset *dataset_new(size_t count, size_t features, size_t classes);
+void dataset_destroy(Dataset *set);
+// tells the kernel how the mapped samples are about to be read
+void dataset_advise(Dataset *set, DatasetAccess access);
+// NULL with a message on stderr when a file cannot be read
+Dataset *load_set(const char *image_path, const char *label_path);
+Dataset *load_training_set();
+Dataset *load_test_set();
+
+// bytes per element, 0 for a type byte idx does not define
+static inline size_t idx_type_size(IdxType type) {
+	switch (type) {
+	case IDX_U8: case IDX_I8: return 1;
+	case IDX_I16: return 2;
+	case IDX_I32: case IDX_F32: return 4;
+	case IDX_F64: return 8;
+	}
+	return 0;
+}
 
-DataEntry *load_training_set();
-DataEntry *load_test_set();
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define IDX_BE(bits, v) __builtin_bswap##bits(v)
+#else
+#define IDX_BE(bits, v) (v)
+#endif
+
+static inline uint16_t idx_be16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return IDX_BE(16, v); }
+static inline uint32_t idx_be32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return IDX_BE(32, v); }
+static inline uint64_t idx_be64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return IDX_BE(64, v); }
+
+static inline uint8_t *dataset_sample(Dataset *set, size_t i) {
+	return set->pixels + i * set->features * idx_type_size(set->type);
+}
+
+// writes sample i into dst, integer elements are scaled by the largest value of their type
+// (so u8 pixels land in [0, 1]) and floating point ones are taken as stored
+static inline void dataset_load_x(Dataset *set, size_t i, real_t *dst) {
+	uint8_t *src = dataset_sample(set, i);
+	size_t n = set->features;
+	switch (set->type) {
+	case IDX_U8:
+		for (size_t f = 0; f < n; ++f) dst[f] = (real_t)src[f] * (real_t)(1.0 / 255);
+		break;
+	case IDX_I8:
+		for (size_t f = 0; f < n; ++f) dst[f] = (real_t)(int8_t)src[f] * (real_t)(1.0 / 127);
+		break;
+	case IDX_I16:
+		for (size_t f = 0; f < n; ++f) dst[f] = (real_t)(int16_t)idx_be16(src + 2 * f) * (real_t)(1.0 / 32767);
+		break;
+	case IDX_I32:
+		for (size_t f = 0; f < n; ++f) dst[f] = (real_t)((double)(int32_t)idx_be32(src + 4 * f) * (1.0 / 2147483647));
+		break;
+	case IDX_F32:
+		for (size_t f = 0; f < n; ++f) {
+			uint32_t bits = idx_be32(src + 4 * f);
+			float v;
+			memcpy(&v, &bits, 4);
+			dst[f] = (real_t)v;
+		}
+		break;
+	case IDX_F64:
+		for (size_t f = 0; f < n; ++f) {
+			uint64_t bits = idx_be64(src + 8 * f);
+			double v;
+			memcpy(&v, &bits, 8);
+			dst[f] = (real_t)v;
+		}
+		break;
+	}
+}
 
 #endif // LOAD_MNIST_H
 
-#ifdef LOAD_MNIST_IMPLEMENTAION
+#if defined(LOAD_MNIST_IMPLEMENTAION) && !defined(LOAD_MNIST_IMPLEMENTED)
+#define LOAD_MNIST_IMPLEMENTED
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
 typedef struct {
 	uint8_t *buf;
@@ -50,94 +147,256 @@ uint8_t parser_u8(parser_t *p) {
 	return p->buf[p->off++];
 }
 
-uint32_t parser_u32(parser_t *p) {
-	assert(!parser_eof(p, 4));
-	return p->off += 4, *(uint32_t*)(p->buf + p->off - 4);
+typedef struct {
+	IdxType type;
+	uint8_t rank;
+	uint32_t dims[255];
+	size_t count;  // dims[0]
+	size_t sample; // elements per entry, product of dims[1..rank)
+} IdxHeader;
+
+// reads the magic number and the dimensions, the big-endian dimensions are copied out and swapped in one pass
+void parse_idx_header(parser_t *p, IdxHeader *h) {
+	p->off = 0;
+	// read before asserting, NDEBUG builds must still step over them
+	uint8_t zero0 = parser_u8(p), zero1 = parser_u8(p);
+	assert(zero0 == 0 && zero1 == 0);
+	(void)zero0, (void)zero1;
+	h->type = (IdxType)parser_u8(p);
+	assert(idx_type_size(h->type) != 0);
+	h->rank = parser_u8(p);
+	assert(h->rank > 0 && !parser_eof(p, 4 * (size_t)h->rank));
+	memcpy(h->dims, p->buf + p->off, 4 * (size_t)h->rank);
+	p->off += 4 * (size_t)h->rank;
+	for (uint8_t d = 0; d < h->rank; ++d) h->dims[d] = IDX_BE(32, h->dims[d]);
+	h->count = h->dims[0];
+	h->sample = 1;
+	for (uint8_t d = 1; d < h->rank; ++d) h->sample *= h->dims[d];
+}
+
+void dataset_set_shape(Dataset *set, IdxHeader *h) {
+	set->count = h->count;
+	set->features = h->sample;
+	set->type = h->type;
 }
 
-#define PARSE_HEADER(p) \
-	p->off = 2; \
-	assert(parser_u8(p) == 0x08); \
-	uint8_t dims_c = parser_u8(p); \
-	uint32_t dims[dims_c]; \
-	for (uint8_t d = 0; d < dims_c; ++d) { \
-		dims[d] = parser_u32(p); \
-		dims[d] = ((dims[d] >> 24)& 0xFF) | \
-                          ((dims[d] << 8) & 0xFF0000) | \
-                          ((dims[d] >> 8) & 0xFF00) | \
-                          ((dims[d] << 24)& 0xFF000000); \
+// class indices of a label file, u8 labels are used as they are, wider integers are narrowed into a new buffer
+uint8_t *idx_labels(uint8_t *src, IdxType type, size_t count) {
+	if (type == IDX_U8) return src;
+	uint8_t *labels = (uint8_t*)malloc(count);
+	assert(labels != NULL);
+	for (size_t e = 0; e < count; ++e) {
+		int64_t v = 0;
+		switch (type) {
+		case IDX_I8: v = (int8_t)src[e]; break;
+		case IDX_I16: v = (int16_t)idx_be16(src + 2 * e); break;
+		case IDX_I32: v = (int32_t)idx_be32(src + 4 * e); break;
+		default: assert(!"labels must be integers");
+		}
+		assert(v >= 0 && v < 256);
+		labels[e] = (uint8_t)v;
 	}
+	return labels;
+}
 
-void parse_digits(parser_t *p, DataEntry *set, size_t set_size) {
-	PARSE_HEADER(p);
-	assert(dims_c == 3 && dims[0] == set_size && dims[1] == 28 && dims[2] == 28);
-	size_t res = dims[1] * dims[2];
-	for (int e = 0; e < dims[0]; ++e) {
-		set[e].x = NULL;
-		arrsetlen(set[e].x, res);
-		for (int i = 0; i < res; ++i) {
-			set[e].x[i] = (double)parser_u8(p) / 255.0;
-		}
+void dataset_count_classes(Dataset *set) {
+	set->classes = 0;
+	for (size_t e = 0; e < set->count; ++e) {
+		if (set->labels[e] >= set->classes) set->classes = set->labels[e] + 1;
+	}
+}
+
+// points set->pixels at the sample elements in p, nothing is copied
+void parse_samples(parser_t *p, Dataset *set) {
+	IdxHeader h;
+	parse_idx_header(p, &h);
+	dataset_set_shape(set, &h);
+	size_t size = h.count * h.sample * idx_type_size(h.type);
+	assert(!parser_eof(p, size));
+	set->pixels = p->buf + p->off;
+	p->off += size;
+}
+
+// points set->labels at the labels in p, only labels wider than a byte are copied,
+// returns whether set->labels is a view of p
+int parse_labels(parser_t *p, Dataset *set) {
+	IdxHeader h;
+	parse_idx_header(p, &h);
+	assert(h.rank == 1 && h.count == set->count);
+	assert(!parser_eof(p, h.count * idx_type_size(h.type)));
+	set->labels = idx_labels(p->buf + p->off, h.type, h.count);
+	p->off += h.count * idx_type_size(h.type);
+	dataset_count_classes(set);
+	return h.type == IDX_U8;
+}
+
+// maps the whole file read-only, the pages are shared with every other process mapping it.
+// p.buf is NULL, with a message on stderr, when the file cannot be opened or mapped
+parser_t map_file(const char *file_path) {
+	parser_t p = { NULL, 0, 0 };
+	int fd = open(file_path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "ERROR :: %s: %s\n", file_path, strerror(errno));
+		return p;
 	}
+	struct stat st;
+	const char *why = NULL;
+	if (fstat(fd, &st) == -1) {
+		why = strerror(errno);
+	} else if (st.st_size == 0) {
+		// mmap refuses an empty mapping, and there would be no header to parse
+		why = "empty file";
+	} else {
+		void *buf = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (buf == MAP_FAILED) why = strerror(errno);
+		else p.buf = (uint8_t*)buf, p.size = (size_t)st.st_size;
+	}
+	close(fd);
+	if (why) fprintf(stderr, "ERROR :: %s: %s\n", file_path, why);
+	return p;
 }
 
-void parse_labels(parser_t *p, DataEntry *set, size_t set_size) {
-	PARSE_HEADER(p);
-	assert(dims_c == 1 && dims[0] == set_size);
-	for (int e = 0; e < dims[0]; ++e) {
-		uint8_t digit = parser_u8(p);
-		set[e].y = NULL;
-		arrsetlen(set[e].y, Y_SIZE);
-		for (uint8_t i = 0; i < Y_SIZE; ++i) {
-			set[e].y[i] = (double)((i + 1) == digit);
+// gzread takes an unsigned length, decompress at most this much per call
+#define GZ_CHUNK (1u << 20)
+
+// inflates exactly size bytes of f into dst, chunk by chunk. returns 0 with a message on stderr
+// when the stream ends early or is corrupt
+int gz_read(gzFile f, const char *path, uint8_t *dst, size_t size) {
+	while (size > 0) {
+		unsigned chunk = size < GZ_CHUNK ? (unsigned)size : GZ_CHUNK;
+		int n = gzread(f, dst, chunk);
+		if (n <= 0) {
+			int err;
+			const char *why = gzerror(f, &err);
+			// a stream that is whole but short leaves no error behind, zlib's messages start with the path
+			if (err == Z_OK) fprintf(stderr, "ERROR :: %s: unexpected end of file\n", path);
+			else fprintf(stderr, "ERROR :: %s\n", why);
+			return 0;
 		}
+		dst += n, size -= (size_t)n;
 	}
+	return 1;
 }
 
-// @allocated
-uint8_t *read_file(const char *file_path, size_t *size) {
-	FILE *stream = fopen(file_path, "rb");
-	assert(stream != NULL);
-	assert(fseek(stream, 0, SEEK_END) != -1);
-	assert((*size = ftell(stream)) != -1);
-	assert(fseek(stream, 0, SEEK_SET) != -1);
-	uint8_t *buf = (uint8_t*)malloc(*size);
-	assert(fread(buf, 1, *size, stream) != -1);
-	fclose(stream);
-	return buf;
+// inflates the magic number and the dimensions into head, which must hold 4 + 4 * 255 bytes
+int gz_read_header(gzFile f, const char *path, uint8_t *head, parser_t *p) {
+	if (!gz_read(f, path, head, 4) || !gz_read(f, path, head + 4, 4 * (size_t)head[3])) return 0;
+	*p = (parser_t){ head, 4 + 4 * (size_t)head[3], 0 };
+	return 1;
 }
 
-void reset_parser(parser_t p) {
-	free(p.buf);
-	p.buf = NULL;
-	p.size = p.off = 0;
+// decompresses the samples straight into a heap buffer
+int stream_samples(gzFile f, const char *path, Dataset *set) {
+	uint8_t head[4 + 4 * 255];
+	parser_t p;
+	if (!gz_read_header(f, path, head, &p)) return 0;
+	IdxHeader h;
+	parse_idx_header(&p, &h);
+	dataset_set_shape(set, &h);
+	size_t size = h.count * h.sample * idx_type_size(h.type);
+	set->pixels = (uint8_t*)malloc(size);
+	assert(set->pixels != NULL);
+	return gz_read(f, path, set->pixels, size);
 }
 
-DataEntry *load_set(const char *image_path, const char *label_path, size_t set_size) {
-	size_t file_size;
-	uint8_t *buf;
-	parser_t parser;
-	DataEntry *entries = NULL;
-	arrsetlen(entries, set_size);
+// decompresses the labels straight into a heap buffer
+int stream_labels(gzFile f, const char *path, Dataset *set) {
+	uint8_t head[4 + 4 * 255];
+	parser_t p;
+	if (!gz_read_header(f, path, head, &p)) return 0;
+	IdxHeader h;
+	parse_idx_header(&p, &h);
+	assert(h.rank == 1 && h.count == set->count);
+	uint8_t *raw = (uint8_t*)malloc(h.count * idx_type_size(h.type));
+	assert(raw != NULL);
+	if (!gz_read(f, path, raw, h.count * idx_type_size(h.type))) {
+		free(raw);
+		return 0;
+	}
+	set->labels = idx_labels(raw, h.type, h.count);
+	if (set->labels != raw) free(raw);
+	dataset_count_classes(set);
+	return 1;
+}
+
+// a ".gz" path is streamed, otherwise path is mapped and if it is missing path".gz" is streamed
+gzFile open_gz(const char *path) {
+	size_t len = strlen(path);
+	if (len > 3 && strcmp(path + len - 3, ".gz") == 0) return gzopen(path, "rb");
+	if (access(path, R_OK) == 0) return NULL;
+	char gz_path[len + 4];
+	snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+	return gzopen(gz_path, "rb");
+}
+
+// loads the file into set->pixels (which = 0) or set->labels (which = 1), returns 0 with a
+// message on stderr when it cannot be read
+int load_part(const char *path, Dataset *set, int which) {
+	gzFile f = open_gz(path);
+	if (f != NULL) {
+		gzbuffer(f, GZ_CHUNK);
+		int ok = which == 0 ? stream_samples(f, path, set) : stream_labels(f, path, set);
+		gzclose(f);
+		return ok;
+	}
+	parser_t p = map_file(path);
+	if (p.buf == NULL) return 0;
+	if (which == 0) {
+		set->maps[0] = p.buf, set->map_sizes[0] = p.size;
+		parse_samples(&p, set);
+	} else if (parse_labels(&p, set)) {
+		set->maps[1] = p.buf, set->map_sizes[1] = p.size;
+	} else {
+		// the labels were narrowed into their own buffer
+		munmap(p.buf, p.size);
+	}
+	return 1;
+}
+
+Dataset *dataset_new(size_t count, size_t features, size_t classes) {
+	Dataset *set = (Dataset*)calloc(1, sizeof(Dataset));
+	set->count = count;
+	set->features = features;
+	set->classes = classes;
+	set->type = IDX_U8;
+	set->pixels = (uint8_t*)calloc(count * features, 1);
+	set->labels = (uint8_t*)calloc(count, 1);
+	assert(set->pixels != NULL && set->labels != NULL);
+	return set;
+}
+
+void dataset_destroy(Dataset *set) {
+	if (set->maps[0]) munmap(set->maps[0], set->map_sizes[0]); else free(set->pixels);
+	if (set->maps[1]) munmap(set->maps[1], set->map_sizes[1]); else free(set->labels);
+	free(set);
+}
 
-	buf = read_file(image_path, &file_size);
-	parser.buf = buf; parser.size = file_size;
-	parse_digits(&parser, entries, set_size);
-	reset_parser(parser);
+void dataset_advise(Dataset *set, DatasetAccess access) {
+	int advice = access == DATASET_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL;
+	for (size_t m = 0; m < 2; ++m) {
+		if (set->maps[m] == NULL) continue;
+		madvise(set->maps[m], set->map_sizes[m], advice);
+		// random order still reads every sample each epoch, start paging it in now
+		if (access == DATASET_RANDOM) madvise(set->maps[m], set->map_sizes[m], MADV_WILLNEED);
+	}
+}
 
-	buf = read_file(label_path, &file_size);
-	parser.buf = buf; parser.size = file_size;
-	parse_labels(&parser, entries, set_size);
-	reset_parser(parser);
+Dataset *load_set(const char *image_path, const char *label_path) {
+	Dataset *set = (Dataset*)calloc(1, sizeof(Dataset));
+	if (!load_part(image_path, set, 0) || !load_part(label_path, set, 1)) {
+		dataset_destroy(set);
+		return NULL;
+	}
 
-	return entries;
+	dataset_advise(set, DATASET_SEQUENTIAL);
+	return set;
 }
 
-DataEntry *load_training_set() {
-	return load_set(TRAIN_SET_IMAGE, TRAIN_SET_LABEL, TRAIN_SET_SIZE);
+Dataset *load_training_set() {
+	return load_set(TRAIN_SET_IMAGE, TRAIN_SET_LABEL);
 }
 
-DataEntry *load_test_set() {
-	return load_set(TEST_SET_IMAGE, TEST_SET_LABEL, TEST_SET_SIZE);
+Dataset *load_test_set() {
+	return load_set(TEST_SET_IMAGE, TEST_SET_LABEL);
 }
 #endif
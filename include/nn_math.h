@@ -3,12 +3,57 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
 #include "stb_ds.h"
 
-typedef double* vec_t;
-typedef vec_t* mat_t;
+// alignment (in bytes) of every matrix buffer and row
+#define NN_ALIGN 64
+
+// element type of every vector and matrix, build with -DNN_DOUBLE for double precision
+#ifdef NN_DOUBLE
+typedef double real_t;
+#define real_exp exp
+#else
+typedef float real_t;
+#define real_exp expf
+#endif
+
+typedef real_t* vec_t;
+
+// row-major matrix in one contiguous buffer, rows are padded to `stride` elements
+typedef struct {
+	size_t rows, cols, stride;
+	real_t *data;
+} mat_t;
+
+#define mat_row(m, i) ((m).data + (i) * (m).stride)
+// rows are padded to whole NN_ALIGN blocks
+#define mat_stride(cols) (((cols) + NN_ALIGN / sizeof(real_t) - 1) / (NN_ALIGN / sizeof(real_t)) * (NN_ALIGN / sizeof(real_t)))
+#define MAT_AT(m, i, j) ((m).data[(i) * (m).stride + (j)])
+
+// 16-bit storage of mixed-precision training
+typedef uint16_t half_t;
+
+typedef enum {
+	HALF_BF16, // the upper half of a float: its range with 8 bits of precision
+	HALF_FP16, // ieee binary16: 11 bits of precision, finite up to 65504
+} HalfFormat;
+
+// a mat_t stored in 16 bits, rows padded to whole NN_ALIGN blocks like mat_t's. mat_row and
+// MAT_AT work on it too
+typedef struct {
+	size_t rows, cols, stride;
+	half_t *data;
+	HalfFormat format;
+} hmat_t;
+
+#define hmat_stride(cols) (((cols) + NN_ALIGN / sizeof(half_t) - 1) / (NN_ALIGN / sizeof(half_t)) * (NN_ALIGN / sizeof(half_t)))
 
 typedef enum { LOAD, ADD, SUB, MUL, DIV } OpType;
 
@@ -22,43 +67,442 @@ typedef struct {
 	mat_t val;
 } MatOp;
 
+typedef enum {
+	ACT_SIGMOID,
+	ACT_TANH,
+	ACT_RELU,
+	ACT_LEAKY_RELU, // slope LEAKY_RELU_SLOPE below 0
+	ACT_SOFTMAX,    // over the units of the layer
+	ACT_IDENTITY,
+} Activation;
+
+#define LEAKY_RELU_SLOPE 0.01
+
+// applied to the output of a product while it is still in registers: z = out + bias, then
+// out = act(z). bias has an entry per column of a gemm output and per element of a gemv
+// output, act must be elementwise, softmax needs whole rows
+typedef struct {
+	const real_t *bias; // NULL adds nothing
+	Activation act;
+	real_t *z;          // optional, keeps the pre-activation laid out like the output
+	size_t ldz;         // row stride of z in a gemm
+} Epilogue;
+
+// which operands of a gemm are read transposed: GEMM_NT computes a * b^T
+typedef enum { GEMM_NN, GEMM_NT, GEMM_TN } GemmOp;
+
+// register tile of the micro-kernel and cache blocking of the packed panels
+#define GEMM_MR 4
+#define GEMM_NR (NN_ALIGN / sizeof(real_t))
+#define GEMM_MC 128 // rows of a packed A block, sized for L2
+#define GEMM_KC 256 // depth of a packed block, one A panel + one B panel fit in L1
+#define GEMM_NC 2048
+
+// parameter update rules, each one fused kernel over a parameter tensor and its state
+typedef enum { OPT_SGD, OPT_MOMENTUM, OPT_NESTEROV, OPT_RMSPROP, OPT_ADAM, OPT_ADAMW } OptimizerKind;
+
+// scalars of one optimizer step, the gradient is first turned into g = grad_scale * g + l2 * p
+typedef struct {
+	real_t lr, grad_scale;
+	real_t l2;           // l2 penalty folded into the gradient
+	real_t decay;        // decoupled weight decay, p -= lr * decay * p (adamw)
+	real_t beta1, beta2; // moment decays, beta1 is the momentum of the sgd variants
+	real_t eps;
+	real_t bias1, bias2; // adam's bias corrections 1 / (1 - beta^t)
+} OptStep;
+
+// vector kernels picked once at startup for the best instruction set the cpu supports
+typedef struct {
+	const char *isa;
+	void (*operate[DIV + 1])(real_t *dst, const real_t *src, size_t n);
+	void (*scale)(real_t *dst, real_t s, size_t n);
+	void (*axpy)(real_t *dst, const real_t *x, real_t alpha, size_t n);
+	real_t (*dot)(const real_t *a, const real_t *b, size_t n);
+	// epi is NULL or already offset to the tile
+	void (*gemm_micro)(size_t kc, const real_t *ap, const real_t *bp,
+		real_t *c, size_t ldc, size_t mr, size_t nr, real_t alpha, real_t beta, const Epilogue *epi);
+	void (*exp)(real_t *dst, const real_t *src, size_t n); // polynomial exp, see nn_simd.h for the error bound
+	void (*sigmoid)(real_t *dst, const real_t *src, size_t n);
+	void (*sigmoid_grad)(real_t *d, const real_t *a, size_t n); // d *= a * (1 - a)
+	// z = src + bias, dst = act(z), bias and z may be NULL, act is elementwise
+	void (*bias_act)(real_t *dst, const real_t *src, const real_t *bias, real_t *z, size_t n, Activation act);
+	// reads g once and writes p and its moments m, v once, m and v may be NULL when unused
+	void (*optimize[OPT_ADAMW + 1])(real_t *p, const real_t *g, real_t *m, real_t *v, size_t n, const OptStep *s);
+	// int8 products: dst[b * ldd + r] = sum of x[b * ldx + i] * w[r * ldw + i] over i < k, for
+	// the n samples b and the given rows r, k a multiple of NN_ALIGN. not generated from
+	// nn_simd.h: unsigned by signed byte products have no vector extension spelling, so the
+	// x86 paths use intrinsics
+	void (*qgemm)(int32_t *dst, size_t ldd, const uint8_t *x, size_t ldx, size_t n, const int8_t *w, size_t ldw, size_t rows, size_t k);
+	const char *qisa; // "generic", "avx2" or "avx512vnni"
+	// 16-bit storage, rounded to nearest even. bf16 flushes float subnormals to zero the way
+	// the avx512bf16 conversion does, so every path stores the same bits. intrinsics again,
+	// double builds go through float and stay on the generic path
+	void (*to_half[HALF_FP16 + 1])(half_t *dst, const real_t *src, size_t n);
+	void (*from_half[HALF_FP16 + 1])(real_t *dst, const half_t *src, size_t n);
+	// gemm_micro on bf16 panels with k interleaved in pairs, see hmat_gemm_epilogue. NULL without
+	// avx512bf16 or when real_t is double, the 16-bit products then widen their panels instead
+	void (*gemm_micro_bf16)(size_t kc, const half_t *ap, const half_t *bp,
+		real_t *c, size_t ldc, size_t mr, size_t nr, real_t alpha, real_t beta, const Epilogue *epi);
+	const char *hisa; // "generic", "f16c" or "avx512bf16"
+} NNKernels;
+
+// largest int8 weight magnitude. with 7-bit weights the pairwise sums of maddubs,
+// 2 * 255 * 63, cannot saturate its int16 lanes, so every qgemm path gives the same result
+#define QUANT_WEIGHT_MAX 63
+
+extern NNKernels nn_kernels;
+// heap allocations made so far by vec_new, mat_new and the gemm packing buffers, atomic
+// since every training thread grows packing buffers of its own
+extern _Atomic size_t nn_alloc_count;
+// forces an instruction set ("generic", "sse2", "avx2", "avx512", "neon"), returns 0 if unsupported
+int nn_kernels_use(const char *isa);
+
 vec_t vec_new(size_t);
 void vec_destroy(vec_t);
 void vec_operate(vec_t, size_t, ...);
-void vec_scale(vec_t, double);
+void vec_scale(vec_t, real_t);
 void vec_print(vec_t);
 void vec_print_dims(vec_t);
 
 void vecT_vec_dot(mat_t, vec_t, vec_t);
 void mat_vec_dot(vec_t, mat_t, vec_t);
+// dst = mat * vec, finished by the epilogue
+void mat_vec_dot_epilogue(vec_t dst, mat_t, vec_t, const Epilogue *);
 void matT_vec_dot(vec_t, mat_t, vec_t);
+void mat_mat_dot(mat_t, mat_t, mat_t);
+void mat_matT_dot(mat_t, mat_t, mat_t);
+void matT_mat_dot(mat_t, mat_t, mat_t);
+// dst = alpha * op(a, b) + beta * dst
+void mat_gemm(mat_t dst, GemmOp, mat_t a, mat_t b, real_t alpha, real_t beta);
+// mat_gemm finished by the epilogue, which runs on every tile of the last pass over k
+void mat_gemm_epilogue(mat_t dst, GemmOp, mat_t a, mat_t b, real_t alpha, real_t beta, const Epilogue *);
+
+// mat_gemm_epilogue on 16-bit operands, the products accumulate in real_t. with avx512bf16
+// two bf16 operands go through vdpbf16ps, which rounds each pair sum once and flushes
+// subnormals; every other case widens the packed panels and runs gemm_micro
+void hmat_gemm_epilogue(mat_t dst, GemmOp, hmat_t a, hmat_t b, real_t alpha, real_t beta, const Epilogue *);
 
 mat_t mat_new(size_t, size_t);
+// view of `count` rows starting at `row`, shares the data of the matrix
+mat_t mat_slice(mat_t, size_t row, size_t count);
 void mat_destroy(mat_t);
 void mat_operate(mat_t, size_t, ...);
-void mat_scale(mat_t, double);
+void mat_scale(mat_t, real_t);
 void mat_print(mat_t);
-void met_print_dims(mat_t);
+void mat_print_dims(mat_t);
+
+hmat_t hmat_new(size_t rows, size_t cols, HalfFormat);
+hmat_t hmat_slice(hmat_t, size_t row, size_t count);
+void hmat_destroy(hmat_t);
+// dst = src rounded to 16 bits, the padding of dst stays zero
+void hmat_store(hmat_t dst, mat_t src);
+// dst = src widened to real_t
+void hmat_load(mat_t dst, hmat_t src);
 
 #endif //NN_MATH_H
 
-#ifdef NN_MATH_IMPLEMENTATION
+#if defined(NN_MATH_IMPLEMENTATION) && !defined(NN_MATH_IMPLEMENTED)
+#define NN_MATH_IMPLEMENTED
+
+#define SIMD_ISA generic
+#define SIMD_WIDTH sizeof(real_t) // one lane, plain scalar code
+#include "nn_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_ISA sse2
+#define SIMD_TARGET "sse2"
+#define SIMD_WIDTH 16
+#include "nn_simd.h"
+#define SIMD_ISA avx2
+#define SIMD_TARGET "avx2,fma"
+#define SIMD_WIDTH 32
+#include "nn_simd.h"
+#define SIMD_ISA avx512
+#define SIMD_TARGET "avx512f"
+#define SIMD_WIDTH 64
+#include "nn_simd.h"
+#elif defined(__aarch64__)
+// advanced simd is part of the aarch64 baseline, no target attribute needed
+#define SIMD_ISA neon
+#define SIMD_WIDTH 16
+#include "nn_simd.h"
+#endif
+
+// the int8 products go tile by tile: tile(dst, ldd, x, ldx, w, ldw, k) fills a TS x TR tile of
+// dst, samples by rows, so every load of x feeds TR products and every load of w feeds TS.
+// the edges fall back to dot, one sample and one row at a time
+#define NN_QGEMM(name, attr, tile, dot, TS, TR) \
+	attr static void name(int32_t *dst, size_t ldd, const uint8_t *x, size_t ldx, size_t n, const int8_t *w, size_t ldw, size_t rows, size_t k) { \
+		for (size_t b = 0; b < n; b += TS) { \
+			for (size_t r = 0; r < rows; r += TR) { \
+				if (b + TS <= n && r + TR <= rows) { \
+					tile(dst + b * ldd + r, ldd, x + b * ldx, ldx, w + r * ldw, ldw, k); \
+					continue; \
+				} \
+				for (size_t s = b; s < n && s < b + TS; ++s) { \
+					for (size_t c = r; c < rows && c < r + TR; ++c) dst[s * ldd + c] = dot(x + s * ldx, w + c * ldw, k); \
+				} \
+			} \
+		} \
+	}
+
+static inline int32_t nn_qdot_generic(const uint8_t *x, const int8_t *w, size_t k) {
+	int32_t acc = 0;
+	for (size_t i = 0; i < k; ++i) acc += (int32_t)x[i] * w[i];
+	return acc;
+}
+
+static inline void nn_qtile_generic(int32_t *dst, size_t ldd, const uint8_t *x, size_t ldx, const int8_t *w, size_t ldw, size_t k) {
+	(void)ldd, (void)ldx;
+	int32_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	for (size_t i = 0; i < k; ++i) {
+		int32_t xi = x[i];
+		a0 += xi * w[i], a1 += xi * w[ldw + i], a2 += xi * w[2 * ldw + i], a3 += xi * w[3 * ldw + i];
+	}
+	dst[0] = a0, dst[1] = a1, dst[2] = a2, dst[3] = a3;
+}
+
+NN_QGEMM(nn_qgemm_generic, , nn_qtile_generic, nn_qdot_generic, 1, 4)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// maddubs multiplies 32 byte pairs and adds neighbours into int16, madd by 1 widens those
+// into int32 sums of 4
+__attribute__((target("avx2"))) static inline __m256i nn_qmadd_avx2(__m256i acc, __m256i x, __m256i w) {
+	return _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), _mm256_set1_epi16(1)));
+}
+
+__attribute__((target("avx2"))) static inline int32_t nn_hsum_avx2(__m256i v) {
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+	return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2"))) static inline int32_t nn_qdot_avx2(const uint8_t *x, const int8_t *w, size_t k) {
+	__m256i acc = _mm256_setzero_si256();
+	for (size_t i = 0; i < k; i += 32) {
+		acc = nn_qmadd_avx2(acc, _mm256_loadu_si256((const __m256i*)(x + i)), _mm256_loadu_si256((const __m256i*)(w + i)));
+	}
+	return nn_hsum_avx2(acc);
+}
+
+// 2 x 4: 8 accumulators, 2 inputs and a weight leave room in the 16 ymm registers
+__attribute__((target("avx2"))) static inline void nn_qtile_avx2(int32_t *dst, size_t ldd, const uint8_t *x, size_t ldx, const int8_t *w, size_t ldw, size_t k) {
+	__m256i acc[2][4];
+	for (size_t s = 0; s < 2; ++s) for (size_t r = 0; r < 4; ++r) acc[s][r] = _mm256_setzero_si256();
+	for (size_t i = 0; i < k; i += 32) {
+		__m256i x0 = _mm256_loadu_si256((const __m256i*)(x + i)), x1 = _mm256_loadu_si256((const __m256i*)(x + ldx + i));
+#pragma GCC unroll 4
+		for (size_t r = 0; r < 4; ++r) {
+			__m256i wv = _mm256_loadu_si256((const __m256i*)(w + r * ldw + i));
+			acc[0][r] = nn_qmadd_avx2(acc[0][r], x0, wv);
+			acc[1][r] = nn_qmadd_avx2(acc[1][r], x1, wv);
+		}
+	}
+	for (size_t s = 0; s < 2; ++s) for (size_t r = 0; r < 4; ++r) dst[s * ldd + r] = nn_hsum_avx2(acc[s][r]);
+}
+
+NN_QGEMM(nn_qgemm_avx2, __attribute__((target("avx2"))), nn_qtile_avx2, nn_qdot_avx2, 2, 4)
+
+// vpdpbusd does the byte products and the sums of 4 in one instruction, straight into int32
+#define NN_VNNI_ATTR __attribute__((target("avx512f,avx512bw,avx512vnni")))
 
-static inline double operate(double x, double y, OpType o) {
-	switch (o) {
-		case LOAD: return y;
-		case ADD: return x + y;
-		case SUB: return x - y;
-		case MUL: return x * y;
-		case DIV: return x / y;
+NN_VNNI_ATTR static inline int32_t nn_qdot_vnni(const uint8_t *x, const int8_t *w, size_t k) {
+	__m512i acc = _mm512_setzero_si512();
+	for (size_t i = 0; i < k; i += 64) acc = _mm512_dpbusd_epi32(acc, _mm512_loadu_si512(x + i), _mm512_loadu_si512(w + i));
+	return _mm512_reduce_add_epi32(acc);
+}
+
+// 4 x 4: 16 accumulators, 4 inputs and a weight out of the 32 zmm registers
+NN_VNNI_ATTR static inline void nn_qtile_vnni(int32_t *dst, size_t ldd, const uint8_t *x, size_t ldx, const int8_t *w, size_t ldw, size_t k) {
+	__m512i acc[4][4];
+	for (size_t s = 0; s < 4; ++s) for (size_t r = 0; r < 4; ++r) acc[s][r] = _mm512_setzero_si512();
+	for (size_t i = 0; i < k; i += 64) {
+		__m512i xv[4];
+#pragma GCC unroll 4
+		for (size_t s = 0; s < 4; ++s) xv[s] = _mm512_loadu_si512(x + s * ldx + i);
+#pragma GCC unroll 4
+		for (size_t r = 0; r < 4; ++r) {
+			__m512i wv = _mm512_loadu_si512(w + r * ldw + i);
+#pragma GCC unroll 4
+			for (size_t s = 0; s < 4; ++s) acc[s][r] = _mm512_dpbusd_epi32(acc[s][r], xv[s], wv);
+		}
+	}
+	for (size_t s = 0; s < 4; ++s) for (size_t r = 0; r < 4; ++r) dst[s * ldd + r] = _mm512_reduce_add_epi32(acc[s][r]);
+}
+
+NN_QGEMM(nn_qgemm_vnni, NN_VNNI_ATTR, nn_qtile_vnni, nn_qdot_vnni, 4, 4)
+#endif
+
+// bf16 is the upper half of a float rounded to nearest even, nan stays a quiet nan and
+// subnormals become a signed zero
+static inline half_t nn_bf16_from_float(float f) {
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	if ((u & 0x7FFFFFFFu) > 0x7F800000u) return (half_t)(u >> 16 | 0x40);
+	if ((u & 0x7F800000u) == 0) u &= 0x80000000u;
+	return (half_t)((u + 0x7FFFu + (u >> 16 & 1)) >> 16);
+}
+
+static inline float nn_float_from_bf16(half_t h) {
+	uint32_t u = (uint32_t)h << 16;
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static inline half_t nn_fp16_from_float(float f) {
+	_Float16 h = (_Float16)f;
+	half_t u;
+	memcpy(&u, &h, sizeof(u));
+	return u;
+}
+
+// by hand rather than through _Float16, which is a library call per value on x86 without f16c
+static inline float nn_float_from_fp16(half_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16, exp = h >> 10 & 0x1F, man = h & 0x3FF, u;
+	if (exp == 0) {
+		float f = man * 0x1p-24f;
+		return sign ? -f : f;
+	}
+	u = sign | (exp == 31 ? 0x7F800000u : (exp + 112) << 23) | man << 13;
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static inline real_t nn_half_to_real(half_t h, HalfFormat format) {
+	return format == HALF_BF16 ? nn_float_from_bf16(h) : nn_float_from_fp16(h);
+}
+
+static void nn_to_bf16_generic(half_t *dst, const real_t *src, size_t n) {
+	for (size_t i = 0; i < n; ++i) dst[i] = nn_bf16_from_float((float)src[i]);
+}
+
+static void nn_from_bf16_generic(real_t *dst, const half_t *src, size_t n) {
+	for (size_t i = 0; i < n; ++i) dst[i] = nn_float_from_bf16(src[i]);
+}
+
+static void nn_to_fp16_generic(half_t *dst, const real_t *src, size_t n) {
+	for (size_t i = 0; i < n; ++i) dst[i] = nn_fp16_from_float((float)src[i]);
+}
+
+static void nn_from_fp16_generic(real_t *dst, const half_t *src, size_t n) {
+	for (size_t i = 0; i < n; ++i) dst[i] = nn_float_from_fp16(src[i]);
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NN_DOUBLE)
+#define NN_F16C_ATTR __attribute__((target("avx,f16c")))
+
+NN_F16C_ATTR static void nn_to_fp16_f16c(half_t *dst, const real_t *src, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	}
+	nn_to_fp16_generic(dst + i, src + i, n - i);
+}
+
+NN_F16C_ATTR static void nn_from_fp16_f16c(real_t *dst, const half_t *src, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+	nn_from_fp16_generic(dst + i, src + i, n - i);
+}
+
+#define NN_BF16_ATTR __attribute__((target("avx512f,avx512bf16")))
+
+NN_BF16_ATTR static void nn_to_bf16_avx512bf16(half_t *dst, const real_t *src, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) _mm256_storeu_si256((__m256i*)(dst + i), (__m256i)_mm512_cvtneps_pbh(_mm512_loadu_ps(src + i)));
+	nn_to_bf16_generic(dst + i, src + i, n - i);
+}
+
+// a row of the A panel is one pair, broadcast against the GEMM_NR pairs of a B panel row:
+// vdpbf16ps adds both products of every pair into the float lane they share
+NN_BF16_ATTR static void nn_gemm_micro_bf16(size_t kc, const half_t *ap, const half_t *bp,
+		real_t *c, size_t ldc, size_t mr, size_t nr, real_t alpha, real_t beta, const Epilogue *epi) {
+	_Static_assert(GEMM_NR == 16, "one zmm of float lanes per panel row");
+	__m512 acc[GEMM_MR];
+	for (size_t i = 0; i < GEMM_MR; ++i) acc[i] = _mm512_setzero_ps();
+	for (size_t k = 0; k < kc; k += 2) {
+		__m512bh b = (__m512bh)_mm512_load_si512(bp);
+#pragma GCC unroll 4
+		for (size_t i = 0; i < GEMM_MR; ++i) {
+			int32_t pair;
+			memcpy(&pair, ap + 2 * i, sizeof(pair));
+			acc[i] = _mm512_dpbf16_ps(acc[i], (__m512bh)_mm512_set1_epi32(pair), b);
+		}
+		ap += 2 * GEMM_MR, bp += 2 * GEMM_NR;
+	}
+	for (size_t i = 0; i < mr; ++i) {
+		real_t *r = c + i * ldc, tile[GEMM_NR];
+		_mm512_storeu_ps(tile, acc[i]);
+		for (size_t j = 0; j < nr; ++j) tile[j] = beta == 0 ? alpha * tile[j] : alpha * tile[j] + beta * r[j];
+		if (epi) {
+			nn_kernels.bias_act(r, tile, epi->bias, epi->z ? epi->z + i * epi->ldz : NULL, nr, epi->act);
+			continue;
+		}
+		for (size_t j = 0; j < nr; ++j) r[j] = tile[j];
+	}
+}
+#endif
+
+NNKernels nn_kernels;
+_Atomic size_t nn_alloc_count;
+
+int nn_kernels_use(const char *isa) {
+	const NNKernels *k = NULL;
+	if (strcmp(isa, "generic") == 0) k = &nn_kernels_generic;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (strcmp(isa, "sse2") == 0 && __builtin_cpu_supports("sse2")) k = &nn_kernels_sse2;
+	if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) k = &nn_kernels_avx2;
+	if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) k = &nn_kernels_avx512;
+#elif defined(__aarch64__)
+	if (strcmp(isa, "neon") == 0) k = &nn_kernels_neon;
+#endif
+	if (k == NULL) return 0;
+	nn_kernels = *k;
+	nn_kernels.qgemm = nn_qgemm_generic, nn_kernels.qisa = "generic";
+#if defined(__x86_64__) || defined(__i386__)
+	if (k == &nn_kernels_avx2 || k == &nn_kernels_avx512) nn_kernels.qgemm = nn_qgemm_avx2, nn_kernels.qisa = "avx2";
+	if (k == &nn_kernels_avx512 && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni")) {
+		nn_kernels.qgemm = nn_qgemm_vnni, nn_kernels.qisa = "avx512vnni";
+	}
+#endif
+	nn_kernels.to_half[HALF_BF16] = nn_to_bf16_generic, nn_kernels.from_half[HALF_BF16] = nn_from_bf16_generic;
+	nn_kernels.to_half[HALF_FP16] = nn_to_fp16_generic, nn_kernels.from_half[HALF_FP16] = nn_from_fp16_generic;
+	nn_kernels.gemm_micro_bf16 = NULL, nn_kernels.hisa = "generic";
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NN_DOUBLE)
+	if ((k == &nn_kernels_avx2 || k == &nn_kernels_avx512) && __builtin_cpu_supports("f16c")) {
+		nn_kernels.to_half[HALF_FP16] = nn_to_fp16_f16c, nn_kernels.from_half[HALF_FP16] = nn_from_fp16_f16c;
+		nn_kernels.hisa = "f16c";
+	}
+	if (k == &nn_kernels_avx512 && __builtin_cpu_supports("avx512bf16")) {
+		nn_kernels.to_half[HALF_BF16] = nn_to_bf16_avx512bf16;
+		nn_kernels.gemm_micro_bf16 = nn_gemm_micro_bf16, nn_kernels.hisa = "avx512bf16";
+	}
+#endif
+	return 1;
+}
+
+// runs before main, NN_ISA in the environment overrides the detected instruction set
+__attribute__((constructor)) static void nn_kernels_init(void) {
+	const char *env = getenv("NN_ISA");
+	if (env != NULL && nn_kernels_use(env)) return;
+	const char *best[] = { "avx512", "avx2", "sse2", "neon", "generic" };
+	for (size_t i = 0; i < sizeof(best) / sizeof(best[0]); ++i) {
+		if (nn_kernels_use(best[i])) return;
 	}
 }
 
 vec_t vec_new(size_t len) {
 	vec_t vec = NULL;
-	for (size_t r = 0; r < len; ++r) {
-		arrpush(vec, 0);
-	}
+	if (len == 0) return vec;
+	arrsetlen(vec, len);
+	memset(vec, 0, len * sizeof(real_t));
+	nn_alloc_count++;
 	return vec;
 }
 
@@ -72,17 +516,13 @@ void vec_operate(vec_t src, size_t n, ...) {
 	for (size_t o = 0; o < n; ++o) {
 		VecOp op = va_arg(args, VecOp);
 		assert(arrlen(src) == arrlen(op.val) && "vec_operate");
-		for (size_t i = 0; i < arrlen(src); ++i) {
-			src[i] = operate(src[i], op.val[i], op.type);
-		}
+		nn_kernels.operate[op.type](src, op.val, arrlen(src));
 	}
 	va_end(args);
 }
 
-void vec_scale(vec_t src, double scaler) {
-	for (size_t i = 0; i < arrlen(src); ++i) {
-		src[i] *= scaler;
-	}
+void vec_scale(vec_t src, real_t scaler) {
+	nn_kernels.scale(src, scaler, arrlen(src));
 }
 
 void vec_print(vec_t v) {
@@ -98,18 +538,25 @@ void vec_print_dims(vec_t vec) {
 }
 
 mat_t mat_new(size_t row, size_t col) {
-	mat_t mat = NULL;
-	for (size_t r = 0; r < row; ++r) {
-		arrpush(mat, vec_new(col));
-	}
+	mat_t mat = { row, col, mat_stride(col), NULL };
+	size_t bytes = row * mat.stride * sizeof(real_t);
+	if (bytes == 0) return mat;
+	mat.data = (real_t*)aligned_alloc(NN_ALIGN, bytes);
+	assert(mat.data != NULL && "mat_new");
+	memset(mat.data, 0, bytes);
+	nn_alloc_count++;
 	return mat;
 }
 
+mat_t mat_slice(mat_t m, size_t row, size_t count) {
+	assert(row + count <= m.rows && "mat_slice");
+	m.data = mat_row(m, row);
+	m.rows = count;
+	return m;
+}
+
 void mat_destroy(mat_t m) {
-	for (size_t i = 0; i < arrlen(m); ++i) {
-		vec_destroy(m[i]);
-	}
-	arrfree(m);
+	free(m.data);
 }
 
 void mat_operate(mat_t src, size_t n, ...) {
@@ -117,73 +564,323 @@ void mat_operate(mat_t src, size_t n, ...) {
 	va_start(args, n);
 	for (size_t o = 0; o < n; ++o) {
 		MatOp op = va_arg(args, MatOp);
-		assert(arrlen(src) == arrlen(op.val) && "vec_operate");
-		for (size_t i = 0; i < arrlen(src); ++i) {
-			assert(arrlen(src[i]) == arrlen(op.val[i]) && "vec_operate");
-			for (size_t j = 0; j < arrlen(src[i]); ++j) {
-				src[i][j] = operate(src[i][j], op.val[i][j], op.type);
-			}
+		assert(src.rows == op.val.rows && src.cols == op.val.cols && "mat_operate");
+		for (size_t i = 0; i < src.rows; ++i) {
+			nn_kernels.operate[op.type](mat_row(src, i), mat_row(op.val, i), src.cols);
 		}
 	}
 	va_end(args);
 }
 
-void mat_scale(mat_t mat, double scaler) {
-	for (size_t i = 0; i < arrlen(mat); ++i) {
-		for (size_t j = 0; j < arrlen(mat[i]); ++j) {
-			mat[i][j] *= scaler;
-		}
+void mat_scale(mat_t mat, real_t scaler) {
+	for (size_t i = 0; i < mat.rows; ++i) {
+		nn_kernels.scale(mat_row(mat, i), scaler, mat.cols);
 	}
 }
 
 void mat_print(mat_t m) {
 	printf("[\n");
-	for (size_t i = 0; i < arrlen(m); ++i) {
-		printf("    "); vec_print(m[i]);
+	for (size_t i = 0; i < m.rows; ++i) {
+		printf("    [ ");
+		for (size_t j = 0; j < m.cols; ++j) {
+			printf("%lf ", MAT_AT(m, i, j));
+		}
+		printf(" ]\n");
 	}
 	printf("]\n");
 }
 
 void vecT_vec_dot(mat_t dst, vec_t a, vec_t b) {
-	assert(arrlen(dst) == arrlen(b));
-	for (size_t i = 0; i < arrlen(b); ++i) {
-		assert(arrlen(dst[i]) == arrlen(a));
-		for (size_t j = 0; j < arrlen(a); ++j) {
-			dst[i][j] = a[j] * b[i];
-		}
+	assert(dst.rows == arrlen(b) && dst.cols == arrlen(a) && "vecT_vec_dot");
+	for (size_t i = 0; i < dst.rows; ++i) {
+		nn_kernels.operate[LOAD](mat_row(dst, i), a, dst.cols);
+		nn_kernels.scale(mat_row(dst, i), b[i], dst.cols);
 	}
 }
 
 void mat_vec_dot(vec_t dst, mat_t mat, vec_t vec) {
-	assert(arrlen(mat) == arrlen(dst) && "mat_vec_dot");
-	assert(arrlen(mat[0]) == arrlen(vec) && "mat_vec_dot");
-	for (size_t i = 0; i < arrlen(mat); ++i) {
-		double val = 0;
-		for (size_t j = 0; j < arrlen(mat[i]); ++j) {
-			val += mat[i][j] * vec[j];
-		}
-		dst[i] = val;
+	assert(mat.rows == arrlen(dst) && "mat_vec_dot");
+	assert(mat.cols == arrlen(vec) && "mat_vec_dot");
+	for (size_t i = 0; i < mat.rows; ++i) {
+		dst[i] = nn_kernels.dot(mat_row(mat, i), vec, mat.cols);
 	}
 }
 
+// the dot products of a block of rows stay in an L1-resident tile until the epilogue writes them
+#define GEMV_BLOCK 64
+
+void mat_vec_dot_epilogue(vec_t dst, mat_t mat, vec_t vec, const Epilogue *epi) {
+	assert(mat.rows == arrlen(dst) && "mat_vec_dot_epilogue");
+	assert(mat.cols == arrlen(vec) && "mat_vec_dot_epilogue");
+	assert(epi->act != ACT_SOFTMAX && "mat_vec_dot_epilogue");
+	real_t tile[GEMV_BLOCK];
+	for (size_t i0 = 0; i0 < mat.rows; i0 += GEMV_BLOCK) {
+		size_t n = mat.rows - i0 < GEMV_BLOCK ? mat.rows - i0 : GEMV_BLOCK;
+		for (size_t i = 0; i < n; ++i) tile[i] = nn_kernels.dot(mat_row(mat, i0 + i), vec, mat.cols);
+		nn_kernels.bias_act(dst + i0, tile, epi->bias ? epi->bias + i0 : NULL, epi->z ? epi->z + i0 : NULL, n, epi->act);
+	}
+}
+
+// walks the matrix row by row so memory is read sequentially
 void matT_vec_dot(vec_t dst, mat_t mat, vec_t vec) {
-	assert(arrlen(mat[0]) == arrlen(dst) && "matT_vec_dot");
-	assert(arrlen(mat) == arrlen(vec) && "matT_vec_dot");
-	for (size_t j = 0; j < arrlen(mat[0]); ++j) {
-		double val = 0;
-		for (size_t i = 0; i < arrlen(mat); ++i) {
-			val += mat[i][j] * vec[i];
+	assert(mat.cols == arrlen(dst) && "matT_vec_dot");
+	assert(mat.rows == arrlen(vec) && "matT_vec_dot");
+	for (size_t j = 0; j < mat.cols; ++j) {
+		dst[j] = 0;
+	}
+	for (size_t i = 0; i < mat.rows; ++i) {
+		nn_kernels.axpy(dst, mat_row(mat, i), vec[i], mat.cols);
+	}
+}
+
+// packs op(a)[i0:i0+mc, k0:k0+kc] into GEMM_MR row panels, k-major inside a panel
+static void gemm_pack_a(real_t *dst, mat_t a, int trans, size_t i0, size_t k0, size_t mc, size_t kc) {
+	for (size_t p = 0; p < mc; p += GEMM_MR) {
+		size_t mr = mc - p < GEMM_MR ? mc - p : GEMM_MR;
+		for (size_t k = 0; k < kc; ++k) {
+			for (size_t i = 0; i < GEMM_MR; ++i) {
+				real_t v = 0;
+				if (i < mr) v = trans ? MAT_AT(a, k0 + k, i0 + p + i) : MAT_AT(a, i0 + p + i, k0 + k);
+				*dst++ = v;
+			}
 		}
-		dst[j] = val;
 	}
 }
 
-void mat_print_dims(mat_t mat) {
-	printf("mat.len(): %zu\n[\n", arrlen(mat));
-	for (size_t i = 0; i < arrlen(mat); ++i) {
-		printf("    "); vec_print_dims(mat[i]);
+// packs op(b)[k0:k0+kc, j0:j0+nc] into GEMM_NR column panels, k-major inside a panel
+static void gemm_pack_b(real_t *dst, mat_t b, int trans, size_t k0, size_t j0, size_t kc, size_t nc) {
+	for (size_t p = 0; p < nc; p += GEMM_NR) {
+		size_t nr = nc - p < GEMM_NR ? nc - p : GEMM_NR;
+		for (size_t k = 0; k < kc; ++k) {
+			if (!trans && nr == GEMM_NR) {
+				memcpy(dst, mat_row(b, k0 + k) + j0 + p, GEMM_NR * sizeof(real_t));
+				dst += GEMM_NR;
+				continue;
+			}
+			for (size_t j = 0; j < GEMM_NR; ++j) {
+				real_t v = 0;
+				if (j < nr) v = trans ? MAT_AT(b, j0 + p + j, k0 + k) : MAT_AT(b, k0 + k, j0 + p + j);
+				*dst++ = v;
+			}
+		}
 	}
-	printf("]\n");
+}
+
+// grows the per-thread packing buffers, they are kept for the life of the thread
+static real_t *gemm_buffer(real_t **buf, size_t *cap, size_t len) {
+	if (*cap < len) {
+		free(*buf);
+		*buf = (real_t*)aligned_alloc(NN_ALIGN, len * sizeof(real_t));
+		assert(*buf != NULL && "gemm_buffer");
+		*cap = len;
+		nn_alloc_count++;
+	}
+	return *buf;
+}
+
+// dst = beta * dst finished by the epilogue, the product of an empty k
+static void gemm_empty(mat_t dst, real_t beta, const Epilogue *epi) {
+	for (size_t i = 0; i < dst.rows; ++i) {
+		real_t *r = mat_row(dst, i);
+		for (size_t j = 0; j < dst.cols; ++j) r[j] = beta == 0 ? 0 : beta * r[j];
+		if (epi) nn_kernels.bias_act(r, r, epi->bias, epi->z ? epi->z + i * epi->ldz : NULL, dst.cols, epi->act);
+	}
+}
+
+// the epilogue of the tile at row i, column j of the output
+static Epilogue gemm_tile_epilogue(const Epilogue *epi, size_t i, size_t j) {
+	if (epi == NULL) return (Epilogue){ 0 };
+	return (Epilogue){ epi->bias ? epi->bias + j : NULL, epi->act, epi->z ? epi->z + i * epi->ldz + j : NULL, epi->ldz };
+}
+
+void mat_gemm(mat_t dst, GemmOp op, mat_t a, mat_t b, real_t alpha, real_t beta) {
+	mat_gemm_epilogue(dst, op, a, b, alpha, beta, NULL);
+}
+
+void mat_gemm_epilogue(mat_t dst, GemmOp op, mat_t a, mat_t b, real_t alpha, real_t beta, const Epilogue *epi) {
+	static _Thread_local real_t *abuf, *bbuf;
+	static _Thread_local size_t acap, bcap;
+	int ta = op == GEMM_TN, tb = op == GEMM_NT;
+	size_t M = ta ? a.cols : a.rows, K = ta ? a.rows : a.cols;
+	size_t N = tb ? b.rows : b.cols;
+	assert((tb ? b.cols : b.rows) == K && "mat_gemm");
+	assert(dst.rows == M && dst.cols == N && "mat_gemm");
+	assert((epi == NULL || epi->act != ACT_SOFTMAX) && "mat_gemm");
+	if (K == 0) {
+		gemm_empty(dst, beta, epi);
+		return;
+	}
+	real_t *ap = gemm_buffer(&abuf, &acap, GEMM_MC * GEMM_KC);
+	real_t *bp = gemm_buffer(&bbuf, &bcap, GEMM_KC * GEMM_NC);
+	for (size_t jc = 0; jc < N; jc += GEMM_NC) {
+		size_t nc = N - jc < GEMM_NC ? N - jc : GEMM_NC;
+		for (size_t pc = 0; pc < K; pc += GEMM_KC) {
+			size_t kc = K - pc < GEMM_KC ? K - pc : GEMM_KC;
+			// only the first pass over k applies beta, later ones accumulate, the last one
+			// finishes the tiles with the epilogue
+			real_t bt = pc == 0 ? beta : 1;
+			int last = pc + kc == K;
+			gemm_pack_b(bp, b, tb, pc, jc, kc, nc);
+			for (size_t ic = 0; ic < M; ic += GEMM_MC) {
+				size_t mc = M - ic < GEMM_MC ? M - ic : GEMM_MC;
+				gemm_pack_a(ap, a, ta, ic, pc, mc, kc);
+				for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+					size_t nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+					for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+						size_t mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+						Epilogue tile = gemm_tile_epilogue(epi, ic + ir, jc + jr);
+						nn_kernels.gemm_micro(kc, ap + ir * kc, bp + jr * kc,
+							mat_row(dst, ic + ir) + jc + jr, dst.stride, mr, nr, alpha, bt, epi && last ? &tile : NULL);
+					}
+				}
+			}
+		}
+	}
+}
+
+// packs `count` rows of a 16-bit operand from r0 on, depth k0:k0+kc, into panels of `width`
+// rows, k-major inside a panel. element (r, k) is m[k][r] when trans is set, so an A block
+// packs with its own trans and a B block with the opposite one. pairs keeps the values 16-bit
+// with k interleaved in pairs, padded with a zero to an even depth, for gemm_micro_bf16;
+// otherwise they are widened to the real_t panels of gemm_micro. every layout reads the rows
+// of m contiguously, the widening goes through the from_half kernels
+static void hgemm_pack(void *dst, hmat_t m, int trans, size_t r0, size_t k0, size_t count, size_t kc, size_t width, int pairs) {
+	static _Thread_local real_t row[GEMM_KC];
+	real_t *w = (real_t*)dst;
+	half_t *h = (half_t*)dst;
+	void (*widen)(real_t *, const half_t *, size_t) = nn_kernels.from_half[m.format];
+	for (size_t p = 0; p < count; p += width) {
+		size_t n = count - p < width ? count - p : width;
+		if (pairs && trans) {
+			// rows k and k + 1 of m interleaved
+			for (size_t k = 0; k < kc; k += 2, h += 2 * width) {
+				const half_t *a = mat_row(m, k0 + k) + r0 + p, *b = k + 1 < kc ? mat_row(m, k0 + k + 1) + r0 + p : NULL;
+				for (size_t r = 0; r < n; ++r) h[2 * r] = a[r], h[2 * r + 1] = b ? b[r] : 0;
+				memset(h + 2 * n, 0, (width - n) * 2 * sizeof(half_t));
+			}
+		} else if (pairs) {
+			// a pair is 32 contiguous bits of a row of m
+			size_t kp = (kc + 1) / 2;
+			uint32_t *q = (uint32_t*)h;
+			for (size_t r = 0; r < width; ++r) {
+				const half_t *a = r < n ? mat_row(m, r0 + p + r) + k0 : NULL;
+				for (size_t k = 0; k < kp; ++k) {
+					uint32_t v = 0;
+					if (a && 2 * k + 1 < kc) memcpy(&v, a + 2 * k, sizeof(v));
+					else if (a) v = a[2 * k];
+					q[k * width + r] = v;
+				}
+			}
+			h += 2 * kp * width;
+		} else if (trans) {
+			for (size_t k = 0; k < kc; ++k, w += width) {
+				widen(w, mat_row(m, k0 + k) + r0 + p, n);
+				for (size_t r = n; r < width; ++r) w[r] = 0;
+			}
+		} else {
+			for (size_t r = 0; r < width; ++r) {
+				if (r < n) widen(row, mat_row(m, r0 + p + r) + k0, kc);
+				for (size_t k = 0; k < kc; ++k) w[k * width + r] = r < n ? row[k] : 0;
+			}
+			w += kc * width;
+		}
+	}
+}
+
+void hmat_gemm_epilogue(mat_t dst, GemmOp op, hmat_t a, hmat_t b, real_t alpha, real_t beta, const Epilogue *epi) {
+	static _Thread_local real_t *abuf, *bbuf;
+	static _Thread_local size_t acap, bcap;
+	int ta = op == GEMM_TN, tb = op == GEMM_NT;
+	size_t M = ta ? a.cols : a.rows, K = ta ? a.rows : a.cols;
+	size_t N = tb ? b.rows : b.cols;
+	assert((tb ? b.cols : b.rows) == K && "hmat_gemm");
+	assert(dst.rows == M && dst.cols == N && "hmat_gemm");
+	assert((epi == NULL || epi->act != ACT_SOFTMAX) && "hmat_gemm");
+	if (K == 0) {
+		gemm_empty(dst, beta, epi);
+		return;
+	}
+	int pairs = nn_kernels.gemm_micro_bf16 != NULL && a.format == HALF_BF16 && b.format == HALF_BF16;
+	// the pair panels take half the bytes of the widened ones, both fit the same buffers
+	real_t *ap = gemm_buffer(&abuf, &acap, GEMM_MC * GEMM_KC);
+	real_t *bp = gemm_buffer(&bbuf, &bcap, GEMM_KC * GEMM_NC);
+	for (size_t jc = 0; jc < N; jc += GEMM_NC) {
+		size_t nc = N - jc < GEMM_NC ? N - jc : GEMM_NC;
+		for (size_t pc = 0; pc < K; pc += GEMM_KC) {
+			size_t kc = K - pc < GEMM_KC ? K - pc : GEMM_KC, kp = pairs ? (kc + 1) / 2 * 2 : kc;
+			real_t bt = pc == 0 ? beta : 1;
+			int last = pc + kc == K;
+			hgemm_pack(bp, b, !tb, jc, pc, nc, kc, GEMM_NR, pairs);
+			for (size_t ic = 0; ic < M; ic += GEMM_MC) {
+				size_t mc = M - ic < GEMM_MC ? M - ic : GEMM_MC;
+				hgemm_pack(ap, a, ta, ic, pc, mc, kc, GEMM_MR, pairs);
+				for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+					size_t nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+					for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+						size_t mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+						Epilogue tile = gemm_tile_epilogue(epi, ic + ir, jc + jr);
+						real_t *c = mat_row(dst, ic + ir) + jc + jr;
+						if (pairs) {
+							nn_kernels.gemm_micro_bf16(kp, (half_t*)ap + ir * kp, (half_t*)bp + jr * kp, c, dst.stride, mr, nr, alpha, bt, epi && last ? &tile : NULL);
+						} else {
+							nn_kernels.gemm_micro(kc, ap + ir * kc, bp + jr * kc, c, dst.stride, mr, nr, alpha, bt, epi && last ? &tile : NULL);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// dst = a * b
+void mat_mat_dot(mat_t dst, mat_t a, mat_t b) {
+	mat_gemm(dst, GEMM_NN, a, b, 1, 0);
+}
+
+// dst = a * b^T
+void mat_matT_dot(mat_t dst, mat_t a, mat_t b) {
+	mat_gemm(dst, GEMM_NT, a, b, 1, 0);
+}
+
+// dst = a^T * b
+void matT_mat_dot(mat_t dst, mat_t a, mat_t b) {
+	mat_gemm(dst, GEMM_TN, a, b, 1, 0);
+}
+
+void mat_print_dims(mat_t mat) {
+	printf("mat: %zux%zu (stride %zu)\n", mat.rows, mat.cols, mat.stride);
+}
+
+hmat_t hmat_new(size_t rows, size_t cols, HalfFormat format) {
+	hmat_t m = { rows, cols, hmat_stride(cols), NULL, format };
+	size_t bytes = rows * m.stride * sizeof(half_t);
+	if (bytes == 0) return m;
+	m.data = (half_t*)aligned_alloc(NN_ALIGN, bytes);
+	assert(m.data != NULL && "hmat_new");
+	memset(m.data, 0, bytes);
+	nn_alloc_count++;
+	return m;
+}
+
+hmat_t hmat_slice(hmat_t m, size_t row, size_t count) {
+	assert(row + count <= m.rows && "hmat_slice");
+	m.data = mat_row(m, row);
+	m.rows = count;
+	return m;
+}
+
+void hmat_destroy(hmat_t m) {
+	free(m.data);
+}
+
+void hmat_store(hmat_t dst, mat_t src) {
+	assert(dst.rows == src.rows && dst.cols == src.cols && "hmat_store");
+	for (size_t i = 0; i < src.rows; ++i) nn_kernels.to_half[dst.format](mat_row(dst, i), mat_row(src, i), src.cols);
+}
+
+void hmat_load(mat_t dst, hmat_t src) {
+	assert(dst.rows == src.rows && dst.cols == src.cols && "hmat_load");
+	for (size_t i = 0; i < src.rows; ++i) nn_kernels.from_half[src.format](mat_row(dst, i), mat_row(src, i), src.cols);
 }
 
 #endif
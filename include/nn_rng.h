@@ -0,0 +1,99 @@
+#ifndef NN_RNG_H
+#define NN_RNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "nn_math.h"
+
+// xoshiro256++ generator. every thread owns its own state, so nothing is shared or locked,
+// and a (seed, stream) pair always produces the same sequence
+typedef struct {
+	uint64_t s[4];
+} Rng;
+
+// streams of a training run, each derived from the seed on its own
+enum {
+	RNG_STREAM_INIT = 1,    // weight initialization, one sub-stream per block of rows
+	RNG_STREAM_SHUFFLE = 2, // epoch order
+	RNG_STREAM_LOADER = 3,  // prefetch thread augmentation
+	RNG_STREAM_WORKER = 16, // + worker id, inline augmentation
+};
+
+static inline uint64_t rng_splitmix(uint64_t *x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// the state of stream is splitmix64 expanded from a hash of seed and stream
+static inline void rng_seed(Rng *rng, uint64_t seed, uint64_t stream) {
+	uint64_t h = stream;
+	uint64_t x = seed ^ rng_splitmix(&h);
+	for (size_t i = 0; i < 4; ++i) rng->s[i] = rng_splitmix(&x);
+}
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng *rng) {
+	uint64_t *s = rng->s;
+	uint64_t result = rng_rotl(s[0] + s[3], 23) + s[0];
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rng_rotl(s[3], 45);
+	return result;
+}
+
+// uniform in [0, range) by multiply-shift, the rare low products that would bias it are redrawn
+static inline uint64_t rng_bounded(Rng *rng, uint64_t range) {
+	unsigned __int128 m = (unsigned __int128)rng_next(rng) * range;
+	if ((uint64_t)m < range) {
+		uint64_t floor = -range % range;
+		while ((uint64_t)m < floor) m = (unsigned __int128)rng_next(rng) * range;
+	}
+	return (uint64_t)(m >> 64);
+}
+
+// uniform in (0, 1), never 0 so it is safe to take the log of
+static inline double rng_uniform(Rng *rng) {
+	return ((rng_next(rng) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+// fills dst with n normal samples. box-muller in blocks: the uniforms of a block are drawn
+// first, then transformed pairwise in loops with no dependency between iterations
+static inline void rng_normal(Rng *rng, real_t *dst, size_t n, real_t mean, real_t stddev) {
+	enum { BLOCK = 128 };
+	double u[BLOCK], v[BLOCK];
+	for (size_t off = 0; off < n; off += 2 * BLOCK) {
+		size_t left = n - off, pairs = left / 2 < BLOCK ? (left + 1) / 2 : BLOCK;
+		for (size_t i = 0; i < pairs; ++i) u[i] = rng_uniform(rng), v[i] = rng_uniform(rng);
+		real_t *d = dst + off;
+		size_t full = left / 2 < pairs ? left / 2 : pairs;
+		for (size_t i = 0; i < full; ++i) {
+			double r = sqrt(-2.0 * log(u[i])), t = 2.0 * M_PI * v[i];
+			d[2*i] = mean + stddev * (real_t)(r * cos(t));
+			d[2*i+1] = mean + stddev * (real_t)(r * sin(t));
+		}
+		// odd n, the last pair only has room for its cosine half
+		if (full < pairs) d[2*full] = mean + stddev * (real_t)(sqrt(-2.0 * log(u[full])) * cos(2.0 * M_PI * v[full]));
+	}
+}
+
+// fisher-yates over n indices
+static inline void rng_shuffle(Rng *rng, size_t *idx, size_t n) {
+	for (size_t i = n; i > 1; --i) {
+		size_t j = rng_bounded(rng, i);
+		size_t temp = idx[i-1];
+		idx[i-1] = idx[j];
+		idx[j] = temp;
+	}
+}
+
+#endif // NN_RNG_H
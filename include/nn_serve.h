@@ -0,0 +1,370 @@
+#ifndef NN_SERVE_H
+#define NN_SERVE_H
+
+#include <pthread.h>
+#include "nn.h"
+
+// inference over a unix domain socket. every connection sends one request at a time and
+// reads its reply; the requests of all connections queue up and are answered in
+// micro-batches of one forward pass each.
+// wire format, in native byte order since the socket is local:
+//   request: uint32_t features, then that many floats, normalized like dataset_load_x
+//   reply:   uint32_t class, uint32_t outputs, then that many floats, the output activations
+// a request with the wrong number of features is answered with SERVE_BAD_REQUEST and no
+// outputs, and its connection is closed
+#define SERVE_BAD_REQUEST UINT32_MAX
+// latencies the percentiles are taken over, the latest ones
+#define SERVE_LATENCIES 65536
+
+typedef struct {
+	const char *path; // of the socket, replaced when something is already there
+	size_t max_batch; // requests per forward pass, 0 picks 64
+	double max_wait;  // seconds the first request of a batch waits for it to fill, 0 does not wait
+} ServeConfig;
+
+typedef struct {
+	uint64_t requests, batches; // answered since server_start
+	double seconds;             // since server_start
+	double throughput;          // requests per second
+	double mean_batch;          // requests per forward pass
+	double p50, p99;            // seconds from a request arriving to its reply being sent
+} ServeStats;
+
+// a request on its way through the queue, owned by the thread of its connection
+typedef struct {
+	float *x, *y;
+	uint32_t class;
+	double arrived;
+	bool done;
+} ServeRequest;
+
+typedef struct {
+	Network *net;
+	ServeConfig cfg;
+	int fd; // listening socket
+	pthread_t acceptor, batcher;
+	pthread_mutex_t lock; // guards everything below
+	pthread_cond_t queued, replied, closed;
+	ServeRequest **queue; // stb_ds array, oldest first
+	int *conns;           // stb_ds array of open connections
+	bool stopping;
+	double started;
+	uint64_t requests, batches;
+	double *latencies; // ring of SERVE_LATENCIES
+} Server;
+
+// binds cfg->path and answers requests on background threads until server_stop. the network
+// is only read, from one thread, and must not be trained, tested or destroyed while it
+// serves. returns NULL with a message on stderr when the socket cannot be set up
+Server *server_start(Network *net, const ServeConfig *cfg);
+ServeStats server_stats(Server *s);
+// stops accepting, answers what is already queued, closes every connection and the socket.
+// returns the counters as they ended
+ServeStats server_stop(Server *s);
+
+// client side: a connection to a server, -1 with a message on stderr when it cannot
+int serve_connect(const char *path);
+// one request over a connection from serve_connect. the first `outputs` output activations go
+// to y when it is not NULL. returns the class, SERVE_BAD_REQUEST when the server rejected the
+// request or the connection failed
+uint32_t serve_classify(int fd, const float *x, uint32_t features, float *y, size_t outputs);
+
+#endif // NN_SERVE_H
+
+#if defined(NN_SERVE_IMPLEMENTATION) && !defined(NN_SERVE_IMPLEMENTED)
+#define NN_SERVE_IMPLEMENTED
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static double serve_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// whole reads and writes, false on end of file or error
+static bool serve_read(int fd, void *buf, size_t size) {
+	for (size_t off = 0; off < size;) {
+		ssize_t got = recv(fd, (char*)buf + off, size - off, 0);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+		off += got;
+	}
+	return true;
+}
+
+static bool serve_write(int fd, const void *buf, size_t size) {
+	for (size_t off = 0; off < size;) {
+		// a client gone before its reply is an error here, not a SIGPIPE
+		ssize_t put = send(fd, (const char*)buf + off, size - off, MSG_NOSIGNAL);
+		if (put < 0 && errno == EINTR) continue;
+		if (put <= 0) return false;
+		off += put;
+	}
+	return true;
+}
+
+static bool serve_address(const char *path, struct sockaddr_un *addr) {
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) return false;
+	strcpy(addr->sun_path, path);
+	return true;
+}
+
+typedef struct {
+	Server *s;
+	int fd;
+} ServeConn;
+
+// one thread per connection: reads a request, queues it, waits for the batcher to fill it in
+// and sends the reply
+static void *serve_conn(void *arg) {
+	ServeConn *c = (ServeConn*)arg;
+	Server *s = c->s;
+	int fd = c->fd;
+	free(c);
+	size_t features = s->net->sizes[0], outputs = s->net->sizes[arrlen(s->net->sizes) - 1];
+	uint32_t reply[2] = { 0, (uint32_t)outputs };
+	ServeRequest r = { .x = (float*)malloc(features * sizeof(float)), .y = (float*)malloc(outputs * sizeof(float)) };
+	uint32_t n;
+	while (serve_read(fd, &n, sizeof(n))) {
+		if (n != features) {
+			uint32_t bad[2] = { SERVE_BAD_REQUEST, 0 };
+			serve_write(fd, bad, sizeof(bad));
+			break;
+		}
+		if (!serve_read(fd, r.x, features * sizeof(float))) break;
+		r.arrived = serve_now();
+		r.done = false;
+		pthread_mutex_lock(&s->lock);
+		// the batcher may be gone once stopping is set, nothing is queued after that
+		bool queue = !s->stopping;
+		if (queue) {
+			arrpush(s->queue, &r);
+			pthread_cond_signal(&s->queued);
+		}
+		while (queue && !r.done) pthread_cond_wait(&s->replied, &s->lock);
+		pthread_mutex_unlock(&s->lock);
+		if (!queue) break;
+		reply[0] = r.class;
+		if (!serve_write(fd, reply, sizeof(reply)) || !serve_write(fd, r.y, outputs * sizeof(float))) break;
+		double latency = serve_now() - r.arrived;
+		pthread_mutex_lock(&s->lock);
+		s->latencies[s->requests++ % SERVE_LATENCIES] = latency;
+		pthread_mutex_unlock(&s->lock);
+	}
+	free(r.x);
+	free(r.y);
+	pthread_mutex_lock(&s->lock);
+	for (size_t i = 0; i < arrlen(s->conns); ++i) {
+		if (s->conns[i] == fd) {
+			arrdelswap(s->conns, i);
+			break;
+		}
+	}
+	close(fd);
+	pthread_cond_signal(&s->closed);
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+static void *serve_accept(void *arg) {
+	Server *s = (Server*)arg;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (;;) {
+		int fd = accept(s->fd, NULL, NULL);
+		if (fd == -1 && errno == EINTR) continue;
+		// server_stop shuts the socket down, which fails the accept
+		if (fd == -1) break;
+		ServeConn *c = (ServeConn*)malloc(sizeof(ServeConn));
+		*c = (ServeConn){ .s = s, .fd = fd };
+		pthread_t t;
+		pthread_mutex_lock(&s->lock);
+		if (s->stopping || pthread_create(&t, &attr, serve_conn, c) != 0) {
+			close(fd);
+			free(c);
+		} else {
+			arrpush(s->conns, fd);
+		}
+		pthread_mutex_unlock(&s->lock);
+	}
+	pthread_attr_destroy(&attr);
+	return NULL;
+}
+
+// takes the oldest requests once max_batch of them are queued or the first has waited
+// max_wait, and answers them with one network_predict. the queue is drained before it stops
+static void *serve_batch(void *arg) {
+	Server *s = (Server*)arg;
+	Network *net = s->net;
+	size_t features = net->sizes[0], outputs = net->sizes[arrlen(net->sizes) - 1];
+	size_t max = s->cfg.max_batch;
+	mat_t X = mat_new(max, features), Y = mat_new(max, outputs);
+	ServeRequest **batch = (ServeRequest**)malloc(max * sizeof(ServeRequest*));
+	// a first pass over the zeroed buffers grows the workspace, the batches never allocate
+	network_predict(net, X, Y);
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		while (arrlen(s->queue) == 0 && !s->stopping) pthread_cond_wait(&s->queued, &s->lock);
+		if (arrlen(s->queue) == 0) break;
+		double deadline = s->queue[0]->arrived + s->cfg.max_wait;
+		struct timespec ts = { (time_t)deadline, (long)((deadline - (time_t)deadline) * 1e9) };
+		while ((size_t)arrlen(s->queue) < max && !s->stopping && serve_now() < deadline) {
+			pthread_cond_timedwait(&s->queued, &s->lock, &ts);
+		}
+		size_t n = (size_t)arrlen(s->queue) < max ? (size_t)arrlen(s->queue) : max;
+		memcpy(batch, s->queue, n * sizeof(ServeRequest*));
+		arrdeln(s->queue, 0, n);
+		pthread_mutex_unlock(&s->lock);
+
+		mat_t Xn = mat_slice(X, 0, n), Yn = mat_slice(Y, 0, n);
+		for (size_t b = 0; b < n; ++b) {
+			real_t *x = mat_row(Xn, b);
+			for (size_t i = 0; i < features; ++i) x[i] = batch[b]->x[i];
+		}
+		network_predict(net, Xn, Yn);
+		for (size_t b = 0; b < n; ++b) {
+			real_t *y = mat_row(Yn, b);
+			size_t best = 0;
+			for (size_t k = 0; k < outputs; ++k) {
+				batch[b]->y[k] = (float)y[k];
+				if (y[k] > y[best]) best = k;
+			}
+			batch[b]->class = (uint32_t)best;
+		}
+
+		pthread_mutex_lock(&s->lock);
+		for (size_t b = 0; b < n; ++b) batch[b]->done = true;
+		s->batches++;
+		pthread_cond_broadcast(&s->replied);
+	}
+	pthread_mutex_unlock(&s->lock);
+	free(batch);
+	mat_destroy(X);
+	mat_destroy(Y);
+	return NULL;
+}
+
+Server *server_start(Network *net, const ServeConfig *cfg) {
+	struct sockaddr_un addr;
+	if (!serve_address(cfg->path, &addr)) {
+		fprintf(stderr, "ERROR :: %s: socket path too long\n", cfg->path);
+		return NULL;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		fprintf(stderr, "ERROR :: socket: %s\n", strerror(errno));
+		return NULL;
+	}
+	unlink(cfg->path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+		fprintf(stderr, "ERROR :: %s: %s\n", cfg->path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	Server *s = (Server*)calloc(1, sizeof(Server));
+	s->net = net;
+	s->cfg = *cfg;
+	if (s->cfg.max_batch == 0) s->cfg.max_batch = 64;
+	s->fd = fd;
+	s->latencies = (double*)malloc(SERVE_LATENCIES * sizeof(double));
+	s->started = serve_now();
+	pthread_mutex_init(&s->lock, NULL);
+	// the batcher's deadlines are on the monotonic clock
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&s->queued, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&s->replied, NULL);
+	pthread_cond_init(&s->closed, NULL);
+	// outside the asserts, so NDEBUG builds still start them
+	int err = pthread_create(&s->batcher, NULL, serve_batch, s);
+	assert(err == 0 && "server_start");
+	err = pthread_create(&s->acceptor, NULL, serve_accept, s);
+	assert(err == 0 && "server_start");
+	(void)err;
+	return s;
+}
+
+static int serve_cmp(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+ServeStats server_stats(Server *s) {
+	pthread_mutex_lock(&s->lock);
+	ServeStats st = { .requests = s->requests, .batches = s->batches, .seconds = serve_now() - s->started };
+	size_t n = s->requests < SERVE_LATENCIES ? s->requests : SERVE_LATENCIES;
+	double *sorted = (double*)malloc((n > 0 ? n : 1) * sizeof(double));
+	memcpy(sorted, s->latencies, n * sizeof(double));
+	pthread_mutex_unlock(&s->lock);
+	qsort(sorted, n, sizeof(double), serve_cmp);
+	// nearest rank
+	if (n > 0) st.p50 = sorted[(n - 1) / 2], st.p99 = sorted[(n * 99 + 99) / 100 - 1];
+	free(sorted);
+	st.throughput = st.seconds > 0 ? st.requests / st.seconds : 0;
+	st.mean_batch = st.batches ? (double)st.requests / st.batches : 0;
+	return st;
+}
+
+ServeStats server_stop(Server *s) {
+	pthread_mutex_lock(&s->lock);
+	s->stopping = true;
+	pthread_cond_broadcast(&s->queued);
+	pthread_mutex_unlock(&s->lock);
+	shutdown(s->fd, SHUT_RDWR);
+	pthread_join(s->acceptor, NULL);
+	close(s->fd);
+	unlink(s->cfg.path);
+	pthread_join(s->batcher, NULL);
+	// the connection threads wake up to a closed socket and leave
+	pthread_mutex_lock(&s->lock);
+	for (size_t i = 0; i < arrlen(s->conns); ++i) shutdown(s->conns[i], SHUT_RDWR);
+	while (arrlen(s->conns) > 0) pthread_cond_wait(&s->closed, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+	ServeStats st = server_stats(s);
+	arrfree(s->conns);
+	arrfree(s->queue);
+	free(s->latencies);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->queued);
+	pthread_cond_destroy(&s->replied);
+	pthread_cond_destroy(&s->closed);
+	free(s);
+	return st;
+}
+
+int serve_connect(const char *path) {
+	struct sockaddr_un addr;
+	if (!serve_address(path, &addr)) {
+		fprintf(stderr, "ERROR :: %s: socket path too long\n", path);
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd != -1 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+	fprintf(stderr, "ERROR :: %s: %s\n", path, strerror(errno));
+	if (fd != -1) close(fd);
+	return -1;
+}
+
+uint32_t serve_classify(int fd, const float *x, uint32_t features, float *y, size_t outputs) {
+	uint32_t reply[2];
+	if (!serve_write(fd, &features, sizeof(features)) || !serve_write(fd, x, features * sizeof(float))) return SERVE_BAD_REQUEST;
+	if (!serve_read(fd, reply, sizeof(reply))) return SERVE_BAD_REQUEST;
+	for (uint32_t k = 0; k < reply[1]; ++k) {
+		float v;
+		if (!serve_read(fd, &v, sizeof(v))) return SERVE_BAD_REQUEST;
+		if (y && k < outputs) y[k] = v;
+	}
+	return reply[0];
+}
+
+#endif // NN_SERVE_IMPLEMENTATION
@@ -0,0 +1,349 @@
+// kernel template, included once per instruction set by the NN_MATH_IMPLEMENTATION
+// section of nn_math.h with these defined:
+//   SIMD_ISA    suffix of the generated functions (sse2, avx2, ...)
+//   SIMD_TARGET string for __attribute__((target)), left undefined for the baseline
+//   SIMD_WIDTH  vector width in bytes
+// the bodies are written with gcc/clang vector extensions, so the same source
+// lowers to SSE2, AVX2, AVX-512 or NEON depending on SIMD_TARGET.
+
+#ifndef NN_SIMD_EXP
+#define NN_SIMD_EXP
+// exp(x) = 2^k * p(r) with k = round(x / ln2) and r = x - k * ln2 in [-ln2/2, ln2/2], where
+// p is the taylor polynomial of e^r (truncation error below r^(d+1) / (d+1)!) and ln2 is split
+// in a high part exact in k * ln2_hi and a low correction. x is clamped so 2^k stays a normal
+// number. measured against libm over [-EXP_CLAMP, EXP_CLAMP] the relative error of exp stays
+// below 1e-7 in float and 5e-16 in double, sigmoid's absolute error below 9e-8 / 2.3e-16
+#ifdef NN_DOUBLE
+typedef int64_t simd_int_t;
+#define EXP_CLAMP 708.0
+#define EXP_OFFSET 1024.5 // keeps x / ln2 positive so truncation rounds
+#define EXP_BIAS 1023
+#define EXP_MANTISSA 52
+#define EXP_LN2_HI 6.93147180369123816490e-01
+#define EXP_LN2_LO 1.90821492927058770002e-10
+#define EXP_DEGREE 12
+#define RSQRT_MAGIC 0x5FE6EB50C7B537A9ll
+#define RSQRT_STEPS 4
+#else
+typedef int32_t simd_int_t;
+#define EXP_CLAMP 87.0f
+#define EXP_OFFSET 128.5f
+#define EXP_BIAS 127
+#define EXP_MANTISSA 23
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+#define EXP_DEGREE 7
+#define RSQRT_MAGIC 0x5F375A86
+#define RSQRT_STEPS 3
+#endif
+// 1/sqrt(x) by newton steps y *= 1.5 - x/2 y^2 from the bit-level guess magic - bits(x) / 2,
+// which is within 3.5%. every step squares the relative error, so 3 steps (float) and 4
+// (double) end at the rounding error, x = 0 gives a finite y and x * y = 0
+#endif
+
+#define SIMD_CAT_(a, b) a##_##b
+#define SIMD_CAT(a, b) SIMD_CAT_(a, b)
+#define SIMD_STR_(a) #a
+#define SIMD_STR(a) SIMD_STR_(a)
+#define SIMD_FN(name) SIMD_CAT(name, SIMD_ISA)
+#define SIMD_LANES (SIMD_WIDTH / sizeof(real_t))
+#ifdef SIMD_TARGET
+#define SIMD_ATTR __attribute__((target(SIMD_TARGET)))
+#else
+#define SIMD_ATTR
+#endif
+
+typedef real_t SIMD_FN(vreal) __attribute__((vector_size(SIMD_WIDTH)));
+// unaligned, may alias the scalar buffers it is loaded from
+typedef real_t SIMD_FN(vreal_u) __attribute__((vector_size(SIMD_WIDTH), aligned(sizeof(real_t)), may_alias));
+
+typedef simd_int_t SIMD_FN(vint) __attribute__((vector_size(SIMD_WIDTH)));
+
+#define VREAL SIMD_FN(vreal)
+#define VINT SIMD_FN(vint)
+#define VLOAD(p) (*(SIMD_FN(vreal_u)*)(p))
+// lanes of a where mask is set, b elsewhere
+#define VSELECT(mask, a, b) ((VREAL)(((VINT)(a) & (mask)) | ((VINT)(b) & ~(mask))))
+
+#define SIMD_BINARY(name, expr) \
+	SIMD_ATTR static void SIMD_FN(name)(real_t *dst, const real_t *src, size_t n) { \
+		size_t i = 0; \
+		for (; i + SIMD_LANES <= n; i += SIMD_LANES) { \
+			VREAL x = VLOAD(dst + i), y = VLOAD(src + i); \
+			(void)x; VLOAD(dst + i) = (expr); \
+		} \
+		for (; i < n; ++i) { \
+			real_t x = dst[i], y = src[i]; \
+			(void)x; dst[i] = (expr); \
+		} \
+	}
+
+SIMD_BINARY(simd_load, y)
+SIMD_BINARY(simd_add, x + y)
+SIMD_BINARY(simd_sub, x - y)
+SIMD_BINARY(simd_mul, x * y)
+SIMD_BINARY(simd_div, x / y)
+
+SIMD_ATTR static void SIMD_FN(simd_scale)(real_t *dst, real_t s, size_t n) {
+	size_t i = 0;
+	for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+		VLOAD(dst + i) = VLOAD(dst + i) * s;
+	}
+	for (; i < n; ++i) dst[i] *= s;
+}
+
+// dst += alpha * x
+SIMD_ATTR static void SIMD_FN(simd_axpy)(real_t *restrict dst, const real_t *restrict x, real_t alpha, size_t n) {
+	size_t i = 0;
+	for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+		VLOAD(dst + i) = VLOAD(dst + i) + alpha * VLOAD(x + i);
+	}
+	for (; i < n; ++i) dst[i] += alpha * x[i];
+}
+
+SIMD_ATTR static real_t SIMD_FN(simd_dot)(const real_t *a, const real_t *b, size_t n) {
+	// four independent accumulators hide the add latency
+	VREAL acc[4] = {0};
+	size_t i = 0;
+	for (; i + 4 * SIMD_LANES <= n; i += 4 * SIMD_LANES) {
+		for (size_t u = 0; u < 4; ++u) {
+			acc[u] += VLOAD(a + i + u * SIMD_LANES) * VLOAD(b + i + u * SIMD_LANES);
+		}
+	}
+	for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+		acc[0] += VLOAD(a + i) * VLOAD(b + i);
+	}
+	VREAL sum = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	real_t val = 0;
+	for (size_t l = 0; l < SIMD_LANES; ++l) val += sum[l];
+	for (; i < n; ++i) val += a[i] * b[i];
+	return val;
+}
+
+// see NN_SIMD_EXP for the method and the error bound
+SIMD_ATTR static inline VREAL SIMD_FN(simd_vexp)(VREAL x) {
+	VREAL lo = (VREAL){ 0 } - EXP_CLAMP, hi = (VREAL){ 0 } + EXP_CLAMP;
+	x = VSELECT(x < lo, lo, x);
+	x = VSELECT(x > hi, hi, x);
+	VINT k = __builtin_convertvector(x * (real_t)M_LOG2E + EXP_OFFSET, VINT) - (simd_int_t)EXP_OFFSET;
+	VREAL kf = __builtin_convertvector(k, VREAL);
+	VREAL r = x - kf * EXP_LN2_HI - kf * EXP_LN2_LO;
+	// horner over 1/d!, ..., 1/2!, 1, 1
+	real_t c = 1;
+	for (int d = 2; d <= EXP_DEGREE; ++d) c /= d;
+	VREAL p = (VREAL){ 0 } + c;
+	for (int d = EXP_DEGREE; d > 0; --d) {
+		c *= d;
+		p = p * r + c;
+	}
+	VREAL scale = (VREAL)((k + EXP_BIAS) << EXP_MANTISSA);
+	return p * scale;
+}
+
+// see NN_SIMD_EXP, libm's sqrt does not vectorize because of errno
+SIMD_ATTR static inline VREAL SIMD_FN(simd_vrsqrt)(VREAL x) {
+	VREAL y = (VREAL)((simd_int_t)RSQRT_MAGIC - ((VINT)x >> 1));
+	for (int s = 0; s < RSQRT_STEPS; ++s) y = y * (real_t)1.5 - (real_t)0.5 * x * y * y * y;
+	return y;
+}
+
+// dst = expr(VLOAD(src + i)) over whole vectors, the tail goes through the same
+// polynomial so every element rounds the same way
+#define SIMD_UNARY_EXP(name, expr) \
+	SIMD_ATTR static void SIMD_FN(name)(real_t *dst, const real_t *src, size_t n) { \
+		size_t i = 0; \
+		for (; i + SIMD_LANES <= n; i += SIMD_LANES) { \
+			VREAL x = VLOAD(src + i); \
+			VLOAD(dst + i) = (expr); \
+		} \
+		if (i == n) return; \
+		real_t tile[SIMD_LANES]; \
+		for (size_t l = 0; l < SIMD_LANES; ++l) tile[l] = i + l < n ? src[i + l] : 0; \
+		VREAL x = VLOAD(tile); \
+		VLOAD(tile) = (expr); \
+		for (size_t l = 0; i + l < n; ++l) dst[i + l] = tile[l]; \
+	}
+
+SIMD_UNARY_EXP(simd_exp, SIMD_FN(simd_vexp)(x))
+// dst = 1 / (1 + e^-src)
+SIMD_UNARY_EXP(simd_sigmoid, 1 / (1 + SIMD_FN(simd_vexp)(-x)))
+
+// d *= a * (1 - a), sigmoid'(z) from the activations a = sigmoid(z) of the forward pass
+SIMD_ATTR static void SIMD_FN(simd_sigmoid_grad)(real_t *restrict d, const real_t *restrict a, size_t n) {
+	size_t i = 0;
+	for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+		VREAL x = VLOAD(a + i);
+		VLOAD(d + i) = VLOAD(d + i) * (x * (1 - x));
+	}
+	for (; i < n; ++i) d[i] *= a[i] * (1 - a[i]);
+}
+
+// elementwise activation of a whole vector, tanh(x) = 2 sigmoid(2x) - 1
+SIMD_ATTR static inline VREAL SIMD_FN(simd_vact)(VREAL x, Activation act) {
+	switch (act) {
+	case ACT_SIGMOID: return 1 / (1 + SIMD_FN(simd_vexp)(-x));
+	case ACT_TANH: return 2 * (1 / (1 + SIMD_FN(simd_vexp)(-2 * x))) - 1;
+	case ACT_RELU: return VSELECT(x > 0, x, (VREAL){ 0 });
+	case ACT_LEAKY_RELU: return VSELECT(x > 0, x, (real_t)LEAKY_RELU_SLOPE * x);
+	default: return x;
+	}
+}
+
+SIMD_ATTR static void SIMD_FN(simd_bias_act)(real_t *dst, const real_t *src, const real_t *bias, real_t *z, size_t n, Activation act) {
+	size_t i = 0;
+	for (; i + SIMD_LANES <= n; i += SIMD_LANES) {
+		VREAL x = VLOAD(src + i);
+		if (bias) x += VLOAD(bias + i);
+		if (z) VLOAD(z + i) = x;
+		VLOAD(dst + i) = SIMD_FN(simd_vact)(x, act);
+	}
+	if (i == n) return;
+	real_t tile[SIMD_LANES];
+	for (size_t l = 0; l < SIMD_LANES; ++l) tile[l] = i + l < n ? src[i + l] + (bias ? bias[i + l] : 0) : 0;
+	if (z) for (size_t l = 0; i + l < n; ++l) z[i + l] = tile[l];
+	VLOAD(tile) = SIMD_FN(simd_vact)(VLOAD(tile), act);
+	for (size_t l = 0; i + l < n; ++l) dst[i + l] = tile[l];
+}
+
+// optimizer updates, every tile function updates SIMD_LANES parameters. P is the parameter
+// and G the gradient with the batch mean and the l2 penalty folded in
+#define SIMD_OPTIMIZER(name, body) \
+	SIMD_ATTR static inline void SIMD_FN(name##_tile)(real_t *p, const real_t *g, real_t *m, real_t *v, OptStep s) { \
+		VREAL P = VLOAD(p), G = s.grad_scale * VLOAD(g) + s.l2 * P; \
+		(void)m, (void)v; \
+		body \
+	} \
+	SIMD_ATTR static void SIMD_FN(name)(real_t *restrict p, const real_t *restrict g, real_t *restrict m, real_t *restrict v, size_t n, const OptStep *step) { \
+		OptStep s = *step; \
+		size_t i = 0; \
+		for (; i + SIMD_LANES <= n; i += SIMD_LANES) { \
+			SIMD_FN(name##_tile)(p + i, g + i, m ? m + i : NULL, v ? v + i : NULL, s); \
+		} \
+		if (i == n) return; \
+		real_t tp[SIMD_LANES] = { 0 }, tg[SIMD_LANES] = { 0 }, tm[SIMD_LANES] = { 0 }, tv[SIMD_LANES] = { 0 }; \
+		for (size_t l = 0; i + l < n; ++l) { \
+			tp[l] = p[i + l], tg[l] = g[i + l]; \
+			if (m) tm[l] = m[i + l]; \
+			if (v) tv[l] = v[i + l]; \
+		} \
+		SIMD_FN(name##_tile)(tp, tg, tm, tv, s); \
+		for (size_t l = 0; i + l < n; ++l) { \
+			p[i + l] = tp[l]; \
+			if (m) m[i + l] = tm[l]; \
+			if (v) v[i + l] = tv[l]; \
+		} \
+	}
+
+// p -= lr * g
+SIMD_OPTIMIZER(simd_sgd,
+	VLOAD(p) = P - s.lr * G;
+)
+// m = beta1 * m + g, p -= lr * m
+SIMD_OPTIMIZER(simd_momentum,
+	VREAL M = s.beta1 * VLOAD(m) + G;
+	VLOAD(m) = M;
+	VLOAD(p) = P - s.lr * M;
+)
+// m = beta1 * m + g, p -= lr * (g + beta1 * m), the step is taken from the look-ahead point
+SIMD_OPTIMIZER(simd_nesterov,
+	VREAL M = s.beta1 * VLOAD(m) + G;
+	VLOAD(m) = M;
+	VLOAD(p) = P - s.lr * (G + s.beta1 * M);
+)
+// v = beta2 * v + (1 - beta2) * g^2, p -= lr * g / (sqrt(v) + eps)
+SIMD_OPTIMIZER(simd_rmsprop,
+	VREAL V = s.beta2 * VLOAD(v) + (1 - s.beta2) * G * G;
+	VLOAD(v) = V;
+	VLOAD(p) = P - s.lr * G / (V * SIMD_FN(simd_vrsqrt)(V) + s.eps);
+)
+// m and v are the moving averages of g and g^2, p -= lr * (m^ / (sqrt(v^) + eps) + decay * p)
+// with the bias-corrected m^ = m * bias1, v^ = v * bias2
+SIMD_OPTIMIZER(simd_adam,
+	VREAL M = s.beta1 * VLOAD(m) + (1 - s.beta1) * G;
+	VREAL V = s.beta2 * VLOAD(v) + (1 - s.beta2) * G * G;
+	VLOAD(m) = M;
+	VLOAD(v) = V;
+	V = V * s.bias2;
+	VLOAD(p) = P - s.lr * (M * s.bias1 / (V * SIMD_FN(simd_vrsqrt)(V) + s.eps) + s.decay * P);
+)
+
+// c[mr x nr] = alpha * ap * bp + beta * c over packed GEMM_MR / GEMM_NR panels, then the
+// epilogue on the accumulators before they are stored
+SIMD_ATTR static void SIMD_FN(simd_gemm_micro)(size_t kc, const real_t *restrict ap, const real_t *restrict bp,
+		real_t *c, size_t ldc, size_t mr, size_t nr, real_t alpha, real_t beta, const Epilogue *epi) {
+	enum { NV = GEMM_NR / SIMD_LANES };
+	VREAL acc[GEMM_MR][NV] = {0};
+	for (size_t k = 0; k < kc; ++k) {
+		VREAL b[NV];
+		for (size_t v = 0; v < NV; ++v) b[v] = VLOAD(bp + v * SIMD_LANES);
+		for (size_t i = 0; i < GEMM_MR; ++i) {
+			for (size_t v = 0; v < NV; ++v) acc[i][v] += ap[i] * b[v];
+		}
+		ap += GEMM_MR, bp += GEMM_NR;
+	}
+	for (size_t i = 0; i < mr; ++i) {
+		real_t *r = c + i * ldc;
+		if (nr == GEMM_NR) {
+			for (size_t v = 0; v < NV; ++v) {
+				VREAL out = alpha * acc[i][v];
+				if (beta != 0) out += beta * VLOAD(r + v * SIMD_LANES);
+				if (epi) {
+					if (epi->bias) out += VLOAD(epi->bias + v * SIMD_LANES);
+					if (epi->z) VLOAD(epi->z + i * epi->ldz + v * SIMD_LANES) = out;
+					out = SIMD_FN(simd_vact)(out, epi->act);
+				}
+				VLOAD(r + v * SIMD_LANES) = out;
+			}
+			continue;
+		}
+		real_t tile[GEMM_NR];
+		for (size_t v = 0; v < NV; ++v) VLOAD(tile + v * SIMD_LANES) = acc[i][v];
+		for (size_t j = 0; j < nr; ++j) {
+			tile[j] = beta == 0 ? alpha * tile[j] : alpha * tile[j] + beta * r[j];
+		}
+		if (epi) {
+			SIMD_FN(simd_bias_act)(r, tile, epi->bias, epi->z ? epi->z + i * epi->ldz : NULL, nr, epi->act);
+			continue;
+		}
+		for (size_t j = 0; j < nr; ++j) r[j] = tile[j];
+	}
+}
+
+static const NNKernels SIMD_FN(nn_kernels) = {
+	.isa = SIMD_STR(SIMD_ISA),
+	.operate = {
+		[LOAD] = SIMD_FN(simd_load), [ADD] = SIMD_FN(simd_add), [SUB] = SIMD_FN(simd_sub),
+		[MUL] = SIMD_FN(simd_mul), [DIV] = SIMD_FN(simd_div),
+	},
+	.scale = SIMD_FN(simd_scale),
+	.axpy = SIMD_FN(simd_axpy),
+	.dot = SIMD_FN(simd_dot),
+	.gemm_micro = SIMD_FN(simd_gemm_micro),
+	.exp = SIMD_FN(simd_exp),
+	.sigmoid = SIMD_FN(simd_sigmoid),
+	.sigmoid_grad = SIMD_FN(simd_sigmoid_grad),
+	.bias_act = SIMD_FN(simd_bias_act),
+	.optimize = {
+		[OPT_SGD] = SIMD_FN(simd_sgd), [OPT_MOMENTUM] = SIMD_FN(simd_momentum),
+		[OPT_NESTEROV] = SIMD_FN(simd_nesterov), [OPT_RMSPROP] = SIMD_FN(simd_rmsprop),
+		[OPT_ADAM] = SIMD_FN(simd_adam), [OPT_ADAMW] = SIMD_FN(simd_adam),
+	},
+};
+
+#undef SIMD_BINARY
+#undef SIMD_UNARY_EXP
+#undef SIMD_OPTIMIZER
+#undef VSELECT
+#undef VLOAD
+#undef VINT
+#undef VREAL
+#undef SIMD_ATTR
+#undef SIMD_LANES
+#undef SIMD_FN
+#undef SIMD_STR
+#undef SIMD_STR_
+#undef SIMD_CAT
+#undef SIMD_CAT_
+#undef SIMD_ISA
+#undef SIMD_TARGET
+#undef SIMD_WIDTH
@@ -1,3 +1,5 @@
+#include <unistd.h>
+#include <time.h>
 #define NN_MATH_IMPLEMENTATION
 #include "nn.h"
 #define LOAD_MNIST_IMPLEMENTAION
@@ -5,15 +7,37 @@
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
 
-int main(void) {
+// main.out [checkpoint]: with a checkpoint path the run is saved there as it goes and picks
+// up from it when restarted
+int main(int argc, char **argv) {
 	size_t *sizes = NULL;
 	arrsetlen(sizes, 3);
 	sizes[0] = 28 * 28;
 	sizes[1] = 10;
 	sizes[2] = 10;
 	Network *net = network_create(sizes);
-	DataEntry *training_set = load_training_set();
-	DataEntry *test_set = load_test_set();
-	network_SGD(net, 10, 10, 3, training_set, test_set);
+	net->activations[0] = ACT_RELU;
+	net->activations[1] = ACT_SOFTMAX;
+	net->loss = LOSS_CROSS_ENTROPY;
+	Dataset *training_set = load_training_set();
+	Dataset *test_set = load_test_set();
+	if (training_set == NULL || test_set == NULL) return 1;
+	TrainConfig cfg = {
+		.epochs = 10,
+		.batch_size = 10,
+		.lrate = 0.05,
+		.threads = sysconf(_SC_NPROCESSORS_ONLN),
+		.prefetch = 2,
+		.seed = (uint64_t)time(NULL),
+		.checkpoint = argc > 1 ? argv[1] : NULL,
+		.resume = true,
+	};
+	network_init(net, cfg.seed, cfg.threads);
+	printf("INFO :: seed %llu\n", (unsigned long long)cfg.seed);
+	// a checkpoint that cannot be resumed from is reported and nothing is trained
+	bool trained = network_SGD(net, &cfg, training_set, test_set);
 	network_destroy(net);
+	dataset_destroy(training_set);
+	dataset_destroy(test_set);
+	return trained ? 0 : 1;
 }
@@ -12,49 +12,141 @@
 #include <math.h>
 #include <time.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
 
-static double d_sigmoid(double x) {
-	return 1 / (1 + exp(-x));
+// pthread_create outside the assert, so NDEBUG builds still start the thread
+static void thread_start(pthread_t *thread, void *(*fn)(void *), void *arg) {
+	int err = pthread_create(thread, NULL, fn, arg);
+	assert(err == 0 && "pthread_create");
+	(void)err;
 }
 
-static void sigmoid(vec_t dst, vec_t src) {
-	assert(arrlen(src) == arrlen(dst));
-	for (int i = 0; i < arrlen(src); ++i) {
-		dst[i] = 1.0 / (1.0 + exp(-src[i]));
+// a = f(z) over one row of n units, a and z may alias
+static void activate(Activation act, real_t *a, const real_t *z, size_t n) {
+	switch (act) {
+	default:
+		// the elementwise ones are the same kernels the gemm epilogue runs
+		nn_kernels.bias_act(a, z, NULL, NULL, n, act);
+		break;
+	case ACT_SOFTMAX: {
+		// shifted by the max so exp never overflows
+		real_t max = z[0], sum = 0;
+		for (size_t i = 1; i < n; ++i) max = z[i] > max ? z[i] : max;
+		for (size_t i = 0; i < n; ++i) a[i] = z[i] - max;
+		nn_kernels.exp(a, a, n);
+		for (size_t i = 0; i < n; ++i) sum += a[i];
+		nn_kernels.scale(a, 1 / sum, n);
+		break;
+	}
 	}
 }
 
-static double d_sigmoid_prime(double x) {
-	double e = exp(-x);
-	return e / ((1 + e) * (1 + e));
-}
-
-static void sigmoid_prime(vec_t dst, vec_t src) {
-	assert(arrlen(src) == arrlen(dst));
-	for (int i = 0; i < arrlen(src); ++i) {
-		double e = exp(-src[i]);
-		dst[i] = e / ((1 + e) * (1 + e));
+// d *= f'(z) over one row, every derivative is taken from the activations a = f(z)
+static void activate_grad(Activation act, real_t *d, const real_t *a, size_t n) {
+	switch (act) {
+	case ACT_SIGMOID:
+		nn_kernels.sigmoid_grad(d, a, n);
+		break;
+	case ACT_TANH:
+		for (size_t i = 0; i < n; ++i) d[i] *= 1 - a[i] * a[i];
+		break;
+	case ACT_RELU:
+		for (size_t i = 0; i < n; ++i) d[i] = a[i] > 0 ? d[i] : 0;
+		break;
+	case ACT_LEAKY_RELU:
+		for (size_t i = 0; i < n; ++i) d[i] = a[i] > 0 ? d[i] : (real_t)LEAKY_RELU_SLOPE * d[i];
+		break;
+	case ACT_SOFTMAX: {
+		// the jacobian diag(a) - a a^T applied to d
+		real_t dot = nn_kernels.dot(d, a, n);
+		for (size_t i = 0; i < n; ++i) d[i] = a[i] * (d[i] - dot);
+		break;
+	}
+	case ACT_IDENTITY:
+		break;
 	}
 }
 
-static inline double rand_uniform() {
-    return (rand() + 1.0) / (RAND_MAX + 2.0); // avoid 0
+// softmax and cross-entropy in one pass: a = softmax(z), d = a - onehot(label) which is the
+// output delta with the jacobian already cancelled out, returns -log a[label] computed as
+// log(sum e^(z - max)) - (z[label] - max) so it stays finite when a[label] underflows
+static real_t softmax_cross_entropy(real_t *a, real_t *d, const real_t *z, size_t n, size_t label) {
+	real_t max = z[0], sum = 0;
+	for (size_t i = 1; i < n; ++i) max = z[i] > max ? z[i] : max;
+	for (size_t i = 0; i < n; ++i) a[i] = z[i] - max;
+	real_t shifted = a[label];
+	nn_kernels.exp(a, a, n);
+	for (size_t i = 0; i < n; ++i) sum += a[i];
+	nn_kernels.scale(a, 1 / sum, n);
+	for (size_t i = 0; i < n; ++i) d[i] = a[i] - (i == label);
+	return (real_t)log(sum) - shifted;
 }
 
-// standard normal via Box-Muller
-double randn() {
-    static bool has_spare = 0;
-    static double spare;
+// the delta of the output layer for one sample. a holds the activations the forward pass
+// fused into the product, except for softmax outputs which are computed here from the
+// weighted inputs z. returns the loss of the sample
+static real_t output_delta(Network *net, real_t *a, real_t *d, const real_t *z, size_t n, size_t label) {
+	Activation act = net->activations[arrlen(net->activations) - 1];
+	if (act == ACT_SOFTMAX) {
+		if (net->loss == LOSS_CROSS_ENTROPY) return softmax_cross_entropy(a, d, z, n, label);
+		activate(act, a, z, n);
+	}
+	real_t loss = 0;
+	for (size_t i = 0; i < n; ++i) d[i] = a[i] - (i == label);
+	if (net->loss == LOSS_CROSS_ENTROPY) {
+		// sigmoid outputs: the sigmoid' of the delta cancels against the loss, d = a - y as is
+		assert(act == ACT_SIGMOID && "cross-entropy needs a softmax or sigmoid output layer");
+		for (size_t i = 0; i < n; ++i) {
+			real_t p = i == label ? a[i] : 1 - a[i];
+			loss -= (real_t)log(p > (real_t)1e-30 ? p : (real_t)1e-30);
+		}
+		return loss;
+	}
+	for (size_t i = 0; i < n; ++i) loss += d[i] * d[i] / 2;
+	activate_grad(act, d, a, n);
+	return loss;
+}
 
-    if (has_spare) return has_spare = false, spare;
+// out = f(in * W[l]^T + b[l]), from the 16-bit inputs in16 and weights of a mixed-precision
+// run when in16 is given
+static void layer_product(Network *net, size_t l, mat_t out, mat_t in, const hmat_t *in16, Activation act) {
+	Epilogue epi = { .bias = net->biases[l], .act = act };
+	if (in16) hmat_gemm_epilogue(out, GEMM_NT, *in16, net->mixed.weights[l], 1, 0, &epi);
+	else mat_gemm_epilogue(out, GEMM_NT, in, net->weights[l], 1, 0, &epi);
+}
 
-    double u, v;
-    u = rand_uniform();
-    v = rand_uniform();
+// A[l] = f(in * W[l]^T + b[l]) over the rows of a batch, the bias and f run in the epilogue of
+// the product. softmax needs whole rows: Z[l] gets the weighted inputs and the rows are
+// activated after, unless it is the output layer which is activated together with its delta
+static void forward_layer(Network *net, size_t l, mat_t in, const hmat_t *in16, mat_t Z, mat_t A, bool output) {
+	Activation act = net->activations[l];
+	if (act != ACT_SOFTMAX) {
+		layer_product(net, l, A, in, in16, act);
+		return;
+	}
+	layer_product(net, l, Z, in, in16, ACT_IDENTITY);
+	for (size_t b = 0; !output && b < Z.rows; ++b) {
+		activate(act, mat_row(A, b), mat_row(Z, b), Z.cols);
+	}
+}
 
-    double mag = sqrt(-2.0 * log(u));
-    has_spare = true, spare = mag * sin(2.0 * M_PI * v);
-    return mag * cos(2.0 * M_PI * v);
+// forward_layer for a single sample
+static void forward_sample(Network *net, size_t l, vec_t in, vec_t z, vec_t a, bool output) {
+	Activation act = net->activations[l];
+	if (act != ACT_SOFTMAX) {
+		mat_vec_dot_epilogue(a, net->weights[l], in, &(Epilogue){ .bias = net->biases[l], .act = act });
+		return;
+	}
+	mat_vec_dot_epilogue(z, net->weights[l], in, &(Epilogue){ .bias = net->biases[l], .act = ACT_IDENTITY });
+	if (!output) activate(act, a, z, arrlen(z));
 }
 
 static mat_t *new_mat_arr(size_t *sizes) {
@@ -65,6 +157,15 @@ static mat_t *new_mat_arr(size_t *sizes) {
 	return arr;
 }
 
+// allocates array of length: arrlen(sizes[l]) - 1 of rows x sizes[l] matrices
+static mat_t *new_batch_arr(size_t *sizes, size_t rows) {
+	mat_t *arr = NULL;
+	for (size_t l = 1; l < arrlen(sizes); ++l) {
+		arrpush(arr, mat_new(rows, sizes[l]));
+	}
+	return arr;
+}
+
 static void free_mat_arr(mat_t *arr) {
 	for (size_t i = 0; i < arrlen(arr); ++i) {
 		mat_destroy(arr[i]);
@@ -88,146 +189,1665 @@ static void free_vec_arr(vec_t *arr) {
 	arrfree(arr);
 }
 
-Network *network_create(size_t *sizes) {
-	Network *net = (Network*)malloc(sizeof(Network));
-	net->sizes = sizes;
-	net->weights = new_mat_arr(sizes);
-	net->biases = new_vec_arr(sizes);
-	srand(time(NULL));
+static void free_hmat_arr(hmat_t *arr) {
+	for (size_t i = 0; i < arrlen(arr); ++i) {
+		hmat_destroy(arr[i]);
+	}
+	arrfree(arr);
+}
+
+static void workspace_free_batch(Workspace *ws) {
+	mat_destroy(ws->X);
+	free(ws->labels);
+	free_mat_arr(ws->Z);
+	free_mat_arr(ws->A);
+	free_mat_arr(ws->D);
+	ws->Z = ws->A = ws->D = NULL;
+	hmat_destroy(ws->X16);
+	free_hmat_arr(ws->A16);
+	free_hmat_arr(ws->D16);
+	ws->X16.data = NULL;
+	ws->A16 = ws->D16 = NULL;
+	ws->half_batch = 0;
+}
+
+static void workspace_reserve(Workspace *ws, size_t *sizes, size_t batch_size) {
+	if (batch_size <= ws->batch) return;
+	workspace_free_batch(ws);
+	ws->batch = batch_size;
+	ws->X = mat_new(batch_size, sizes[0]);
+	ws->labels = (uint8_t*)malloc(batch_size);
+	ws->Z = new_batch_arr(sizes, batch_size);
+	ws->A = new_batch_arr(sizes, batch_size);
+	ws->D = new_batch_arr(sizes, batch_size);
+}
+
+// grows the 16-bit copies of the batch buffers to the rows the real_t ones hold
+static void workspace_reserve_half(Workspace *ws, size_t *sizes, HalfFormat format) {
+	if (ws->half_batch == ws->batch && ws->X16.format == format) return;
+	hmat_destroy(ws->X16);
+	free_hmat_arr(ws->A16);
+	free_hmat_arr(ws->D16);
+	ws->A16 = ws->D16 = NULL;
+	ws->half_batch = ws->batch;
+	ws->X16 = hmat_new(ws->batch, sizes[0], format);
+	for (size_t l = 1; l < arrlen(sizes); ++l) {
+		arrpush(ws->A16, hmat_new(ws->batch, sizes[l], format));
+		arrpush(ws->D16, hmat_new(ws->batch, sizes[l], format));
+	}
+}
+
+// allocates the moments the optimizer of the network uses, zeroed
+static void optimizer_reserve(Network *net) {
+	OptimizerKind kind = net->optimizer.kind;
+	OptimizerState *opt = &net->opt;
+	if (kind != OPT_SGD && kind != OPT_RMSPROP && opt->m == NULL) {
+		opt->m = new_mat_arr(net->sizes);
+		opt->mb = new_vec_arr(net->sizes);
+	}
+	if (kind >= OPT_RMSPROP && opt->v == NULL) {
+		opt->v = new_mat_arr(net->sizes);
+		opt->vb = new_vec_arr(net->sizes);
+	}
+}
+
+static void optimizer_reset(OptimizerState *opt) {
+	for (size_t l = 0; l < arrlen(opt->m); ++l) {
+		mat_scale(opt->m[l], 0);
+		vec_scale(opt->mb[l], 0);
+	}
+	for (size_t l = 0; l < arrlen(opt->v); ++l) {
+		mat_scale(opt->v[l], 0);
+		vec_scale(opt->vb[l], 0);
+	}
+	atomic_store(&opt->steps, 0);
+}
+
+void network_reserve(Network *net, size_t batch_size) {
+	workspace_reserve(&net->ws, net->sizes, batch_size);
+	optimizer_reserve(net);
+}
+
+// fp16 loss scaling, see MixedState
+#define LOSS_SCALE_INIT 65536.0
+#define LOSS_SCALE_MAX 16777216.0
+#define LOSS_SCALE_WINDOW 1000
+
+static void mixed_free(MixedState *mx) {
+	free_hmat_arr(mx->weights);
+	mx->weights = NULL;
+}
+
+// sets up the 16-bit weights of a run in the given precision, a change of precision starts
+// the loss scale over
+static void mixed_reserve(Network *net, TrainPrecision precision) {
+	MixedState *mx = &net->mixed;
+	if (mx->precision != precision || atomic_load(&mx->loss_scale) == 0) {
+		mixed_free(mx);
+		mx->precision = precision;
+		atomic_store(&mx->loss_scale, precision == TRAIN_FP16 ? LOSS_SCALE_INIT : 1);
+		atomic_store(&mx->good_steps, 0);
+		atomic_store(&mx->skipped, 0);
+	}
+	if (precision == TRAIN_FULL || mx->weights) return;
 	for (size_t l = 0; l < arrlen(net->weights); ++l) {
-		for (size_t i = 0; i < arrlen(net->weights[l]); ++i) {
-			net->biases[l][i] = randn();
-			for (size_t j = 0; j < arrlen(net->weights[l][i]); ++j) {
-				net->weights[l][i][j] = randn();
-			}
-		}
+		arrpush(mx->weights, hmat_new(net->weights[l].rows, net->weights[l].cols, precision == TRAIN_FP16 ? HALF_FP16 : HALF_BF16));
 	}
+}
+
+// rounds the master weights into the 16-bit ones
+static void mixed_sync(Network *net) {
+	for (size_t l = 0; l < arrlen(net->mixed.weights); ++l) hmat_store(net->mixed.weights[l], net->weights[l]);
+}
+
+// counts a step of an fp16 run, false when it overflowed and must be dropped
+static bool loss_scale_step(MixedState *mx, bool overflow) {
+	if (overflow) {
+		double scale = atomic_load_explicit(&mx->loss_scale, memory_order_relaxed) / 2;
+		atomic_store_explicit(&mx->loss_scale, scale > 1 ? scale : 1, memory_order_relaxed);
+		atomic_store_explicit(&mx->good_steps, 0, memory_order_relaxed);
+		atomic_fetch_add_explicit(&mx->skipped, 1, memory_order_relaxed);
+		return false;
+	}
+	if (atomic_fetch_add_explicit(&mx->good_steps, 1, memory_order_relaxed) + 1 >= LOSS_SCALE_WINDOW) {
+		double scale = atomic_load_explicit(&mx->loss_scale, memory_order_relaxed) * 2;
+		atomic_store_explicit(&mx->loss_scale, scale < LOSS_SCALE_MAX ? scale : LOSS_SCALE_MAX, memory_order_relaxed);
+		atomic_store_explicit(&mx->good_steps, 0, memory_order_relaxed);
+	}
+	return true;
+}
+
+static void workspace_create(Workspace *ws, size_t *sizes) {
+	memset(ws, 0, sizeof(*ws));
+	ws->grad_weights = new_mat_arr(sizes);
+	ws->grad_biases = new_vec_arr(sizes);
+	ws->x = vec_new(sizes[0]);
+	ws->z = new_vec_arr(sizes);
+	ws->a = new_vec_arr(sizes);
+	ws->d = new_vec_arr(sizes);
+	ws->loss_scale = 1;
+	workspace_reserve(ws, sizes, 1);
+}
+
+static void workspace_destroy(Workspace *ws) {
+	workspace_free_batch(ws);
+	free_mat_arr(ws->grad_weights);
+	free_vec_arr(ws->grad_biases);
+	vec_destroy(ws->x);
+	free_vec_arr(ws->z);
+	free_vec_arr(ws->a);
+	free_vec_arr(ws->d);
+}
+
+// a network around the given parameters with the default activations, loss and optimizer
+static Network *network_new(size_t *sizes, mat_t *weights, vec_t *biases) {
+	Network *net = (Network*)malloc(sizeof(Network));
+	net->sizes = sizes;
+	net->weights = weights;
+	net->biases = biases;
+	net->activations = NULL;
+	for (size_t l = 1; l < arrlen(sizes); ++l) arrpush(net->activations, ACT_SIGMOID);
+	net->loss = LOSS_QUADRATIC;
+	net->optimizer = (Optimizer){ .kind = OPT_SGD };
+	memset(&net->opt, 0, sizeof(net->opt));
+	memset(&net->mixed, 0, sizeof(net->mixed));
+	workspace_create(&net->ws, sizes);
+	net->map = NULL;
+	net->map_size = 0;
+	return net;
+}
+
+Network *network_create(size_t *sizes) {
+	Network *net = network_new(sizes, new_mat_arr(sizes), new_vec_arr(sizes));
+	network_init(net, (uint64_t)time(NULL), 1);
 	return net;
 }
 
+// rows of a layer drawn from one stream, blocks are independent of each other and of the thread count
+#define INIT_BLOCK_ROWS 64
+
+typedef struct {
+	Network *net;
+	uint64_t seed;
+	size_t *first_block; // first block of every layer, plus the total at the end
+	_Atomic size_t cursor;
+} InitJob;
+
+static void *init_worker(void *arg) {
+	InitJob *job = (InitJob*)arg;
+	size_t L = arrlen(job->net->weights);
+	for (;;) {
+		size_t task = atomic_fetch_add_explicit(&job->cursor, 1, memory_order_relaxed);
+		if (task >= job->first_block[L]) break;
+		size_t l = 0;
+		while (task >= job->first_block[l+1]) ++l;
+		size_t block = task - job->first_block[l];
+		mat_t w = job->net->weights[l];
+		size_t lo = block * INIT_BLOCK_ROWS, hi = lo + INIT_BLOCK_ROWS < w.rows ? lo + INIT_BLOCK_ROWS : w.rows;
+		Rng rng;
+		rng_seed(&rng, job->seed, RNG_STREAM_INIT + ((uint64_t)(l + 1) << 32) + block);
+		// he initialization for relu layers and the layer fed by one, N(0, 1) weights would
+		// blow their unbounded outputs up
+		Activation *act = job->net->activations;
+		int relu = act[l] == ACT_RELU || act[l] == ACT_LEAKY_RELU || (l > 0 && (act[l-1] == ACT_RELU || act[l-1] == ACT_LEAKY_RELU));
+		real_t stddev = relu ? (real_t)sqrt(2.0 / w.cols) : 1;
+		rng_normal(&rng, job->net->biases[l] + lo, hi - lo, 0, 1);
+		for (size_t i = lo; i < hi; ++i) rng_normal(&rng, mat_row(w, i), w.cols, 0, stddev);
+	}
+	return NULL;
+}
+
+void network_init(Network *net, uint64_t seed, size_t threads) {
+	size_t L = arrlen(net->weights);
+	size_t first_block[L + 1];
+	first_block[0] = 0;
+	for (size_t l = 0; l < L; ++l) {
+		first_block[l+1] = first_block[l] + (net->weights[l].rows + INIT_BLOCK_ROWS - 1) / INIT_BLOCK_ROWS;
+	}
+	InitJob job = { net, seed, first_block, 0 };
+	if (threads > first_block[L]) threads = first_block[L];
+	pthread_t handles[threads > 1 ? threads : 1];
+	for (size_t t = 1; t < threads; ++t) {
+		thread_start(&handles[t], init_worker, &job);
+	}
+	init_worker(&job);
+	for (size_t t = 1; t < threads; ++t) pthread_join(handles[t], NULL);
+	// new weights start a new run
+	optimizer_reset(&net->opt);
+}
+
 void network_destroy(Network *net) {
-	free_mat_arr(net->weights);
-	free_vec_arr(net->biases);
+	if (net->map) {
+		// the parameters and sizes go with the map, only the arrays of views are owned
+		arrfree(net->weights);
+		arrfree(net->biases);
+		munmap(net->map, net->map_size);
+	} else {
+		free_mat_arr(net->weights);
+		free_vec_arr(net->biases);
+	}
+	arrfree(net->activations);
+	free_mat_arr(net->opt.m);
+	free_mat_arr(net->opt.v);
+	free_vec_arr(net->opt.mb);
+	free_vec_arr(net->opt.vb);
+	mixed_free(&net->mixed);
+	workspace_destroy(&net->ws);
 	free(net);
 }
 
-static void shuffle_set(DataEntry *set) {
-	DataEntry temp;
-	for (int i = 0; i < arrlen(set); ++i) {
-		int r = rand() % arrlen(set);
-		temp = set[i];
-		set[i] = set[r];
-		set[r] = temp;
+// checkpoint format, integers in the byte order of the writer (endian tells which):
+//   CheckpointHeader                        64 bytes
+//   uint32_t activations[layers - 1]
+//   size_t sizes[layers]                    64-byte aligned
+//   for every layer l, each blob 64-byte aligned:
+//     real_t weights[rows][stride]          exactly as mat_new lays them out
+//     real_t biases[rows]
+//   the training state of network_SGD when flags has CHECKPOINT_TRAINING, see TrainState
+// sizes and every bias blob are preceded by an stb_ds array header (length = capacity), so the
+// mapped blobs are the sizes, mat_t data and vec_t arrays of the network as they are, nothing
+// is parsed or copied. checksum is the crc32 of everything after the header
+#define CHECKPOINT_MAGIC "NNCKPT\0\0"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_ENDIAN 0x01020304u
+
+typedef enum { CHECKPOINT_F32 = 1, CHECKPOINT_F64 = 2 } CheckpointType;
+
+enum { CHECKPOINT_TRAINING = 1 };
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t dtype;
+	uint32_t endian;
+	uint32_t layers;  // entries of sizes
+	uint32_t loss;
+	uint32_t flags;   // optional sections after the parameters
+	uint64_t size;    // of the whole file
+	uint64_t checksum;
+	uint8_t reserved[16];
+} CheckpointHeader;
+
+_Static_assert(sizeof(CheckpointHeader) == 64, "checkpoint header");
+
+#define CHECKPOINT_DTYPE (sizeof(real_t) == sizeof(float) ? CHECKPOINT_F32 : CHECKPOINT_F64)
+
+static size_t align_up(size_t off) {
+	return (off + NN_ALIGN - 1) / NN_ALIGN * NN_ALIGN;
+}
+
+// offset of the sizes, which only depends on the number of layers
+static size_t checkpoint_sizes_offset(size_t layers) {
+	return align_up(sizeof(CheckpointHeader) + (layers - 1) * sizeof(uint32_t) + sizeof(stbds_array_header));
+}
+
+// offsets of the weight and bias blobs of every layer, returns where the parameters end
+static size_t checkpoint_layout(const size_t *sizes, size_t layers, size_t *weights, size_t *biases) {
+	size_t off = checkpoint_sizes_offset(layers) + layers * sizeof(size_t);
+	for (size_t l = 0; l + 1 < layers; ++l) {
+		weights[l] = align_up(off);
+		off = weights[l] + sizes[l+1] * mat_stride(sizes[l]) * sizeof(real_t);
+		biases[l] = align_up(off + sizeof(stbds_array_header));
+		off = biases[l] + sizes[l+1] * sizeof(real_t);
+	}
+	return off;
+}
+
+// the stb_ds header that makes the n elements at p an array
+static void checkpoint_array(uint8_t *p, size_t n) {
+	stbds_array_header h = { .length = n, .capacity = n };
+	memcpy(p - sizeof(h), &h, sizeof(h));
+}
+
+// crc32 takes an unsigned length, feed it at most this much per call
+#define CHECKPOINT_CRC_CHUNK (1u << 30)
+
+static uint64_t checkpoint_checksum(const uint8_t *p, size_t n) {
+	uLong crc = crc32(0, Z_NULL, 0);
+	for (size_t off = 0; off < n; off += CHECKPOINT_CRC_CHUNK) {
+		crc = crc32(crc, p + off, n - off < CHECKPOINT_CRC_CHUNK ? n - off : CHECKPOINT_CRC_CHUNK);
 	}
+	return crc;
 }
 
-static DataEntry **get_batches_from_set(DataEntry *set, size_t batch_size) {
-	DataEntry **batches = NULL;
-	for (size_t b = 0; b + batch_size <= arrlen(set); ++b) {
-		DataEntry *batch = NULL;
-		for (size_t o = 0; o < batch_size; ++o) {
-			arrpush(batch, set[b+o]);
+static size_t checkpoint_params_size(const size_t *sizes) {
+	size_t layers = arrlen(sizes);
+	assert(layers >= 2 && "checkpoint");
+	size_t *weights = (size_t*)malloc(2 * layers * sizeof(size_t));
+	size_t end = checkpoint_layout(sizes, layers, weights, weights + layers);
+	free(weights);
+	return end;
+}
+
+// writes the header, less its checksum, and the parameters into a zeroed buffer of size bytes
+static void checkpoint_params(Network *net, uint8_t *buf, size_t size, uint32_t flags) {
+	size_t layers = arrlen(net->sizes), L = layers - 1;
+	size_t *weights = (size_t*)malloc(2 * layers * sizeof(size_t)), *biases = weights + layers;
+	checkpoint_layout(net->sizes, layers, weights, biases);
+	CheckpointHeader h = {
+		.magic = CHECKPOINT_MAGIC, .version = CHECKPOINT_VERSION, .dtype = CHECKPOINT_DTYPE,
+		.endian = CHECKPOINT_ENDIAN, .layers = (uint32_t)layers, .loss = net->loss, .flags = flags, .size = size,
+	};
+	memcpy(buf, &h, sizeof(h));
+	uint32_t *acts = (uint32_t*)(buf + sizeof(h));
+	for (size_t l = 0; l < L; ++l) acts[l] = net->activations[l];
+	size_t off = checkpoint_sizes_offset(layers);
+	memcpy(buf + off, net->sizes, layers * sizeof(size_t));
+	checkpoint_array(buf + off, layers);
+	for (size_t l = 0; l < L; ++l) {
+		mat_t w = net->weights[l];
+		memcpy(buf + weights[l], w.data, w.rows * w.stride * sizeof(real_t));
+		memcpy(buf + biases[l], net->biases[l], w.rows * sizeof(real_t));
+		checkpoint_array(buf + biases[l], w.rows);
+	}
+	free(weights);
+}
+
+// fills in the checksum once everything after the header is written
+static void checkpoint_seal(uint8_t *buf) {
+	CheckpointHeader *h = (CheckpointHeader*)buf;
+	h->checksum = checkpoint_checksum(buf + sizeof(*h), h->size - sizeof(*h));
+}
+
+// writes the checkpoint next to path, flushes it to disk and renames it over path, so path
+// always holds a whole checkpoint, the old one or the new one. returns NULL or the reason
+// it failed, leaving path as it was
+static const char *checkpoint_commit(const char *path, const uint8_t *buf, size_t size) {
+	char tmp[4096];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return "path too long";
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) return strerror(errno);
+	for (size_t off = 0; off < size;) {
+		ssize_t n = write(fd, buf + off, size - off);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1) {
+			const char *why = strerror(errno);
+			close(fd), unlink(tmp);
+			return why;
 		}
-		arrpush(batches, batch);
+		off += n;
+	}
+	if (fsync(fd) == -1 || close(fd) == -1) {
+		const char *why = strerror(errno);
+		unlink(tmp);
+		return why;
+	}
+	if (rename(tmp, path) == -1) {
+		const char *why = strerror(errno);
+		unlink(tmp);
+		return why;
+	}
+	// the rename itself is only durable once the directory is
+	char dir[4096];
+	const char *slash = strrchr(path, '/');
+	if (slash == NULL) strcpy(dir, ".");
+	else snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+	int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dfd != -1) {
+		fsync(dfd);
+		close(dfd);
 	}
-	return batches;
+	return NULL;
 }
 
-void network_SGD(Network *net, size_t epochs, size_t batch_size, double lrate, DataEntry *training_set, DataEntry *test_set) {
-	for (size_t e = 0; e < epochs; ++e) {
-		shuffle_set(training_set);
-		DataEntry **batches = get_batches_from_set(training_set, batch_size);
-		printf("DEBUG :: analysing %zu batches\n", arrlen(batches));
-		clock_t start = clock();
-		for (size_t b = 0; b < arrlen(batches); ++b) {
-			network_update_batch(net, batches[b], lrate);
-			// free(batch);
+bool network_save(Network *net, const char *path) {
+	size_t size = checkpoint_params_size(net->sizes);
+	uint8_t *buf = (uint8_t*)calloc(1, size);
+	assert(buf != NULL && "network_save");
+	checkpoint_params(net, buf, size, 0);
+	checkpoint_seal(buf);
+	const char *why = checkpoint_commit(path, buf, size);
+	free(buf);
+	if (why) fprintf(stderr, "ERROR :: checkpoint %s: %s\n", path, why);
+	return why == NULL;
+}
+
+static Network *checkpoint_error(const char *path, const char *why, void *map, size_t size) {
+	fprintf(stderr, "ERROR :: checkpoint %s: %s\n", path, why);
+	if (map) munmap(map, size);
+	return NULL;
+}
+
+Network *network_load(const char *path, bool verify) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return checkpoint_error(path, strerror(errno), NULL, 0);
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+		close(fd);
+		return checkpoint_error(path, "truncated", NULL, 0);
+	}
+	size_t size = st.st_size;
+	// private and writable: the pages are shared with every other mapping until written to,
+	// training a loaded network copies the pages it updates and leaves the file alone
+	uint8_t *map = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return checkpoint_error(path, strerror(errno), NULL, 0);
+	CheckpointHeader h;
+	memcpy(&h, map, sizeof(h));
+	if (memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) != 0) return checkpoint_error(path, "not a checkpoint", map, size);
+	if (h.version != CHECKPOINT_VERSION) return checkpoint_error(path, "unsupported version", map, size);
+	if (h.endian != CHECKPOINT_ENDIAN) return checkpoint_error(path, "written with another byte order", map, size);
+	if (h.dtype != CHECKPOINT_DTYPE) return checkpoint_error(path, "written with another real_t", map, size);
+	if (h.size != size) return checkpoint_error(path, "truncated", map, size);
+	if (h.flags & ~CHECKPOINT_TRAINING) return checkpoint_error(path, "unknown sections", map, size);
+	if (h.layers < 2 || checkpoint_sizes_offset(h.layers) + h.layers * sizeof(size_t) > size) {
+		return checkpoint_error(path, "corrupt header", map, size);
+	}
+	if (verify && checkpoint_checksum(map + sizeof(h), size - sizeof(h)) != h.checksum) {
+		return checkpoint_error(path, "checksum mismatch", map, size);
+	}
+	size_t layers = h.layers, L = layers - 1;
+	size_t *sizes = (size_t*)(map + checkpoint_sizes_offset(layers));
+	for (size_t l = 0; l < layers; ++l) {
+		if (sizes[l] == 0 || sizes[l] > UINT32_MAX) return checkpoint_error(path, "corrupt sizes", map, size);
+	}
+	size_t *weights = (size_t*)malloc(2 * layers * sizeof(size_t)), *biases = weights + layers;
+	size_t params = checkpoint_layout(sizes, layers, weights, biases);
+	if (h.flags & CHECKPOINT_TRAINING ? params > size : params != size) {
+		free(weights);
+		return checkpoint_error(path, "corrupt sizes", map, size);
+	}
+	const uint32_t *acts = (const uint32_t*)(map + sizeof(h));
+	bool known = h.loss <= LOSS_CROSS_ENTROPY;
+	for (size_t l = 0; l < L; ++l) known = known && acts[l] <= ACT_IDENTITY;
+	if (!known) {
+		free(weights);
+		return checkpoint_error(path, "unknown activation or loss", map, size);
+	}
+
+	mat_t *w = NULL;
+	vec_t *b = NULL;
+	for (size_t l = 0; l < L; ++l) {
+		arrpush(w, ((mat_t){ sizes[l+1], sizes[l], mat_stride(sizes[l]), (real_t*)(map + weights[l]) }));
+		arrpush(b, (vec_t)(map + biases[l]));
+	}
+	free(weights);
+	Network *net = network_new(sizes, w, b);
+	for (size_t l = 0; l < L; ++l) net->activations[l] = (Activation)acts[l];
+	net->loss = (Loss)h.loss;
+	net->map = map;
+	net->map_size = size;
+	return net;
+}
+
+// one pass over the shuffled order, batch b is the view of at most batch_size
+// entries starting at order[b * batch_size], nothing is copied per batch
+typedef struct {
+	size_t *order;
+	size_t count;
+	size_t batch_size;
+	size_t batches;
+} Epoch;
+
+static size_t *epoch_batch(Epoch *ep, size_t b, size_t *n) {
+	size_t off = b * ep->batch_size;
+	*n = ep->count - off < ep->batch_size ? ep->count - off : ep->batch_size;
+	return ep->order + off;
+}
+
+// a mini-batch gathered into one contiguous tile, the first n rows of X are valid
+typedef struct {
+	mat_t X;
+	uint8_t *labels;
+	size_t n;
+	Rng rng; // of the loader once it gathered this batch, where a resumed run picks it up
+} Batch;
+
+// the only place the raw elements are widened, normalized and augmented
+static void gather_batch(Dataset *set, size_t *batch, size_t n, mat_t X, uint8_t *labels, AugmentFn augment, void *ctx, Rng *rng) {
+	for (size_t b = 0; b < n; ++b) {
+		real_t *x = mat_row(X, b);
+		dataset_load_x(set, batch[b], x);
+		if (augment) augment(x, X.cols, rng, ctx);
+		labels[b] = set->labels[batch[b]];
+	}
+}
+
+// loader thread keeping a bounded ring of gathered batches ahead of the trainer. the ring has
+// room for the batches being trained on plus the ones gathered ahead, slots go
+// free -> filled by the loader -> ready -> trained on -> free again
+typedef struct {
+	Dataset *set;
+	Epoch *epoch; // the epoch being loaded, in training order
+	size_t first; // batch of it to start from
+	AugmentFn augment;
+	void *augment_ctx;
+	Rng rng; // owned by the loader thread
+	size_t depth;
+	Batch *slots;
+	size_t *free_slots, free_len; // stack of slots the loader may fill
+	size_t *ready, ready_head, ready_len; // fifo of filled slots
+	bool done; // every batch of the epoch is queued
+	pthread_mutex_t lock;
+	pthread_cond_t filled, drained;
+	pthread_t thread;
+} Prefetcher;
+
+static void prefetch_create(Prefetcher *pf, Dataset *set, size_t depth, size_t batch_size, AugmentFn augment, void *ctx, uint64_t seed) {
+	memset(pf, 0, sizeof(*pf));
+	pf->set = set;
+	rng_seed(&pf->rng, seed, RNG_STREAM_LOADER);
+	pf->depth = depth;
+	pf->augment = augment, pf->augment_ctx = ctx;
+	pf->slots = (Batch*)calloc(depth, sizeof(Batch));
+	pf->free_slots = (size_t*)calloc(depth, sizeof(size_t));
+	pf->ready = (size_t*)calloc(depth, sizeof(size_t));
+	for (size_t s = 0; s < depth; ++s) {
+		pf->slots[s].X = mat_new(batch_size, set->features);
+		pf->slots[s].labels = (uint8_t*)malloc(batch_size);
+	}
+	pthread_mutex_init(&pf->lock, NULL);
+	pthread_cond_init(&pf->filled, NULL);
+	pthread_cond_init(&pf->drained, NULL);
+}
+
+static void *prefetch_loader(void *arg) {
+	Prefetcher *pf = (Prefetcher*)arg;
+	for (size_t b = pf->first; b < pf->epoch->batches; ++b) {
+		pthread_mutex_lock(&pf->lock);
+		while (pf->free_len == 0) pthread_cond_wait(&pf->drained, &pf->lock);
+		size_t slot = pf->free_slots[--pf->free_len];
+		pthread_mutex_unlock(&pf->lock);
+
+		Batch *batch = &pf->slots[slot];
+		size_t *idx = epoch_batch(pf->epoch, b, &batch->n);
+		gather_batch(pf->set, idx, batch->n, batch->X, batch->labels, pf->augment, pf->augment_ctx, &pf->rng);
+		batch->rng = pf->rng;
+
+		pthread_mutex_lock(&pf->lock);
+		pf->ready[(pf->ready_head + pf->ready_len++) % pf->depth] = slot;
+		pthread_cond_signal(&pf->filled);
+		pthread_mutex_unlock(&pf->lock);
+	}
+	pthread_mutex_lock(&pf->lock);
+	pf->done = true;
+	pthread_cond_broadcast(&pf->filled);
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+// starts gathering the batches of an epoch from batch first, every slot must have been released
+static void prefetch_epoch(Prefetcher *pf, Epoch *epoch, size_t first) {
+	pf->epoch = epoch;
+	pf->first = first;
+	pf->done = false;
+	pf->ready_head = pf->ready_len = 0;
+	pf->free_len = pf->depth;
+	for (size_t s = 0; s < pf->depth; ++s) pf->free_slots[s] = pf->depth - 1 - s;
+	thread_start(&pf->thread, prefetch_loader, pf);
+}
+
+// next batch in epoch order, NULL once the epoch is exhausted
+static Batch *prefetch_next(Prefetcher *pf) {
+	pthread_mutex_lock(&pf->lock);
+	while (pf->ready_len == 0 && !pf->done) pthread_cond_wait(&pf->filled, &pf->lock);
+	Batch *batch = NULL;
+	if (pf->ready_len > 0) {
+		batch = &pf->slots[pf->ready[pf->ready_head]];
+		pf->ready_head = (pf->ready_head + 1) % pf->depth, --pf->ready_len;
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return batch;
+}
+
+static void prefetch_release(Prefetcher *pf, Batch *batch) {
+	pthread_mutex_lock(&pf->lock);
+	pf->free_slots[pf->free_len++] = batch - pf->slots;
+	pthread_cond_signal(&pf->drained);
+	pthread_mutex_unlock(&pf->lock);
+}
+
+static void prefetch_join(Prefetcher *pf) {
+	pthread_join(pf->thread, NULL);
+}
+
+static void prefetch_destroy(Prefetcher *pf) {
+	for (size_t s = 0; s < pf->depth; ++s) {
+		mat_destroy(pf->slots[s].X);
+		free(pf->slots[s].labels);
+	}
+	free(pf->slots);
+	free(pf->free_slots);
+	free(pf->ready);
+	pthread_mutex_destroy(&pf->lock);
+	pthread_cond_destroy(&pf->filled);
+	pthread_cond_destroy(&pf->drained);
+}
+
+static void backprop_batch(Network *net, Workspace *ws, mat_t X, const uint8_t *labels, mat_t *grad_weights, vec_t *grad_biases);
+
+// one optimizer step from the gradients ws summed over a batch of n samples. every tensor is
+// a single fused pass: the padding of the weight rows is zero in the gradients and the
+// moments alike, so it stays zero and whole buffers are walked at once. a mixed-precision
+// run rounds the weights of a layer into its 16-bit copy right after they are updated
+static void apply_gradients(Network *net, Workspace *ws, double lrate, size_t n) {
+	Optimizer *o = &net->optimizer;
+	OptimizerState *opt = &net->opt;
+	MixedState *mx = &net->mixed;
+	mat_t *grad_weights = ws->grad_weights;
+	vec_t *grad_biases = ws->grad_biases;
+	if (mx->precision == TRAIN_FP16 && !loss_scale_step(mx, ws->overflow)) return;
+	optimizer_reserve(net);
+	uint64_t t = atomic_fetch_add_explicit(&opt->steps, 1, memory_order_relaxed) + 1;
+	double beta1 = o->beta1 > 0 ? o->beta1 : 0.9, beta2 = o->beta2 > 0 ? o->beta2 : 0.999;
+	OptStep w = {
+		.lr = lrate, .grad_scale = 1.0 / (n * ws->loss_scale),
+		.beta1 = beta1, .beta2 = beta2, .eps = o->eps > 0 ? o->eps : 1e-8,
+		.bias1 = 1 / (1 - pow(beta1, t)), .bias2 = 1 / (1 - pow(beta2, t)),
+	};
+	OptStep b = w;
+	if (o->kind == OPT_ADAMW) w.decay = o->weight_decay;
+	else w.l2 = o->weight_decay;
+	void (*update)(real_t *, const real_t *, real_t *, real_t *, size_t, const OptStep *) = nn_kernels.optimize[o->kind];
+	for (size_t l = 0; l < arrlen(net->sizes)-1; ++l) {
+		mat_t p = net->weights[l];
+		assert(grad_weights[l].stride == p.stride && "apply_gradients");
+		update(p.data, grad_weights[l].data, opt->m ? opt->m[l].data : NULL, opt->v ? opt->v[l].data : NULL, p.rows * p.stride, &w);
+		update(net->biases[l], grad_biases[l], opt->mb ? opt->mb[l] : NULL, opt->vb ? opt->vb[l] : NULL, arrlen(net->biases[l]), &b);
+		if (mx->weights) hmat_store(mx->weights[l], p);
+	}
+}
+
+// data-parallel mini-batch step: every worker backprops a fixed slice of the batch into
+// its own workspace, then the gradients are summed pairwise in a fixed tree so the result
+// does not depend on thread timing. worker 0 runs on the calling thread and owns net->ws.
+typedef struct {
+	Network *net;
+	size_t threads;
+	Workspace **ws;
+	pthread_t *handles;
+	pthread_barrier_t sync;
+	Dataset *set;
+	size_t *batch;
+	size_t batch_len;
+	Batch *ready;    // the current batch when it was prefetched, NULL gathers it from batch
+	Prefetcher *pf;  // NULL gathers every batch on the workers
+	AugmentFn augment;
+	void *augment_ctx;
+	// hogwild epochs: workers claim whole batches through the cursor
+	bool hogwild;
+	Epoch *epoch;
+	double lrate;
+	_Atomic size_t cursor;
+	bool quit;
+} Trainer;
+
+typedef struct {
+	Trainer *tr;
+	size_t id;
+} WorkerArg;
+
+// gathers n samples into the workspace and returns the view of their rows
+static mat_t trainer_gather(Trainer *tr, Workspace *ws, size_t *idx, size_t n) {
+	workspace_reserve(ws, tr->net->sizes, n);
+	mat_t X = mat_slice(ws->X, 0, n);
+	gather_batch(tr->set, idx, n, X, ws->labels, tr->augment, tr->augment_ctx, &ws->rng);
+	return X;
+}
+
+static void trainer_step(Trainer *tr, size_t id) {
+	size_t T = tr->threads, n = tr->batch_len, L = arrlen(tr->net->sizes) - 1;
+	size_t lo = n * id / T, hi = n * (id + 1) / T;
+	Workspace *ws = tr->ws[id];
+	if (hi > lo && tr->ready) {
+		mat_t X = mat_slice(tr->ready->X, lo, hi - lo);
+		backprop_batch(tr->net, ws, X, tr->ready->labels + lo, ws->grad_weights, ws->grad_biases);
+	} else if (hi > lo) {
+		mat_t X = trainer_gather(tr, ws, tr->batch + lo, hi - lo);
+		backprop_batch(tr->net, ws, X, ws->labels, ws->grad_weights, ws->grad_biases);
+	} else {
+		for (size_t l = 0; l < L; ++l) {
+			mat_scale(ws->grad_weights[l], 0);
+			vec_scale(ws->grad_biases[l], 0);
 		}
-		printf("DEBUG :: took: %lfs\n", (double)(clock()-start)/CLOCKS_PER_SEC);
-		arrfree(batches);
-		if (test_set) {
-			size_t t, ts; // test, test_success
-			for (t = 0, ts = 0; t < arrlen(test_set); ++t) {
-				ts += network_test(net, test_set[t]);
+		ws->overflow = false;
+	}
+	for (size_t s = 1; s < T; s *= 2) {
+		pthread_barrier_wait(&tr->sync);
+		if (id % (2 * s) != 0 || id + s >= T) continue;
+		Workspace *other = tr->ws[id + s];
+		ws->overflow |= other->overflow;
+		for (size_t l = 0; l < L; ++l) {
+			mat_operate(ws->grad_weights[l], 1, (MatOp){ ADD, other->grad_weights[l] });
+			vec_operate(ws->grad_biases[l], 1, (VecOp){ ADD, other->grad_biases[l] });
+		}
+	}
+}
+
+// hogwild: every worker applies its own batch updates straight to the shared weights
+// and biases without locking, racing updates are tolerated by design
+static void trainer_hogwild(Trainer *tr, size_t id) {
+	Workspace *ws = tr->ws[id];
+	for (;;) {
+		Batch *ready = NULL;
+		mat_t X;
+		const uint8_t *labels;
+		if (tr->pf) {
+			if ((ready = prefetch_next(tr->pf)) == NULL) break;
+			X = mat_slice(ready->X, 0, ready->n), labels = ready->labels;
+		} else {
+			size_t b = atomic_fetch_add_explicit(&tr->cursor, 1, memory_order_relaxed);
+			if (b >= tr->epoch->batches) break;
+			size_t n, *idx = epoch_batch(tr->epoch, b, &n);
+			X = trainer_gather(tr, ws, idx, n), labels = ws->labels;
+		}
+		backprop_batch(tr->net, ws, X, labels, ws->grad_weights, ws->grad_biases);
+		apply_gradients(tr->net, ws, tr->lrate, X.rows);
+		if (ready) prefetch_release(tr->pf, ready);
+	}
+	// the calling thread must not return while others still write to the network
+	pthread_barrier_wait(&tr->sync);
+}
+
+static void *trainer_worker(void *arg) {
+	WorkerArg *w = (WorkerArg*)arg;
+	for (;;) {
+		pthread_barrier_wait(&w->tr->sync);
+		if (w->tr->quit) break;
+		if (w->tr->hogwild) {
+			trainer_hogwild(w->tr, w->id);
+		} else {
+			trainer_step(w->tr, w->id);
+		}
+	}
+	free(w);
+	return NULL;
+}
+
+static void trainer_start(Trainer *tr, Network *net, Dataset *set, size_t threads, size_t batch_size, bool hogwild, uint64_t seed) {
+	tr->net = net;
+	tr->set = set;
+	tr->threads = threads;
+	tr->hogwild = hogwild;
+	tr->quit = false;
+	tr->ready = NULL;
+	tr->pf = NULL;
+	tr->augment = NULL, tr->augment_ctx = NULL;
+	tr->ws = (Workspace**)calloc(threads, sizeof(Workspace*));
+	tr->handles = (pthread_t*)calloc(threads, sizeof(pthread_t));
+	pthread_barrier_init(&tr->sync, NULL, threads);
+	size_t slice = hogwild ? batch_size : (batch_size + threads - 1) / threads;
+	for (size_t t = 0; t < threads; ++t) {
+		if (t == 0) {
+			tr->ws[0] = &net->ws;
+		} else {
+			tr->ws[t] = (Workspace*)malloc(sizeof(Workspace));
+			workspace_create(tr->ws[t], net->sizes);
+		}
+		workspace_reserve(tr->ws[t], net->sizes, slice);
+		rng_seed(&tr->ws[t]->rng, seed, RNG_STREAM_WORKER + t);
+	}
+	for (size_t t = 1; t < threads; ++t) {
+		WorkerArg *w = (WorkerArg*)malloc(sizeof(WorkerArg));
+		w->tr = tr, w->id = t;
+		thread_start(&tr->handles[t], trainer_worker, w);
+	}
+}
+
+// trains on the prefetched batch ready, or gathers the n samples of batch when it is NULL
+static void trainer_update_batch(Trainer *tr, size_t *batch, Batch *ready, size_t n, double lrate) {
+	tr->batch = batch, tr->ready = ready, tr->batch_len = n;
+	if (tr->threads > 1) pthread_barrier_wait(&tr->sync);
+	trainer_step(tr, 0);
+	apply_gradients(tr->net, tr->ws[0], lrate, n);
+}
+
+static void trainer_epoch_hogwild(Trainer *tr, Epoch *epoch, double lrate) {
+	tr->epoch = epoch, tr->lrate = lrate;
+	atomic_store(&tr->cursor, 0);
+	if (tr->threads > 1) pthread_barrier_wait(&tr->sync);
+	trainer_hogwild(tr, 0);
+}
+
+static void trainer_stop(Trainer *tr) {
+	tr->quit = true;
+	if (tr->threads > 1) pthread_barrier_wait(&tr->sync);
+	for (size_t t = 1; t < tr->threads; ++t) {
+		pthread_join(tr->handles[t], NULL);
+		workspace_destroy(tr->ws[t]);
+		free(tr->ws[t]);
+	}
+	pthread_barrier_destroy(&tr->sync);
+	free(tr->ws);
+	free(tr->handles);
+}
+
+// training state of a checkpoint, 64-byte aligned after the parameters and followed by
+//   Rng workers[workers]
+//   size_t order[samples]                   64-byte aligned
+//   for every layer l, each blob 64-byte aligned, m and mb when bit 0 of moments is set,
+//   v and vb when bit 1 is:
+//     real_t m[rows][stride], mb[rows], v[rows][stride], vb[rows]
+// the run stopped before batch `batch` of epoch `epoch`. order is that epoch's order once
+// shuffled, or the one before when batch is 0, as the shuffle is the first thing an epoch does
+typedef struct {
+	uint32_t optimizer; // OptimizerKind
+	uint32_t moments;
+	uint32_t workers;
+	uint32_t precision; // TrainPrecision
+	double beta1, beta2, eps, weight_decay;
+	uint64_t steps;
+	uint64_t epoch, batch;
+	uint64_t samples, batch_size;
+	Rng shuffle, loader;
+	double loss_scale; // MixedState of the run
+	uint64_t good_steps, skipped;
+} TrainState;
+
+typedef struct {
+	size_t state, workers, order;
+	size_t *m, *mb, *v, *vb; // per layer, 0 when the moment is not saved
+	size_t size;             // of the whole file
+} TrainLayout;
+
+static void train_layout(const size_t *sizes, size_t workers, size_t samples, uint32_t moments, TrainLayout *t) {
+	size_t layers = arrlen(sizes), L = layers - 1;
+	t->m = (size_t*)calloc(4 * layers, sizeof(size_t));
+	t->mb = t->m + layers, t->v = t->m + 2 * layers, t->vb = t->m + 3 * layers;
+	t->state = align_up(checkpoint_params_size(sizes));
+	t->workers = t->state + sizeof(TrainState);
+	t->order = align_up(t->workers + workers * sizeof(Rng));
+	size_t off = t->order + samples * sizeof(size_t);
+	for (size_t l = 0; l < L; ++l) {
+		size_t rows = sizes[l+1], w = rows * mat_stride(sizes[l]) * sizeof(real_t), b = rows * sizeof(real_t);
+		if (moments & 1) {
+			t->m[l] = align_up(off), off = t->m[l] + w;
+			t->mb[l] = align_up(off), off = t->mb[l] + b;
+		}
+		if (moments & 2) {
+			t->v[l] = align_up(off), off = t->v[l] + w;
+			t->vb[l] = align_up(off), off = t->vb[l] + b;
+		}
+	}
+	t->size = off;
+}
+
+// background writer of the checkpoints of network_SGD. between batches, while the writer
+// is idle, the training thread snapshots everything into buf, which only costs a copy of
+// the state; the checksum, the write and the fsync happen on the writer
+typedef struct {
+	const char *path;
+	size_t every;
+	bool epochs_only; // hogwild workers never stop between batches
+	Network *net;
+	Trainer *tr;
+	Epoch *ep;
+	Rng *shuffle, *loader;
+	TrainLayout layout;
+	uint32_t moments;
+	uint8_t *buf;
+	size_t since; // batches trained since the last snapshot
+	bool busy;    // buf holds a snapshot the writer has not committed yet
+	bool quit;
+	pthread_mutex_t lock;
+	pthread_cond_t wake, idle;
+	pthread_t thread;
+} Checkpointer;
+
+static void *checkpoint_writer(void *arg) {
+	Checkpointer *ck = (Checkpointer*)arg;
+	pthread_mutex_lock(&ck->lock);
+	for (;;) {
+		while (!ck->busy && !ck->quit) pthread_cond_wait(&ck->wake, &ck->lock);
+		if (!ck->busy) break;
+		pthread_mutex_unlock(&ck->lock);
+		checkpoint_seal(ck->buf);
+		const char *why = checkpoint_commit(ck->path, ck->buf, ck->layout.size);
+		// a failed write keeps the last good checkpoint, training goes on
+		if (why) fprintf(stderr, "ERROR :: checkpoint %s: %s\n", ck->path, why);
+		pthread_mutex_lock(&ck->lock);
+		ck->busy = false;
+		pthread_cond_broadcast(&ck->idle);
+	}
+	pthread_mutex_unlock(&ck->lock);
+	return NULL;
+}
+
+static void checkpointer_create(Checkpointer *ck, Network *net, TrainConfig *cfg, Trainer *tr, Epoch *ep, Rng *shuffle, Rng *loader) {
+	memset(ck, 0, sizeof(*ck));
+	ck->path = cfg->checkpoint;
+	ck->every = cfg->checkpoint_every;
+	ck->epochs_only = cfg->hogwild;
+	ck->net = net, ck->tr = tr, ck->ep = ep;
+	ck->shuffle = shuffle, ck->loader = loader;
+	ck->moments = (net->opt.m != NULL) | (net->opt.v != NULL) << 1;
+	train_layout(net->sizes, tr->threads, ep->count, ck->moments, &ck->layout);
+	ck->buf = (uint8_t*)calloc(1, ck->layout.size);
+	assert(ck->buf != NULL && "network_SGD: checkpoint buffer");
+	pthread_mutex_init(&ck->lock, NULL);
+	pthread_cond_init(&ck->wake, NULL);
+	pthread_cond_init(&ck->idle, NULL);
+	thread_start(&ck->thread, checkpoint_writer, ck);
+}
+
+// copies the state of the run, about to start batch `batch` of epoch `epoch`, into the buffer
+// and hands it to the writer. a busy writer makes it give up, unless wait is set
+static bool checkpoint_snapshot(Checkpointer *ck, size_t epoch, size_t batch, bool wait) {
+	pthread_mutex_lock(&ck->lock);
+	if (ck->busy && !wait) {
+		pthread_mutex_unlock(&ck->lock);
+		return false;
+	}
+	while (ck->busy) pthread_cond_wait(&ck->idle, &ck->lock);
+	pthread_mutex_unlock(&ck->lock);
+
+	Network *net = ck->net;
+	TrainLayout *t = &ck->layout;
+	Optimizer *o = &net->optimizer;
+	uint8_t *buf = ck->buf;
+	checkpoint_params(net, buf, t->size, CHECKPOINT_TRAINING);
+	TrainState st = {
+		.optimizer = o->kind, .moments = ck->moments, .workers = (uint32_t)ck->tr->threads,
+		.beta1 = o->beta1, .beta2 = o->beta2, .eps = o->eps, .weight_decay = o->weight_decay,
+		.steps = atomic_load(&net->opt.steps), .epoch = epoch, .batch = batch,
+		.samples = ck->ep->count, .batch_size = ck->ep->batch_size,
+		.shuffle = *ck->shuffle, .loader = *ck->loader,
+		.precision = net->mixed.precision, .loss_scale = atomic_load(&net->mixed.loss_scale),
+		.good_steps = atomic_load(&net->mixed.good_steps), .skipped = atomic_load(&net->mixed.skipped),
+	};
+	memcpy(buf + t->state, &st, sizeof(st));
+	for (size_t w = 0; w < ck->tr->threads; ++w) memcpy(buf + t->workers + w * sizeof(Rng), &ck->tr->ws[w]->rng, sizeof(Rng));
+	memcpy(buf + t->order, ck->ep->order, ck->ep->count * sizeof(size_t));
+	for (size_t l = 0; l < arrlen(net->weights); ++l) {
+		size_t rows = net->weights[l].rows, w = rows * net->weights[l].stride * sizeof(real_t), b = rows * sizeof(real_t);
+		if (ck->moments & 1) {
+			memcpy(buf + t->m[l], net->opt.m[l].data, w);
+			memcpy(buf + t->mb[l], net->opt.mb[l], b);
+		}
+		if (ck->moments & 2) {
+			memcpy(buf + t->v[l], net->opt.v[l].data, w);
+			memcpy(buf + t->vb[l], net->opt.vb[l], b);
+		}
+	}
+
+	pthread_mutex_lock(&ck->lock);
+	ck->busy = true;
+	ck->since = 0;
+	pthread_cond_signal(&ck->wake);
+	pthread_mutex_unlock(&ck->lock);
+	return true;
+}
+
+// called once batch b of epoch e and the trained batches before it are done, snapshots
+// when a checkpoint is due. one the writer is too busy for is retried after the next batch
+static void checkpoint_progress(Checkpointer *ck, size_t e, size_t b, size_t trained) {
+	ck->since += trained;
+	bool epoch_end = b + 1 == ck->ep->batches;
+	bool due = ck->every > 0 ? ck->since >= ck->every : epoch_end;
+	if (!due || (ck->epochs_only && !epoch_end)) return;
+	if (epoch_end) checkpoint_snapshot(ck, e + 1, 0, false);
+	else checkpoint_snapshot(ck, e, b + 1, false);
+}
+
+// waits for the writer, the last checkpoint then is on disk
+static void checkpointer_destroy(Checkpointer *ck) {
+	pthread_mutex_lock(&ck->lock);
+	ck->quit = true;
+	pthread_cond_signal(&ck->wake);
+	pthread_mutex_unlock(&ck->lock);
+	pthread_join(ck->thread, NULL);
+	pthread_mutex_destroy(&ck->lock);
+	pthread_cond_destroy(&ck->wake);
+	pthread_cond_destroy(&ck->idle);
+	free(ck->layout.m);
+	free(ck->buf);
+}
+
+// why the checkpoint at path cannot be resumed from, on stderr
+static int resume_error(const char *path, const char *why, Network *ck) {
+	fprintf(stderr, "ERROR :: checkpoint %s: %s\n", path, why);
+	if (ck) network_destroy(ck);
+	return -1;
+}
+
+// restores the run saved in the checkpoint at path: 1 when it did, 0 when there is none yet,
+// -1 with a message on stderr when the file cannot be resumed from. the file is checked
+// whole before anything of the network is touched
+static int checkpoint_resume(Network *net, TrainConfig *cfg, Trainer *tr, Epoch *ep, Rng *shuffle, Rng *loader, size_t *epoch, size_t *batch) {
+	const char *path = cfg->checkpoint;
+	if (access(path, F_OK) != 0) return 0;
+	Network *ck = network_load(path, true);
+	if (ck == NULL) return -1;
+	const uint8_t *map = (const uint8_t*)ck->map;
+	if (!(((const CheckpointHeader*)map)->flags & CHECKPOINT_TRAINING)) return resume_error(path, "holds no training state", ck);
+	size_t L = arrlen(net->weights);
+	bool same = arrlen(ck->sizes) == arrlen(net->sizes);
+	for (size_t l = 0; same && l <= L; ++l) same = ck->sizes[l] == net->sizes[l];
+	if (!same) return resume_error(path, "of another network", ck);
+	TrainState st;
+	size_t state = align_up(checkpoint_params_size(ck->sizes));
+	if (state + sizeof(st) > ck->map_size) return resume_error(path, "corrupt training state", ck);
+	memcpy(&st, map + state, sizeof(st));
+	if (st.samples != ep->count || st.batch_size != ep->batch_size) return resume_error(path, "of another dataset or batch size", ck);
+	if (st.optimizer > OPT_ADAMW || st.moments > 3 || st.batch >= ep->batches || st.precision > TRAIN_FP16) {
+		return resume_error(path, "corrupt training state", ck);
+	}
+	TrainLayout t;
+	train_layout(net->sizes, st.workers, st.samples, st.moments, &t);
+	if (t.size != ck->map_size) {
+		free(t.m);
+		return resume_error(path, "corrupt training state", ck);
+	}
+
+	for (size_t l = 0; l < L; ++l) {
+		mat_t w = net->weights[l];
+		memcpy(w.data, ck->weights[l].data, w.rows * w.stride * sizeof(real_t));
+		memcpy(net->biases[l], ck->biases[l], w.rows * sizeof(real_t));
+		net->activations[l] = ck->activations[l];
+	}
+	net->loss = ck->loss;
+	net->optimizer = (Optimizer){ (OptimizerKind)st.optimizer, st.beta1, st.beta2, st.eps, st.weight_decay };
+	optimizer_reserve(net);
+	optimizer_reset(&net->opt);
+	for (size_t l = 0; l < L; ++l) {
+		size_t rows = net->weights[l].rows, w = rows * net->weights[l].stride * sizeof(real_t), b = rows * sizeof(real_t);
+		if ((st.moments & 1) && net->opt.m) {
+			memcpy(net->opt.m[l].data, map + t.m[l], w);
+			memcpy(net->opt.mb[l], map + t.mb[l], b);
+		}
+		if ((st.moments & 2) && net->opt.v) {
+			memcpy(net->opt.v[l].data, map + t.v[l], w);
+			memcpy(net->opt.vb[l], map + t.vb[l], b);
+		}
+	}
+	atomic_store(&net->opt.steps, st.steps);
+	// the loss scale goes on where it was when the run keeps its precision
+	if (st.precision == net->mixed.precision) {
+		atomic_store(&net->mixed.loss_scale, st.loss_scale);
+		atomic_store(&net->mixed.good_steps, st.good_steps);
+		atomic_store(&net->mixed.skipped, st.skipped);
+	}
+	*shuffle = st.shuffle, *loader = st.loader;
+	// other worker counts keep the streams seeded for them, the run goes on but no longer
+	// replays the one that was stopped
+	if (st.workers == tr->threads) {
+		for (size_t w = 0; w < tr->threads; ++w) memcpy(&tr->ws[w]->rng, map + t.workers + w * sizeof(Rng), sizeof(Rng));
+	}
+	memcpy(ep->order, map + t.order, st.samples * sizeof(size_t));
+	*epoch = st.epoch, *batch = st.batch;
+	free(t.m);
+	network_destroy(ck);
+	printf("INFO :: resuming from %s at epoch %zu, batch %zu\n", cfg->checkpoint, *epoch, *batch);
+	return 1;
+}
+
+bool network_SGD(Network *net, TrainConfig *cfg, Dataset *training_set, Dataset *test_set) {
+	size_t threads = cfg->threads > 0 ? cfg->threads : 1;
+	// hogwild workers step the optimizer concurrently, its moments must exist before
+	optimizer_reserve(net);
+	Trainer tr;
+	trainer_start(&tr, net, training_set, threads, cfg->batch_size, cfg->hogwild, cfg->seed);
+	tr.augment = cfg->augment, tr.augment_ctx = cfg->augment_ctx;
+	Prefetcher pf;
+	if (cfg->prefetch > 0) {
+		// room for the batches in training plus the ones gathered ahead of them
+		size_t consumers = cfg->hogwild ? threads : 1;
+		prefetch_create(&pf, training_set, cfg->prefetch + consumers, cfg->batch_size, cfg->augment, cfg->augment_ctx, cfg->seed);
+		tr.pf = &pf;
+	}
+	dataset_advise(training_set, DATASET_RANDOM);
+	size_t n = training_set->count;
+	Epoch ep = { (size_t*)malloc(n * sizeof(size_t)), n, cfg->batch_size, (n + cfg->batch_size - 1) / cfg->batch_size };
+	for (size_t i = 0; i < n; ++i) ep.order[i] = i;
+	// the samples never move, only their order does
+	Rng shuffle, loader;
+	rng_seed(&shuffle, cfg->seed, RNG_STREAM_SHUFFLE);
+	rng_seed(&loader, cfg->seed, RNG_STREAM_LOADER);
+	size_t first_epoch = 0, first_batch = 0;
+	mixed_reserve(net, cfg->precision);
+	int resumed = cfg->checkpoint && cfg->resume ? checkpoint_resume(net, cfg, &tr, &ep, &shuffle, &loader, &first_epoch, &first_batch) : 0;
+	if (resumed < 0) {
+		free(ep.order);
+		if (tr.pf) prefetch_destroy(tr.pf);
+		trainer_stop(&tr);
+		return false;
+	}
+	if (resumed && tr.pf) tr.pf->rng = loader;
+	mixed_sync(net);
+	Checkpointer ck;
+	if (cfg->checkpoint) checkpointer_create(&ck, net, cfg, &tr, &ep, &shuffle, &loader);
+	for (size_t e = first_epoch; e < cfg->epochs; ++e) {
+		size_t first = e == first_epoch ? first_batch : 0;
+		if (first == 0) rng_shuffle(&shuffle, ep.order, n);
+		printf("DEBUG :: analysing %zu batches on %zu threads%s\n", ep.batches - first, threads, cfg->hogwild ? " (hogwild)" : "");
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		size_t allocs = nn_alloc_count;
+		if (tr.pf) prefetch_epoch(tr.pf, &ep, first);
+		if (cfg->hogwild) {
+			trainer_epoch_hogwild(&tr, &ep, cfg->lrate);
+		} else if (tr.pf) {
+			size_t b = first;
+			for (Batch *ready; (ready = prefetch_next(tr.pf)) != NULL; prefetch_release(tr.pf, ready), ++b) {
+				trainer_update_batch(&tr, NULL, ready, ready->n, cfg->lrate);
+				loader = ready->rng;
+				if (cfg->checkpoint) checkpoint_progress(&ck, e, b, 1);
+			}
+		} else {
+			for (size_t b = first; b < ep.batches; ++b) {
+				size_t len, *batch = epoch_batch(&ep, b, &len);
+				trainer_update_batch(&tr, batch, NULL, len, cfg->lrate);
+				if (cfg->checkpoint) checkpoint_progress(&ck, e, b, 1);
 			}
-			printf("INFO :: Epoch %zu: %zu/%zu\n", e, ts, t);
+		}
+		if (tr.pf) prefetch_join(tr.pf);
+		if (cfg->hogwild && tr.pf) loader = tr.pf->rng;
+		if (cfg->hogwild && cfg->checkpoint) checkpoint_progress(&ck, e, ep.batches - 1, ep.batches - first);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		double took = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+		printf("DEBUG :: took: %lfs, %zu allocations\n", took, nn_alloc_count - allocs);
+		if (test_set) {
+			Evaluation ev = network_evaluate(net, test_set, &(EvalOptions){ .threads = threads });
+			printf("INFO :: Epoch %zu: %zu/%zu\n", e, ev.correct, ev.count);
+			evaluation_destroy(&ev);
 			continue;
 		}
 		printf("INFO :: Epoch %zu\n", e);
 	}
+	if (cfg->checkpoint) {
+		if (ck.since > 0) checkpoint_snapshot(&ck, cfg->epochs, 0, true);
+		checkpointer_destroy(&ck);
+	}
+	free(ep.order);
+	if (tr.pf) prefetch_destroy(tr.pf);
+	trainer_stop(&tr);
+	return true;
 }
 
-int network_test(Network *net, DataEntry entry) {
-	vec_t y = entry.x;
-	vec_t *Y = new_vec_arr(net->sizes);
-	for (size_t l = 0; l < arrlen(Y); ++l) {
-		mat_vec_dot(Y[l], net->weights[l], y);
-		vec_operate(Y[l], 1, (VecOp){ ADD, net->biases[l] });
-		sigmoid(Y[l], Y[l]);
-		y = Y[l];
+// evaluation: thread t takes batches t, t + threads, ... and counts into its own confusion
+// matrix. the losses are kept per batch and summed in batch order, so no total depends on
+// how the batches were spread
+typedef struct {
+	Network *net;
+	Dataset *set;
+	size_t batch_size, threads;
+	size_t classes;
+	double *losses; // one per batch, NULL unless asked for
+} EvalJob;
+
+typedef struct {
+	EvalJob *job;
+	size_t id;
+	Workspace *ws;
+	size_t correct;
+	size_t *confusion;
+} EvalWorker;
+
+static void *eval_worker(void *arg) {
+	EvalWorker *w = (EvalWorker*)arg;
+	EvalJob *job = w->job;
+	Network *net = job->net;
+	Workspace *ws = w->ws;
+	size_t L = arrlen(net->sizes) - 1, count = job->set->count;
+	size_t *idx = (size_t*)malloc(job->batch_size * sizeof(size_t));
+	Activation out = net->activations[L-1];
+	for (size_t off = w->id * job->batch_size; off < count; off += job->threads * job->batch_size) {
+		size_t n = count - off < job->batch_size ? count - off : job->batch_size;
+		for (size_t b = 0; b < n; ++b) idx[b] = off + b;
+		mat_t X = mat_slice(ws->X, 0, n), a = X;
+		gather_batch(job->set, idx, n, X, ws->labels, NULL, NULL, NULL);
+		for (size_t l = 0; l < L - 1; ++l) {
+			forward_layer(net, l, a, NULL, mat_slice(ws->Z[l], 0, n), mat_slice(ws->A[l], 0, n), false);
+			a = mat_slice(ws->A[l], 0, n);
+		}
+		// every output activation is monotonic, argmax is taken from the weighted inputs
+		mat_t Z = mat_slice(ws->Z[L-1], 0, n);
+		mat_gemm_epilogue(Z, GEMM_NT, a, net->weights[L-1], 1, 0, &(Epilogue){ .bias = net->biases[L-1], .act = ACT_IDENTITY });
+		double loss = 0;
+		for (size_t b = 0; b < n; ++b) {
+			real_t *z = mat_row(Z, b);
+			size_t max = 0, label = ws->labels[b];
+			for (size_t k = 1; k < Z.cols; ++k) if (z[k] > z[max]) max = k;
+			w->correct += max == label;
+			w->confusion[label * job->classes + max]++;
+			if (!job->losses) continue;
+			real_t *act = mat_row(ws->A[L-1], b);
+			if (out != ACT_SOFTMAX) activate(out, act, z, Z.cols);
+			loss += output_delta(net, act, mat_row(ws->D[L-1], b), z, Z.cols, label);
+		}
+		if (job->losses) job->losses[off / job->batch_size] = loss;
+	}
+	free(idx);
+	return NULL;
+}
+
+Evaluation network_evaluate(Network *net, Dataset *set, const EvalOptions *opts) {
+	EvalOptions o = opts ? *opts : (EvalOptions){ 0 };
+	size_t outputs = net->sizes[arrlen(net->sizes) - 1];
+	EvalJob job = { .net = net, .set = set, .batch_size = o.batch_size > 0 ? o.batch_size : 256, .threads = o.threads > 0 ? o.threads : 1 };
+	job.classes = set->classes > outputs ? set->classes : outputs;
+	// no thread without a batch of its own
+	size_t batches = (set->count + job.batch_size - 1) / job.batch_size;
+	if (job.threads > batches) job.threads = batches > 0 ? batches : 1;
+	if (o.loss) job.losses = (double*)malloc(batches * sizeof(double));
+
+	EvalWorker workers[job.threads];
+	pthread_t handles[job.threads];
+	for (size_t t = 0; t < job.threads; ++t) {
+		workers[t] = (EvalWorker){ &job, t, &net->ws, 0, (size_t*)calloc(job.classes * job.classes, sizeof(size_t)) };
+		if (t > 0) {
+			workers[t].ws = (Workspace*)malloc(sizeof(Workspace));
+			workspace_create(workers[t].ws, net->sizes);
+		}
+		workspace_reserve(workers[t].ws, net->sizes, job.batch_size);
+	}
+	for (size_t t = 1; t < job.threads; ++t) {
+		thread_start(&handles[t], eval_worker, &workers[t]);
+	}
+	eval_worker(&workers[0]);
+
+	Evaluation ev = { .count = set->count, .classes = job.classes, .confusion = workers[0].confusion };
+	for (size_t t = 0; t < job.threads; ++t) {
+		if (t > 0) {
+			pthread_join(handles[t], NULL);
+			workspace_destroy(workers[t].ws);
+			free(workers[t].ws);
+			for (size_t k = 0; k < job.classes * job.classes; ++k) ev.confusion[k] += workers[t].confusion[k];
+			free(workers[t].confusion);
+		}
+		ev.correct += workers[t].correct;
+	}
+	for (size_t b = 0; job.losses && b < batches; ++b) ev.loss += job.losses[b];
+	free(job.losses);
+	ev.accuracy = set->count ? (double)ev.correct / set->count : 0;
+	ev.loss = set->count ? ev.loss / set->count : 0;
+	return ev;
+}
+
+void evaluation_destroy(Evaluation *ev) {
+	free(ev->confusion);
+	ev->confusion = NULL;
+}
+
+// output channels of a QuantLayer whose weights stay in cache across the rows of a batch
+#define QUANT_BLOCK 64
+
+// calibration batch, and batch of quant_network_evaluate unless told otherwise
+#define QUANT_BATCH 256
+
+static void quant_scratch_reserve(QuantScratch *s, size_t *sizes, size_t batch) {
+	if (batch <= s->batch) return;
+	if (s->batch) {
+		mat_destroy(s->X), mat_destroy(s->A);
+		free(s->Xq), free(s->acc);
 	}
+	size_t widest = 0, stride = 0;
+	for (size_t l = 1; l < arrlen(sizes); ++l) {
+		if (sizes[l] > widest) widest = sizes[l];
+		size_t in = (sizes[l-1] + NN_ALIGN - 1) / NN_ALIGN * NN_ALIGN;
+		if (in > stride) stride = in;
+	}
+	s->batch = batch;
+	s->X = mat_new(batch, sizes[0]);
+	s->A = mat_new(batch, widest);
+	// the padding of every row stays zero-weighted, but it is read, so it is cleared once
+	s->Xq = (uint8_t*)aligned_alloc(NN_ALIGN, batch * stride);
+	memset(s->Xq, 0, batch * stride);
+	s->acc = (int32_t*)malloc(batch * widest * sizeof(int32_t));
+}
+
+static void quant_scratch_free(QuantScratch *s) {
+	if (s->batch == 0) return;
+	mat_destroy(s->X), mat_destroy(s->A);
+	free(s->Xq), free(s->acc);
+}
+
+// q = round(x / scale) + zero, clamped to a byte
+static void quantize_row(uint8_t *q, const real_t *x, size_t n, real_t inv_scale, int32_t zero) {
+	for (size_t i = 0; i < n; ++i) {
+		real_t v = x[i] * inv_scale + (real_t)zero + (real_t)0.5;
+		v = v < 0 ? 0 : v > 255 ? 255 : v;
+		q[i] = (uint8_t)v;
+	}
+}
+
+// the int8 forward pass of the n rows of X, returns the view of the output layer's weighted
+// inputs: every output activation is monotonic, so they classify like the activations
+static mat_t quant_forward(QuantNetwork *q, QuantScratch *s, mat_t X) {
+	size_t n = X.rows;
+	mat_t in = X, out = in;
+	for (size_t l = 0; l < arrlen(q->layers); ++l) {
+		QuantLayer *ql = &q->layers[l];
+		bool last = l + 1 == arrlen(q->layers);
+		for (size_t b = 0; b < n; ++b) {
+			quantize_row(s->Xq + b * ql->stride, mat_row(in, b), ql->cols, 1 / ql->in_scale, ql->in_zero);
+		}
+		for (size_t c = 0; c < ql->rows; c += QUANT_BLOCK) {
+			size_t rows = ql->rows - c < QUANT_BLOCK ? ql->rows - c : QUANT_BLOCK;
+			nn_kernels.qgemm(s->acc + c, ql->rows, s->Xq, ql->stride, n, ql->weights + c * ql->stride, ql->stride, rows, ql->stride);
+		}
+		out = (mat_t){ n, ql->rows, s->A.stride, s->A.data };
+		Activation act = last || ql->act == ACT_SOFTMAX ? ACT_IDENTITY : ql->act;
+		for (size_t b = 0; b < n; ++b) {
+			real_t *a = mat_row(out, b);
+			const int32_t *acc = s->acc + b * ql->rows;
+			for (size_t c = 0; c < ql->rows; ++c) a[c] = ql->scale[c] * (real_t)acc[c];
+			nn_kernels.bias_act(a, a, ql->offset, NULL, ql->rows, act);
+			if (!last && ql->act == ACT_SOFTMAX) activate(ACT_SOFTMAX, a, a, ql->rows);
+		}
+		in = out;
+	}
+	return out;
+}
+
+static size_t argmax(const real_t *z, size_t n) {
 	size_t max = 0;
-	for (size_t i = 1; i < arrlen(y); ++i) if (y[i] > y[max]) max = i;
-	int ret = entry.y[max] >= 1;
-	free_vec_arr(Y);
-	return ret;
+	for (size_t k = 1; k < n; ++k) if (z[k] > z[max]) max = k;
+	return max;
 }
 
-void network_update_batch(Network *net, DataEntry *batch, double lrate) {
-	// allocate gradients
-	mat_t *grad_weights = new_mat_arr(net->sizes);
-	vec_t *grad_biases = new_vec_arr(net->sizes);
+// the input range of every layer over the calibration samples, widened to hold 0 so that
+// zero, the padding and relu's floor, is exact
+static void quant_calibrate(Network *net, Dataset *set, size_t samples, real_t *lo, real_t *hi) {
+	size_t L = arrlen(net->sizes) - 1, count = set->count;
+	if (samples == 0 || samples > count) samples = count;
+	for (size_t l = 0; l < L; ++l) lo[l] = hi[l] = 0;
+	Workspace *ws = &net->ws;
+	workspace_reserve(ws, net->sizes, QUANT_BATCH);
+	size_t idx[QUANT_BATCH];
+	for (size_t off = 0; off < samples; off += QUANT_BATCH) {
+		size_t n = samples - off < QUANT_BATCH ? samples - off : QUANT_BATCH;
+		for (size_t b = 0; b < n; ++b) idx[b] = (off + b) * count / samples;
+		mat_t a = mat_slice(ws->X, 0, n);
+		gather_batch(set, idx, n, a, ws->labels, NULL, NULL, NULL);
+		for (size_t l = 0; l < L; ++l) {
+			for (size_t b = 0; b < n; ++b) {
+				const real_t *x = mat_row(a, b);
+				for (size_t i = 0; i < a.cols; ++i) {
+					if (x[i] < lo[l]) lo[l] = x[i];
+					if (x[i] > hi[l]) hi[l] = x[i];
+				}
+			}
+			if (l + 1 == L) break;
+			forward_layer(net, l, a, NULL, mat_slice(ws->Z[l], 0, n), mat_slice(ws->A[l], 0, n), false);
+			a = mat_slice(ws->A[l], 0, n);
+		}
+	}
+}
 
-	// calculate gradients
-	for (size_t b = 0; b < arrlen(batch); ++b) {
-		network_backprop(net, batch[b], grad_weights, grad_biases);
+QuantNetwork *network_quantize(Network *net, Dataset *calibration, size_t samples) {
+	size_t L = arrlen(net->sizes) - 1;
+	real_t lo[L], hi[L];
+	quant_calibrate(net, calibration, samples, lo, hi);
+	QuantNetwork *q = (QuantNetwork*)calloc(1, sizeof(QuantNetwork));
+	for (size_t l = 0; l <= L; ++l) arrpush(q->sizes, net->sizes[l]);
+	for (size_t l = 0; l < L; ++l) {
+		mat_t w = net->weights[l];
+		QuantLayer ql = { .rows = w.rows, .cols = w.cols, .act = net->activations[l] };
+		ql.stride = (w.cols + NN_ALIGN - 1) / NN_ALIGN * NN_ALIGN;
+		ql.in_scale = hi[l] > lo[l] ? (hi[l] - lo[l]) / 255 : 1;
+		ql.in_zero = (int32_t)floor(-lo[l] / ql.in_scale + 0.5);
+		ql.weights = (int8_t*)aligned_alloc(NN_ALIGN, w.rows * ql.stride);
+		memset(ql.weights, 0, w.rows * ql.stride);
+		ql.scale = (real_t*)malloc(w.rows * sizeof(real_t));
+		ql.offset = (real_t*)malloc(w.rows * sizeof(real_t));
+		for (size_t c = 0; c < w.rows; ++c) {
+			const real_t *row = mat_row(w, c);
+			real_t max = 0;
+			for (size_t i = 0; i < w.cols; ++i) max = fmax(max, fabs(row[i]));
+			real_t s = max > 0 ? max / QUANT_WEIGHT_MAX : 1;
+			int8_t *qrow = ql.weights + c * ql.stride;
+			int32_t sum = 0;
+			for (size_t i = 0; i < w.cols; ++i) {
+				qrow[i] = (int8_t)lrint(row[i] / s);
+				sum += qrow[i];
+			}
+			ql.scale[c] = ql.in_scale * s;
+			ql.offset[c] = net->biases[l][c] - ql.scale[c] * (real_t)ql.in_zero * (real_t)sum;
+		}
+		arrpush(q->layers, ql);
 	}
-	
-	double scaler = -(lrate / arrlen(batch));
-	for (size_t l = 0; l < arrlen(net->sizes)-1; ++l) {
-		mat_scale(grad_weights[l], scaler);
-		vec_scale(grad_biases[l], scaler);
-		mat_operate(net->weights[l], 1, (MatOp){ ADD, grad_weights[l] });
-		vec_operate(net->biases[l], 1, (VecOp){ ADD, grad_biases[l] });
+	return q;
+}
+
+void quant_network_destroy(QuantNetwork *q) {
+	for (size_t l = 0; l < arrlen(q->layers); ++l) {
+		free(q->layers[l].weights);
+		free(q->layers[l].scale);
+		free(q->layers[l].offset);
 	}
+	arrfree(q->layers);
+	arrfree(q->sizes);
+	quant_scratch_free(&q->scratch);
+	free(q);
+}
 
-	// free gradients
-	free_mat_arr(grad_weights);
-	free_vec_arr(grad_biases);
+size_t quant_network_size(QuantNetwork *q) {
+	size_t bytes = 0;
+	for (size_t l = 0; l < arrlen(q->layers); ++l) {
+		bytes += q->layers[l].rows * (q->layers[l].stride + 2 * sizeof(real_t));
+	}
+	return bytes;
 }
 
-void network_backprop(Network *net, DataEntry entry, mat_t *grad_weights, vec_t *grad_biases) {
-	vec_t *Z = new_vec_arr(net->sizes);
-	vec_t *A = new_vec_arr(net->sizes);
-	vec_t a = entry.x;
-	for (size_t l = 0; l < arrlen(net->sizes)-1; ++l) {
-		mat_vec_dot(Z[l], net->weights[l], a);
-		vec_operate(Z[l], 1, (VecOp){ ADD, net->biases[l] });
-		sigmoid(A[l], Z[l]), a = A[l];
+void quant_network_classify(QuantNetwork *q, mat_t X, size_t *classes) {
+	for (size_t off = 0; off < X.rows; off += QUANT_BATCH) {
+		size_t n = X.rows - off < QUANT_BATCH ? X.rows - off : QUANT_BATCH;
+		quant_scratch_reserve(&q->scratch, q->sizes, n);
+		mat_t Z = quant_forward(q, &q->scratch, mat_slice(X, off, n));
+		for (size_t b = 0; b < n; ++b) classes[off + b] = argmax(mat_row(Z, b), Z.cols);
+	}
+}
+
+// quant_network_evaluate spreads batches over threads like network_evaluate
+typedef struct {
+	QuantNetwork *q;
+	Dataset *set;
+	size_t batch_size, threads, classes, id;
+	QuantScratch *s;
+	size_t correct;
+	size_t *confusion;
+} QuantEvalWorker;
+
+static void *quant_eval_worker(void *arg) {
+	QuantEvalWorker *w = (QuantEvalWorker*)arg;
+	size_t count = w->set->count;
+	size_t *idx = (size_t*)malloc(w->batch_size * sizeof(size_t));
+	uint8_t *labels = (uint8_t*)malloc(w->batch_size);
+	for (size_t off = w->id * w->batch_size; off < count; off += w->threads * w->batch_size) {
+		size_t n = count - off < w->batch_size ? count - off : w->batch_size;
+		for (size_t b = 0; b < n; ++b) idx[b] = off + b;
+		mat_t X = mat_slice(w->s->X, 0, n);
+		gather_batch(w->set, idx, n, X, labels, NULL, NULL, NULL);
+		mat_t Z = quant_forward(w->q, w->s, X);
+		for (size_t b = 0; b < n; ++b) {
+			size_t max = argmax(mat_row(Z, b), Z.cols);
+			w->correct += max == labels[b];
+			w->confusion[labels[b] * w->classes + max]++;
+		}
+	}
+	free(idx);
+	free(labels);
+	return NULL;
+}
+
+Evaluation quant_network_evaluate(QuantNetwork *q, Dataset *set, const EvalOptions *opts) {
+	EvalOptions o = opts ? *opts : (EvalOptions){ 0 };
+	size_t batch_size = o.batch_size > 0 ? o.batch_size : QUANT_BATCH, threads = o.threads > 0 ? o.threads : 1;
+	size_t outputs = q->sizes[arrlen(q->sizes) - 1], classes = set->classes > outputs ? set->classes : outputs;
+	size_t batches = (set->count + batch_size - 1) / batch_size;
+	if (threads > batches) threads = batches > 0 ? batches : 1;
+
+	QuantEvalWorker workers[threads];
+	QuantScratch scratch[threads];
+	pthread_t handles[threads];
+	for (size_t t = 0; t < threads; ++t) {
+		memset(&scratch[t], 0, sizeof(scratch[t]));
+		QuantScratch *s = t == 0 ? &q->scratch : &scratch[t];
+		quant_scratch_reserve(s, q->sizes, batch_size);
+		workers[t] = (QuantEvalWorker){ q, set, batch_size, threads, classes, t, s, 0, (size_t*)calloc(classes * classes, sizeof(size_t)) };
+	}
+	for (size_t t = 1; t < threads; ++t) {
+		thread_start(&handles[t], quant_eval_worker, &workers[t]);
+	}
+	quant_eval_worker(&workers[0]);
+
+	Evaluation ev = { .count = set->count, .classes = classes, .confusion = workers[0].confusion };
+	for (size_t t = 0; t < threads; ++t) {
+		if (t > 0) {
+			pthread_join(handles[t], NULL);
+			quant_scratch_free(&scratch[t]);
+			for (size_t k = 0; k < classes * classes; ++k) ev.confusion[k] += workers[t].confusion[k];
+			free(workers[t].confusion);
+		}
+		ev.correct += workers[t].correct;
+	}
+	ev.accuracy = set->count ? (double)ev.correct / set->count : 0;
+	return ev;
+}
+
+int network_test(Network *net, Dataset *set, size_t i) {
+	vec_t y = net->ws.x;
+	dataset_load_x(set, i, y);
+	vec_t *Y = net->ws.a;
+	for (size_t l = 0; l < arrlen(Y); ++l) {
+		forward_sample(net, l, y, net->ws.z[l], Y[l], false);
+		y = Y[l];
+	}
+	size_t max = 0;
+	for (size_t k = 1; k < arrlen(y); ++k) if (y[k] > y[max]) max = k;
+	return max == set->labels[i];
+}
+
+void network_predict(Network *net, mat_t X, mat_t Y) {
+	size_t L = arrlen(net->sizes) - 1, n = X.rows;
+	assert(X.cols == net->sizes[0] && Y.rows == n && Y.cols == net->sizes[L] && "network_predict");
+	workspace_reserve(&net->ws, net->sizes, n);
+	mat_t a = X;
+	for (size_t l = 0; l < L; ++l) {
+		mat_t A = l == L - 1 ? Y : mat_slice(net->ws.A[l], 0, n);
+		forward_layer(net, l, a, NULL, mat_slice(net->ws.Z[l], 0, n), A, false);
+		a = A;
+	}
+}
+
+void network_update_batch(Network *net, Dataset *set, size_t *batch, double lrate) {
+	mat_t *grad_weights = net->ws.grad_weights;
+	vec_t *grad_biases = net->ws.grad_biases;
+
+	// calculate gradients
+	network_backprop_batch(net, set, batch, grad_weights, grad_biases);
+	apply_gradients(net, &net->ws, lrate, arrlen(batch));
+}
+
+void network_backprop(Network *net, Dataset *set, size_t e, mat_t *grad_weights, vec_t *grad_biases) {
+	vec_t *Z = net->ws.z, *A = net->ws.a, *D = net->ws.d;
+	vec_t a = net->ws.x;
+	dataset_load_x(set, e, a);
+	size_t L = arrlen(net->sizes) - 1;
+	for (size_t l = 0; l < L; ++l) {
+		forward_sample(net, l, a, Z[l], A[l], l == L - 1);
+		a = A[l];
 	}
 	// ---------- //
-	vec_t *D = new_vec_arr(net->sizes);
-	for (ssize_t l = arrlen(D) - 1; l >= 0; --l) {
+	for (ssize_t l = L - 1; l >= 0; --l) {
 		// update gradients
-		vec_t v = l > 0 ? A[l-1] : entry.x;
+		vec_t v = l > 0 ? A[l-1] : net->ws.x;
+		if (l == L - 1) {
+			output_delta(net, A[l], D[l], Z[l], arrlen(D[l]), set->labels[e]);
+		} else {
+			// rows of W[l+1] are contiguous, walk them instead of the columns
+			matT_vec_dot(D[l], net->weights[l+1], D[l+1]);
+			activate_grad(net->activations[l], D[l], A[l], arrlen(D[l]));
+		}
 		for (size_t i = 0; i < arrlen(D[l]); ++i) {
-			if (l == arrlen(D) - 1) {
-				D[l][i] = A[l][i] - entry.y[i];
-			} else {
-				double val = 0;
-				for (size_t j = 0; j < arrlen(net->weights[l+1]); ++j) {
-					val += net->weights[l+1][j][i] * D[l+1][j];
-				}
-				D[l][i] = val;
-			}
-			D[l][i] *= d_sigmoid_prime(Z[l][i]);
 			grad_biases[l][i] += D[l][i];
+			real_t *gw = mat_row(grad_weights[l], i);
 			for (size_t j = 0; j < arrlen(v); ++j) {
-				grad_weights[l][i][j] += v[j] * D[l][i];
+				gw[j] += v[j] * D[l][i];
+			}
+		}
+	}
+}
+
+// the batch is laid out one sample per row so every layer is a single matrix product:
+//   Z[l] = A[l-1] * W[l]^T + b[l]
+//   D[l] = (D[l+1] * W[l+1]) . f'(Z[l]), with f'(Z[l]) taken from A[l] = f(Z[l])
+// and the output delta D[L-1] coming from the loss
+//   dW[l] = D[l]^T * A[l-1]
+// in mixed precision the operands of the three products are the 16-bit copies of X, A, D and
+// the weights, each rounded once right after it is computed
+void network_backprop_batch(Network *net, Dataset *set, size_t *batch, mat_t *grad_weights, vec_t *grad_biases) {
+	size_t n = arrlen(batch);
+	workspace_reserve(&net->ws, net->sizes, n);
+	mat_t X = mat_slice(net->ws.X, 0, n);
+	gather_batch(set, batch, n, X, net->ws.labels, NULL, NULL, NULL);
+	backprop_batch(net, &net->ws, X, net->ws.labels, grad_weights, grad_biases);
+	// the loss scale of an fp16 network stays inside
+	if (net->ws.loss_scale != 1) {
+		for (size_t l = 0; l < arrlen(net->weights); ++l) {
+			mat_scale(grad_weights[l], 1 / net->ws.loss_scale);
+			vec_scale(grad_biases[l], 1 / net->ws.loss_scale);
+		}
+		net->ws.loss_scale = 1;
+	}
+}
+
+// true when every value of m is finite
+static bool half_finite(hmat_t m) {
+	half_t inf = m.format == HALF_FP16 ? 0x7C00 : 0x7F80;
+	for (size_t b = 0; b < m.rows; ++b) {
+		const half_t *r = mat_row(m, b);
+		for (size_t i = 0; i < m.cols; ++i) if ((r[i] & inf) == inf) return false;
+	}
+	return true;
+}
+
+// X holds the gathered inputs of the batch, one sample per row, labels their classes
+static void backprop_batch(Network *net, Workspace *ws, mat_t X, const uint8_t *labels, mat_t *grad_weights, vec_t *grad_biases) {
+	size_t L = arrlen(net->sizes) - 1, n = X.rows;
+	workspace_reserve(ws, net->sizes, n);
+	MixedState *mx = &net->mixed;
+	bool half = mx->precision != TRAIN_FULL;
+	ws->loss_scale = mx->precision == TRAIN_FP16 ? (real_t)atomic_load_explicit(&mx->loss_scale, memory_order_relaxed) : 1;
+	ws->overflow = false;
+	if (half) workspace_reserve_half(ws, net->sizes, mx->precision == TRAIN_FP16 ? HALF_FP16 : HALF_BF16);
+	// views of the first n rows of the workspace buffers
+	mat_t Z[L], A[L], D[L];
+	hmat_t A16[L], D16[L], X16 = half ? hmat_slice(ws->X16, 0, n) : ws->X16;
+	for (size_t l = 0; l < L; ++l) {
+		Z[l] = mat_slice(ws->Z[l], 0, n);
+		A[l] = mat_slice(ws->A[l], 0, n);
+		D[l] = mat_slice(ws->D[l], 0, n);
+		if (half) A16[l] = hmat_slice(ws->A16[l], 0, n), D16[l] = hmat_slice(ws->D16[l], 0, n);
+	}
+
+	mat_t a = X;
+	if (half) hmat_store(X16, X);
+	for (size_t l = 0; l < L; ++l) {
+		forward_layer(net, l, a, !half ? NULL : l > 0 ? &A16[l-1] : &X16, Z[l], A[l], l == L - 1);
+		if (half && l < L - 1) hmat_store(A16[l], A[l]);
+		a = A[l];
+	}
+	// ---------- //
+	for (ssize_t l = L - 1; l >= 0; --l) {
+		if (l == L - 1) {
+			for (size_t b = 0; b < n; ++b) {
+				output_delta(net, mat_row(A[l], b), mat_row(D[l], b), mat_row(Z[l], b), D[l].cols, labels[b]);
+			}
+			if (ws->loss_scale != 1) mat_scale(D[l], ws->loss_scale);
+		} else {
+			if (half) hmat_gemm_epilogue(D[l], GEMM_NN, D16[l+1], mx->weights[l+1], 1, 0, NULL);
+			else mat_mat_dot(D[l], D[l+1], net->weights[l+1]);
+			for (size_t b = 0; b < n; ++b) {
+				activate_grad(net->activations[l], mat_row(D[l], b), mat_row(A[l], b), D[l].cols);
+			}
+		}
+		if (half) {
+			hmat_store(D16[l], D[l]);
+			ws->overflow |= !half_finite(D16[l]);
+			hmat_gemm_epilogue(grad_weights[l], GEMM_TN, D16[l], l > 0 ? A16[l-1] : X16, 1, 0, NULL);
+		} else {
+			matT_mat_dot(grad_weights[l], D[l], l > 0 ? A[l-1] : X);
+		}
+		for (size_t i = 0; i < D[l].cols; ++i) {
+			grad_biases[l][i] = 0;
+		}
+		for (size_t b = 0; b < n; ++b) {
+			real_t *d = mat_row(D[l], b);
+			for (size_t i = 0; i < D[l].cols; ++i) {
+				grad_biases[l][i] += d[i];
 			}
 		}
 	}
-	free_vec_arr(Z);
-	free_vec_arr(A);
-	free_vec_arr(D);
 }
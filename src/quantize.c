@@ -0,0 +1,75 @@
+// quantize.out <checkpoint> [calibration samples]: int8 copy of a trained network, with its
+// accuracy, agreement, size and speed on the test set next to the real_t network it came from
+#include <time.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <checkpoint> [calibration samples]\n", argv[0]);
+		return 1;
+	}
+	size_t samples = argc > 2 ? strtoull(argv[2], NULL, 10) : 1000;
+	Network *net = network_load(argv[1], true);
+	if (net == NULL) return 1;
+	Dataset *training_set = load_training_set();
+	Dataset *test_set = load_test_set();
+	if (training_set == NULL || test_set == NULL) return 1;
+
+	double start = now();
+	QuantNetwork *q = network_quantize(net, training_set, samples);
+	double calibrate = now() - start;
+
+	start = now();
+	Evaluation fp = network_evaluate(net, test_set, NULL);
+	double fp_time = now() - start;
+	start = now();
+	Evaluation ev = quant_network_evaluate(q, test_set, NULL);
+	double q_time = now() - start;
+
+	// per-sample agreement, one class at a time on both sides
+	mat_t X = mat_new(test_set->count, test_set->features);
+	for (size_t e = 0; e < test_set->count; ++e) dataset_load_x(test_set, e, mat_row(X, e));
+	size_t *classes = (size_t*)malloc(test_set->count * sizeof(size_t)), agree = 0;
+	quant_network_classify(q, X, classes);
+	for (size_t e = 0; e < test_set->count; ++e) {
+		network_test(net, test_set, e);
+		vec_t a = net->ws.a[arrlen(net->ws.a) - 1];
+		size_t max = 0;
+		for (size_t k = 1; k < arrlen(a); ++k) if (a[k] > a[max]) max = k;
+		agree += classes[e] == max;
+	}
+
+	// padded rows on both sides, like quant_network_size counts them
+	size_t bytes = 0;
+	for (size_t l = 0; l < arrlen(net->weights); ++l) bytes += net->weights[l].rows * (net->weights[l].stride + 1) * sizeof(real_t);
+	const char *name = sizeof(real_t) == sizeof(double) ? "fp64" : "fp32";
+	printf("isa: %s, int8 products: %s\n", nn_kernels.isa, nn_kernels.qisa);
+	printf("layers:");
+	for (size_t l = 0; l < arrlen(net->sizes); ++l) printf(" %zu", net->sizes[l]);
+	printf("\ncalibrated on %zu training samples in %.1fms\n", samples < training_set->count ? samples : training_set->count, calibrate * 1e3);
+	printf("%-5s accuracy %6.2f%%  %8.1f KB  %9.0f samples/s\n", name, 100 * fp.accuracy, bytes / 1e3, test_set->count / fp_time);
+	printf("int8  accuracy %6.2f%%  %8.1f KB  %9.0f samples/s\n", 100 * ev.accuracy, quant_network_size(q) / 1e3, test_set->count / q_time);
+	printf("int8 against %s: %+.2f points, %.2fx smaller, %.2fx the throughput, %zu/%zu classes agree\n",
+		name, 100 * (ev.accuracy - fp.accuracy), (double)bytes / quant_network_size(q), fp_time / q_time, agree, test_set->count);
+
+	free(classes);
+	mat_destroy(X);
+	evaluation_destroy(&fp);
+	evaluation_destroy(&ev);
+	quant_network_destroy(q);
+	network_destroy(net);
+	dataset_destroy(training_set);
+	dataset_destroy(test_set);
+	return 0;
+}
@@ -0,0 +1,57 @@
+// serve.out <checkpoint> <socket> [max batch] [max wait ms]: answers classification requests on
+// a unix domain socket in micro-batches, see include/nn_serve.h for the protocol. prints the
+// counters every second there was traffic, and once more on SIGINT or SIGTERM before exiting
+#include <signal.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define NN_SERVE_IMPLEMENTATION
+#include "nn_serve.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+static void print_stats(ServeStats st) {
+	printf("INFO :: %llu requests in %llu batches (%.1f per batch), %.0f requests/s, p50 %.3fms, p99 %.3fms\n",
+		(unsigned long long)st.requests, (unsigned long long)st.batches, st.mean_batch, st.throughput, st.p50 * 1e3, st.p99 * 1e3);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <checkpoint> <socket> [max batch] [max wait ms]\n", argv[0]);
+		return 1;
+	}
+	ServeConfig cfg = {
+		.path = argv[2],
+		.max_batch = argc > 3 ? strtoull(argv[3], NULL, 10) : 64,
+		.max_wait = argc > 4 ? strtod(argv[4], NULL) * 1e-3 : 1e-3,
+	};
+	Network *net = network_load(argv[1], true);
+	if (net == NULL) return 1;
+
+	// the signals are taken here by sigtimedwait, every thread started after inherits the mask
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	Server *s = server_start(net, &cfg);
+	if (s == NULL) {
+		network_destroy(net);
+		return 1;
+	}
+	printf("INFO :: serving %s on %s, batches of up to %zu, waiting up to %.3fms\n", argv[1], cfg.path, s->cfg.max_batch, cfg.max_wait * 1e3);
+	fflush(stdout);
+	uint64_t seen = 0;
+	for (;;) {
+		int sig = sigtimedwait(&set, NULL, &(struct timespec){ 1, 0 });
+		if (sig == SIGINT || sig == SIGTERM) break;
+		ServeStats st = server_stats(s);
+		if (st.requests != seen) print_stats(st);
+		seen = st.requests;
+	}
+	print_stats(server_stop(s));
+	network_destroy(net);
+	return 0;
+}
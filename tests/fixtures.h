@@ -0,0 +1,45 @@
+// synthetic datasets shared by the tests and the benches
+#ifndef NN_FIXTURES_H
+#define NN_FIXTURES_H
+
+#include <stdlib.h>
+#include "nn_data_loader.h"
+
+// nothing to learn: every pixel and label a fixed pattern of the sample and input index
+static inline Dataset *pattern_set(size_t n, size_t in, size_t out) {
+    Dataset *set = dataset_new(n, in, out);
+    for (size_t e = 0; e < n; ++e) {
+        for (size_t i = 0; i < in; ++i) dataset_sample(set, e)[i] = (e * 13 + i * 7) % 17 * 15;
+        set->labels[e] = e % out;
+    }
+    return set;
+}
+
+// label k lights up inputs k * width .. k * width + width - 1 over some noise. samples are
+// numbered from offset on, so sets with offsets far apart hold different samples
+static inline Dataset *class_set(size_t n, size_t in, size_t classes, size_t width, size_t offset) {
+    Dataset *set = dataset_new(n, in, classes);
+    for (size_t e = 0; e < n; ++e) {
+        size_t k = set->labels[e] = (e + offset) % classes;
+        for (size_t i = 0; i < in; ++i) dataset_sample(set, e)[i] = ((e + offset) * 7 + i * 13) % 23 * 4 + (i / width == k) * 140;
+    }
+    return set;
+}
+
+// mnist shaped, label k lights up row band k, the same shape parse_digits produces. drawn
+// from rand(), seed it with srand for a set of its own
+static inline Dataset *digit_set(size_t n) {
+    Dataset *set = dataset_new(n, 28 * 28, Y_SIZE);
+    for (size_t e = 0; e < n; ++e) {
+        uint8_t *x = dataset_sample(set, e);
+        size_t label = rand() % Y_SIZE;
+        for (size_t i = 0; i < 28 * 28; ++i) {
+            x[i] = rand() % 60;
+            if (i / 28 / 2 == label) x[i] += 150;
+        }
+        set->labels[e] = label;
+    }
+    return set;
+}
+
+#endif // NN_FIXTURES_H
@@ -0,0 +1,172 @@
+#include <math.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+// reference forward pass and loss in double, w/b are double copies of the network parameters
+static double ref_activate(Activation act, double *a, size_t n) {
+    double max = a[0], sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        switch (act) {
+            case ACT_SIGMOID: a[i] = 1 / (1 + exp(-a[i])); break;
+            case ACT_TANH: a[i] = tanh(a[i]); break;
+            case ACT_RELU: a[i] = a[i] > 0 ? a[i] : 0; break;
+            case ACT_LEAKY_RELU: a[i] = a[i] > 0 ? a[i] : LEAKY_RELU_SLOPE * a[i]; break;
+            case ACT_SOFTMAX: max = fmax(max, a[i]); break;
+            case ACT_IDENTITY: break;
+        }
+    }
+    if (act != ACT_SOFTMAX) return 0;
+    for (size_t i = 0; i < n; ++i) sum += a[i] = exp(a[i] - max);
+    for (size_t i = 0; i < n; ++i) a[i] /= sum;
+    return 0;
+}
+
+static double ref_loss(Network *net, double **w, double **b, Dataset *set, size_t e) {
+    double in[64], out[64];
+    size_t len = net->sizes[0];
+    for (size_t i = 0; i < len; ++i) in[i] = dataset_sample(set, e)[i] / 255.0;
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        size_t rows = net->weights[l].rows;
+        for (size_t i = 0; i < rows; ++i) {
+            out[i] = b[l][i];
+            for (size_t j = 0; j < len; ++j) out[i] += w[l][i * len + j] * in[j];
+        }
+        ref_activate(net->activations[l], out, rows);
+        len = rows;
+        memcpy(in, out, len * sizeof(double));
+    }
+    double loss = 0;
+    for (size_t i = 0; i < len; ++i) {
+        double y = i == set->labels[e];
+        if (net->loss == LOSS_QUADRATIC) loss += (in[i] - y) * (in[i] - y) / 2;
+        else if (net->activations[arrlen(net->activations) - 1] == ACT_SOFTMAX) loss -= y * log(in[i]);
+        else loss -= y ? log(in[i]) : log(1 - in[i]);
+    }
+    return loss;
+}
+
+// backprop against central differences of the reference loss, summed over the batch
+static void check_gradients(Activation hidden, Activation output, Loss loss) {
+    size_t *sizes = NULL;
+    arrpush(sizes, 6); arrpush(sizes, 7); arrpush(sizes, 5); arrpush(sizes, 4);
+    Network *net = network_create(sizes);
+    network_init(net, 11, 1);
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        mat_scale(net->weights[l], 0.5);
+        net->activations[l] = hidden;
+    }
+    net->activations[arrlen(net->activations) - 1] = output;
+    net->loss = loss;
+    Dataset *set = pattern_set(5, 6, 4);
+    size_t *batch = NULL;
+    for (size_t e = 0; e < set->count; ++e) arrpush(batch, e);
+    network_backprop_batch(net, set, batch, net->ws.grad_weights, net->ws.grad_biases);
+
+    size_t L = arrlen(net->weights);
+    double *w[L], *b[L];
+    for (size_t l = 0; l < L; ++l) {
+        mat_t m = net->weights[l];
+        w[l] = (double*)malloc(m.rows * m.cols * sizeof(double));
+        b[l] = (double*)malloc(m.rows * sizeof(double));
+        for (size_t i = 0; i < m.rows; ++i) {
+            b[l][i] = net->biases[l][i];
+            for (size_t j = 0; j < m.cols; ++j) w[l][i * m.cols + j] = MAT_AT(m, i, j);
+        }
+    }
+    double tol = sizeof(real_t) == sizeof(float) ? 2e-3 : 1e-6, h = 1e-6;
+    for (size_t l = 0; l < L; ++l) {
+        mat_t m = net->weights[l];
+        for (size_t i = 0; i < m.rows; ++i) {
+            for (size_t j = 0; j <= m.cols; ++j) {
+                // j == cols is the bias of unit i
+                double *p = j < m.cols ? &w[l][i * m.cols + j] : &b[l][i], saved = *p, up = 0, down = 0;
+                *p = saved + h;
+                for (size_t e = 0; e < set->count; ++e) up += ref_loss(net, w, b, set, e);
+                *p = saved - h;
+                for (size_t e = 0; e < set->count; ++e) down += ref_loss(net, w, b, set, e);
+                *p = saved;
+                double numeric = (up - down) / (2 * h);
+                double analytic = j < m.cols ? MAT_AT(net->ws.grad_weights[l], i, j) : net->ws.grad_biases[l][i];
+                assert(fabs(numeric - analytic) <= tol * fmax(1, fabs(numeric)));
+            }
+        }
+    }
+    for (size_t l = 0; l < L; ++l) free(w[l]), free(b[l]);
+    arrfree(batch);
+    dataset_destroy(set);
+    network_destroy(net);
+}
+
+void test_gradients() {
+    Activation hidden[] = { ACT_SIGMOID, ACT_TANH, ACT_RELU, ACT_LEAKY_RELU, ACT_SOFTMAX, ACT_IDENTITY };
+    for (size_t h = 0; h < sizeof(hidden) / sizeof(hidden[0]); ++h) {
+        check_gradients(hidden[h], ACT_SIGMOID, LOSS_QUADRATIC);
+        check_gradients(hidden[h], ACT_SOFTMAX, LOSS_QUADRATIC);
+        check_gradients(hidden[h], ACT_TANH, LOSS_QUADRATIC);
+        check_gradients(hidden[h], ACT_IDENTITY, LOSS_QUADRATIC);
+        check_gradients(hidden[h], ACT_SIGMOID, LOSS_CROSS_ENTROPY);
+        check_gradients(hidden[h], ACT_SOFTMAX, LOSS_CROSS_ENTROPY);
+    }
+    printf("gradient tests passed\n");
+}
+
+void test_softmax_cross_entropy_is_stable() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 6); arrpush(sizes, 4);
+    Network *net = network_create(sizes);
+    net->activations[0] = ACT_SOFTMAX;
+    net->loss = LOSS_CROSS_ENTROPY;
+    // logits in the thousands would overflow a plain exp
+    mat_scale(net->weights[0], 0);
+    for (size_t i = 0; i < 4; ++i) net->biases[0][i] = 1000.0 * i;
+    Dataset *set = pattern_set(3, 6, 4);
+    size_t *batch = NULL;
+    for (size_t e = 0; e < set->count; ++e) arrpush(batch, e);
+    network_backprop_batch(net, set, batch, net->ws.grad_weights, net->ws.grad_biases);
+    for (size_t i = 0; i < 4; ++i) {
+        assert(isfinite(net->ws.grad_biases[0][i]));
+        // all the mass is on the last unit: d = a - y
+        double want = (i == 3) * 3.0;
+        for (size_t e = 0; e < 3; ++e) want -= set->labels[e] == i;
+        assert(fabs(net->ws.grad_biases[0][i] - want) < 1e-6);
+    }
+    assert(network_test(net, set, 0) == (set->labels[0] == 3));
+    arrfree(batch);
+    dataset_destroy(set);
+    network_destroy(net);
+    printf("softmax cross-entropy stability test passed\n");
+}
+
+void test_training_with_relu_softmax() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 6); arrpush(sizes, 16); arrpush(sizes, 4);
+    Network *net = network_create(sizes);
+    network_init(net, 3, 1);
+    mat_scale(net->weights[0], 0.3);
+    mat_scale(net->weights[1], 0.3);
+    net->activations[0] = ACT_RELU;
+    net->activations[1] = ACT_SOFTMAX;
+    net->loss = LOSS_CROSS_ENTROPY;
+    Dataset *set = class_set(40, 6, 4, 1, 0);
+    TrainConfig cfg = { .epochs = 200, .batch_size = 4, .lrate = 0.1, .threads = 1, .seed = 1 };
+    network_SGD(net, &cfg, set, NULL);
+    size_t ok = 0;
+    for (size_t e = 0; e < set->count; ++e) ok += network_test(net, set, e);
+    assert(ok == set->count);
+    dataset_destroy(set);
+    network_destroy(net);
+    printf("relu + softmax training test passed\n");
+}
+
+int main() {
+    test_gradients();
+    test_softmax_cross_entropy_is_stable();
+    test_training_with_relu_softmax();
+    printf("ALL ACTIVATION TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,331 @@
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+#define PATH "/tmp/nn_checkpoint_test.bin"
+#define COPY "/tmp/nn_checkpoint_copy.bin"
+#define DIR "/tmp/nn_checkpoint_dir"
+
+// odd widths so the rows carry padding
+static Network *make_net() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 21); arrpush(sizes, 13); arrpush(sizes, 7); arrpush(sizes, 5);
+    Network *net = network_create(sizes);
+    net->activations[0] = ACT_RELU;
+    net->activations[1] = ACT_TANH;
+    net->activations[2] = ACT_SOFTMAX;
+    net->loss = LOSS_CROSS_ENTROPY;
+    network_init(net, 7, 1);
+    return net;
+}
+
+static bool inside(Network *net, const void *p) {
+    return (const uint8_t*)p >= (const uint8_t*)net->map && (const uint8_t*)p < (const uint8_t*)net->map + net->map_size;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    uint8_t *buf = malloc(*size);
+    assert(fread(buf, 1, *size, f) == *size);
+    fclose(f);
+    return buf;
+}
+
+static void write_file(const char *path, const uint8_t *buf, size_t size) {
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    assert(fwrite(buf, 1, size, f) == size);
+    fclose(f);
+}
+
+void test_roundtrip() {
+    Network *net = make_net();
+    network_save(net, PATH);
+    Network *loaded = network_load(PATH, true);
+    assert(loaded != NULL && loaded->map != NULL);
+    assert(arrlen(loaded->sizes) == arrlen(net->sizes));
+    assert(loaded->loss == net->loss);
+    for (size_t l = 0; l < arrlen(net->sizes); ++l) assert(loaded->sizes[l] == net->sizes[l]);
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        mat_t a = net->weights[l], b = loaded->weights[l];
+        assert(a.rows == b.rows && a.cols == b.cols && a.stride == b.stride);
+        assert(memcmp(a.data, b.data, a.rows * a.stride * sizeof(real_t)) == 0);
+        assert(arrlen(loaded->biases[l]) == a.rows);
+        assert(memcmp(net->biases[l], loaded->biases[l], a.rows * sizeof(real_t)) == 0);
+        assert(loaded->activations[l] == net->activations[l]);
+        // used in place: every blob is a view into the map, aligned for the kernels
+        assert(inside(loaded, b.data) && (uintptr_t)b.data % NN_ALIGN == 0);
+        assert(inside(loaded, loaded->biases[l]) && (uintptr_t)loaded->biases[l] % NN_ALIGN == 0);
+    }
+    assert(inside(loaded, loaded->sizes) && (uintptr_t)loaded->sizes % NN_ALIGN == 0);
+
+    Dataset *set = pattern_set(101, 21, 5);
+    EvalOptions opts = { .batch_size = 16, .loss = true };
+    Evaluation want = network_evaluate(net, set, &opts), got = network_evaluate(loaded, set, &opts);
+    assert(want.correct == got.correct && want.loss == got.loss);
+    evaluation_destroy(&want);
+    evaluation_destroy(&got);
+    dataset_destroy(set);
+    network_destroy(loaded);
+    arrfree(net->sizes);
+    network_destroy(net);
+    printf("roundtrip test passed\n");
+}
+
+// the map is private: training a loaded network leaves the file as it was
+void test_training_leaves_the_file() {
+    Network *net = make_net();
+    network_save(net, PATH);
+    size_t size;
+    uint8_t *before = read_file(PATH, &size);
+
+    Network *loaded = network_load(PATH, false);
+    assert(loaded != NULL);
+    loaded->optimizer = (Optimizer){ .kind = OPT_ADAM };
+    Dataset *set = pattern_set(40, 21, 5);
+    TrainConfig cfg = { .epochs = 2, .batch_size = 4, .lrate = 0.01, .threads = 1, .seed = 1 };
+    network_SGD(loaded, &cfg, set, NULL);
+    assert(memcmp(loaded->weights[0].data, net->weights[0].data, net->weights[0].rows * net->weights[0].stride * sizeof(real_t)) != 0);
+
+    size_t after_size;
+    uint8_t *after = read_file(PATH, &after_size);
+    assert(after_size == size && memcmp(before, after, size) == 0);
+    free(before);
+    free(after);
+    dataset_destroy(set);
+    network_destroy(loaded);
+    arrfree(net->sizes);
+    network_destroy(net);
+    printf("private map test passed\n");
+}
+
+void test_rejects_bad_files() {
+    Network *net = make_net();
+    network_save(net, PATH);
+    size_t size;
+    uint8_t *good = read_file(PATH, &size);
+
+    assert(network_load("/tmp/nn_checkpoint_missing.bin", true) == NULL);
+
+    write_file(PATH, good, size - 1);
+    assert(network_load(PATH, true) == NULL);
+    write_file(PATH, good, 10);
+    assert(network_load(PATH, true) == NULL);
+
+    uint8_t *bad = malloc(size);
+    memcpy(bad, good, size);
+    bad[0] ^= 1;
+    write_file(PATH, bad, size);
+    assert(network_load(PATH, true) == NULL);
+
+    // a flipped weight is only caught by the checksum
+    memcpy(bad, good, size);
+    bad[size - 1] ^= 0x40;
+    write_file(PATH, bad, size);
+    assert(network_load(PATH, true) == NULL);
+    Network *unverified = network_load(PATH, false);
+    assert(unverified != NULL);
+    network_destroy(unverified);
+
+    write_file(PATH, good, size);
+    Network *loaded = network_load(PATH, true);
+    assert(loaded != NULL);
+    network_destroy(loaded);
+
+    free(good);
+    free(bad);
+    remove(PATH);
+    arrfree(net->sizes);
+    network_destroy(net);
+    printf("bad file test passed\n");
+}
+
+// a checkpoint that cannot be written or renamed into place fails the save and leaves no
+// temporary file behind
+void test_save_reports_failures() {
+    Network *net = make_net();
+    assert(!network_save(net, "/tmp/nn_checkpoint_no_such_dir/checkpoint.bin"));
+    // rename cannot replace a directory
+    rmdir(DIR);
+    mkdir(DIR, 0755);
+    assert(!network_save(net, DIR));
+    struct stat st;
+    assert(stat(DIR, &st) == 0 && S_ISDIR(st.st_mode));
+    assert(access(DIR ".tmp", F_OK) != 0);
+    rmdir(DIR);
+    arrfree(net->sizes);
+    network_destroy(net);
+    printf("save failure test passed\n");
+}
+
+static Network *make_trainee(uint64_t seed, OptimizerKind kind) {
+    Network *net = make_net();
+    net->optimizer = (Optimizer){ .kind = kind, .weight_decay = 1e-3 };
+    network_init(net, seed, 1);
+    return net;
+}
+
+static bool same_weights(Network *a, Network *b) {
+    for (size_t l = 0; l < arrlen(a->weights); ++l) {
+        mat_t w = a->weights[l];
+        if (memcmp(w.data, b->weights[l].data, w.rows * w.stride * sizeof(real_t)) != 0) return false;
+        if (memcmp(a->biases[l], b->biases[l], w.rows * sizeof(real_t)) != 0) return false;
+    }
+    return true;
+}
+
+static bool exists(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f) fclose(f);
+    return f != NULL;
+}
+
+// noise from the augmentation stream, and once `at` samples went by a copy of whatever
+// checkpoint is on disk, standing in for a run stopped at that point
+typedef struct {
+    _Atomic size_t seen;
+    size_t at;
+} Preempt;
+
+static void augment(real_t *x, size_t features, Rng *rng, void *ctx) {
+    Preempt *p = (Preempt*)ctx;
+    for (size_t i = 0; i < features; ++i) x[i] += (real_t)(rng_uniform(rng) - 0.5) / 10;
+    if (p == NULL || atomic_fetch_add(&p->seen, 1) + 1 != p->at) return;
+    while (!exists(PATH)) usleep(1000);
+    size_t size;
+    uint8_t *buf = read_file(PATH, &size);
+    write_file(COPY, buf, size);
+    free(buf);
+}
+
+// a run stopped at any checkpoint and resumed ends with the weights of the run never stopped
+void test_resume_replays_the_run(size_t threads, size_t prefetch) {
+    Dataset *set = pattern_set(40, 21, 5);
+    TrainConfig cfg = { .epochs = 4, .batch_size = 4, .lrate = 0.01, .threads = threads, .prefetch = prefetch, .augment = augment, .seed = 9 };
+    Network *want = make_trainee(3, OPT_ADAMW);
+    network_SGD(want, &cfg, set, NULL);
+
+    // stopped between epochs
+    remove(PATH);
+    Network *first = make_trainee(3, OPT_ADAMW);
+    TrainConfig half = cfg;
+    half.epochs = 2, half.checkpoint = PATH;
+    network_SGD(first, &half, set, NULL);
+    assert(exists(PATH) && !exists(PATH ".tmp"));
+    // another init and optimizer, both replaced by the checkpoint
+    Network *resumed = make_trainee(4, OPT_SGD);
+    TrainConfig rest = cfg;
+    rest.checkpoint = PATH, rest.resume = true;
+    network_SGD(resumed, &rest, set, NULL);
+    assert(same_weights(resumed, want) && resumed->opt.steps == want->opt.steps);
+    assert(resumed->optimizer.kind == OPT_ADAMW);
+
+    // stopped part way through the second epoch, at whatever checkpoint was on disk
+    remove(PATH), remove(COPY);
+    Network *stopped = make_trainee(3, OPT_ADAMW);
+    Preempt p = { .at = 55 };
+    TrainConfig every = cfg;
+    every.checkpoint = PATH, every.checkpoint_every = 3, every.augment_ctx = &p;
+    network_SGD(stopped, &every, set, NULL);
+    assert(same_weights(stopped, want));
+    Network *mid = make_trainee(4, OPT_ADAMW);
+    rest.checkpoint = COPY;
+    network_SGD(mid, &rest, set, NULL);
+    assert(same_weights(mid, want));
+
+    // inference maps a training checkpoint like any other
+    Network *loaded = network_load(PATH, true);
+    assert(loaded != NULL && same_weights(loaded, want));
+    network_destroy(loaded);
+
+    remove(PATH), remove(COPY);
+    network_destroy(want), network_destroy(first), network_destroy(resumed);
+    network_destroy(stopped), network_destroy(mid);
+    dataset_destroy(set);
+    printf("resume test (%zu threads, prefetch %zu) passed\n", threads, prefetch);
+}
+
+// resuming without a checkpoint starts afresh, a hogwild run picks up between epochs
+void test_resume_hogwild() {
+    Dataset *set = pattern_set(40, 21, 5);
+    remove(PATH);
+    Network *net = make_trainee(3, OPT_MOMENTUM);
+    TrainConfig cfg = { .epochs = 2, .batch_size = 4, .lrate = 0.01, .threads = 3, .hogwild = true, .checkpoint = PATH, .resume = true, .seed = 9 };
+    network_SGD(net, &cfg, set, NULL);
+    assert(net->opt.steps == 20 && exists(PATH));
+    Network *resumed = make_trainee(4, OPT_MOMENTUM);
+    cfg.epochs = 3;
+    network_SGD(resumed, &cfg, set, NULL);
+    assert(resumed->opt.steps == 30);
+    remove(PATH);
+    network_destroy(net);
+    network_destroy(resumed);
+    dataset_destroy(set);
+    printf("hogwild resume test passed\n");
+}
+
+// a checkpoint that cannot be resumed from fails the run before it touches the network
+void test_resume_rejects_bad_checkpoints() {
+    Dataset *set = pattern_set(40, 21, 5);
+    TrainConfig cfg = { .epochs = 1, .batch_size = 4, .lrate = 0.01, .threads = 1, .seed = 9, .checkpoint = PATH };
+    Network *net = make_trainee(3, OPT_ADAMW), *fresh = make_trainee(4, OPT_ADAMW), *untouched = make_trainee(4, OPT_ADAMW);
+    TrainConfig rest = cfg;
+    rest.resume = true;
+
+    // no training state
+    network_save(net, PATH);
+    assert(!network_SGD(fresh, &rest, set, NULL) && same_weights(fresh, untouched) && fresh->opt.steps == 0);
+
+    remove(PATH);
+    // trained outside the assert, the checkpoint it leaves is what the rest resumes from
+    bool trained = network_SGD(net, &cfg, set, NULL);
+    assert(trained);
+    // another batch size
+    rest.batch_size = 5;
+    assert(!network_SGD(fresh, &rest, set, NULL));
+    rest.batch_size = cfg.batch_size;
+    // another network
+    size_t *sizes = NULL;
+    arrpush(sizes, 21); arrpush(sizes, 9); arrpush(sizes, 5);
+    Network *other = network_create(sizes);
+    assert(!network_SGD(other, &rest, set, NULL));
+    // truncated
+    size_t size;
+    uint8_t *buf = read_file(PATH, &size);
+    write_file(PATH, buf, size - 8);
+    assert(!network_SGD(fresh, &rest, set, NULL));
+    assert(same_weights(fresh, untouched) && fresh->opt.steps == 0);
+
+    free(buf);
+    remove(PATH);
+    arrfree(sizes);
+    network_destroy(net), network_destroy(fresh), network_destroy(untouched), network_destroy(other);
+    dataset_destroy(set);
+    printf("bad resume test passed\n");
+}
+
+int main() {
+    test_roundtrip();
+    test_training_leaves_the_file();
+    test_rejects_bad_files();
+    test_save_reports_failures();
+    test_resume_replays_the_run(1, 0);
+    test_resume_replays_the_run(2, 0);
+    test_resume_replays_the_run(1, 2);
+    test_resume_hogwild();
+    test_resume_rejects_bad_checkpoints();
+    printf("ALL CHECKPOINT TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <math.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+static Network *make_net(Activation hidden, Activation output, Loss loss) {
+    size_t *sizes = NULL;
+    arrpush(sizes, 20); arrpush(sizes, 12); arrpush(sizes, 5);
+    Network *net = network_create(sizes);
+    net->activations[0] = hidden;
+    net->activations[1] = output;
+    net->loss = loss;
+    network_init(net, 5, 1);
+    return net;
+}
+
+// the loss of sample e from the activations network_test leaves behind
+static double sample_loss(Network *net, Dataset *set, size_t e) {
+    network_test(net, set, e);
+    vec_t a = net->ws.a[arrlen(net->ws.a) - 1];
+    double loss = 0;
+    for (size_t k = 0; k < arrlen(a); ++k) {
+        double y = k == set->labels[e];
+        if (net->loss == LOSS_QUADRATIC) loss += (a[k] - y) * (a[k] - y) / 2;
+        else if (net->activations[1] == ACT_SOFTMAX) loss -= y * log(a[k]);
+        else loss -= y ? log(a[k]) : log(1 - a[k]);
+    }
+    return loss;
+}
+
+void test_matches_per_sample(Activation hidden, Activation output, Loss loss) {
+    Network *net = make_net(hidden, output, loss);
+    Dataset *set = pattern_set(203, 20, 5);
+    Evaluation ev = network_evaluate(net, set, &(EvalOptions){ .batch_size = 16, .loss = true });
+    size_t ok = 0;
+    double want = 0;
+    for (size_t e = 0; e < set->count; ++e) {
+        ok += network_test(net, set, e);
+        want += sample_loss(net, set, e);
+    }
+    want /= set->count;
+    assert(ev.count == set->count && ev.correct == ok);
+    assert(fabs(ev.accuracy - (double)ok / set->count) < 1e-12);
+    assert(fabs(ev.loss - want) <= 1e-4 * fmax(1, want));
+    // rows are the true labels, the diagonal is what was classified right
+    assert(ev.classes == 5);
+    size_t diag = 0;
+    for (size_t y = 0; y < ev.classes; ++y) {
+        size_t row = 0;
+        for (size_t p = 0; p < ev.classes; ++p) row += ev.confusion[y * ev.classes + p];
+        size_t count = 0;
+        for (size_t e = 0; e < set->count; ++e) count += set->labels[e] == y;
+        assert(row == count);
+        diag += ev.confusion[y * ev.classes + y];
+    }
+    assert(diag == ev.correct);
+    evaluation_destroy(&ev);
+    dataset_destroy(set);
+    network_destroy(net);
+}
+
+void test_threads_do_not_change_the_result() {
+    Network *net = make_net(ACT_RELU, ACT_SOFTMAX, LOSS_CROSS_ENTROPY);
+    Dataset *set = pattern_set(1001, 20, 5);
+    Evaluation serial = network_evaluate(net, set, &(EvalOptions){ .batch_size = 32, .loss = true });
+    size_t threads[] = { 2, 3, 8, 64 };
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        Evaluation ev = network_evaluate(net, set, &(EvalOptions){ .batch_size = 32, .threads = threads[t], .loss = true });
+        assert(ev.correct == serial.correct && ev.loss == serial.loss);
+        assert(memcmp(ev.confusion, serial.confusion, ev.classes * ev.classes * sizeof(size_t)) == 0);
+        evaluation_destroy(&ev);
+    }
+    // defaults: one thread, no loss
+    Evaluation ev = network_evaluate(net, set, NULL);
+    assert(ev.correct == serial.correct && ev.loss == 0);
+    evaluation_destroy(&ev);
+    evaluation_destroy(&serial);
+    dataset_destroy(set);
+    network_destroy(net);
+    printf("thread independence test passed\n");
+}
+
+int main() {
+    test_matches_per_sample(ACT_SIGMOID, ACT_SIGMOID, LOSS_QUADRATIC);
+    test_matches_per_sample(ACT_TANH, ACT_SOFTMAX, LOSS_CROSS_ENTROPY);
+    test_matches_per_sample(ACT_RELU, ACT_SIGMOID, LOSS_CROSS_ENTROPY);
+    test_matches_per_sample(ACT_SOFTMAX, ACT_SOFTMAX, LOSS_QUADRATIC);
+    printf("per-sample agreement test passed\n");
+    test_threads_do_not_change_the_result();
+    printf("ALL EVALUATE TESTS PASSED\n");
+    return 0;
+}
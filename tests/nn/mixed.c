@@ -0,0 +1,178 @@
+#include <math.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+#define PATH "/tmp/nn_mixed_test.bin"
+
+static Network *make_net() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 70); arrpush(sizes, 37); arrpush(sizes, 10);
+    Network *net = network_create(sizes);
+    net->activations[0] = ACT_RELU;
+    net->activations[1] = ACT_SOFTMAX;
+    net->loss = LOSS_CROSS_ENTROPY;
+    net->optimizer = (Optimizer){ .kind = OPT_ADAM };
+    network_init(net, 5, 1);
+    return net;
+}
+
+static const char *name(TrainPrecision p) {
+    return p == TRAIN_FULL ? "full" : p == TRAIN_BF16 ? "bf16" : "fp16";
+}
+
+// close to the accuracy of full precision, with the 16-bit weights the rounded master weights
+void test_trains(TrainPrecision precision) {
+    Dataset *train = class_set(400, 70, 10, 3, 0), *test = class_set(300, 70, 10, 3, 1000);
+    Network *full = make_net(), *net = make_net();
+    TrainConfig cfg = { .epochs = 10, .batch_size = 8, .lrate = 0.002, .threads = 1, .seed = 1 };
+    network_SGD(full, &cfg, train, NULL);
+    cfg.precision = precision;
+    network_SGD(net, &cfg, train, NULL);
+    Evaluation want = network_evaluate(full, test, NULL), got = network_evaluate(net, test, NULL);
+    assert(want.accuracy > 0.95 && got.accuracy >= want.accuracy - 0.02);
+
+    HalfFormat format = precision == TRAIN_FP16 ? HALF_FP16 : HALF_BF16;
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        mat_t w = net->weights[l];
+        hmat_t h = net->mixed.weights[l];
+        assert(h.format == format && h.rows == w.rows && h.cols == w.cols);
+        for (size_t i = 0; i < w.rows; ++i) {
+            half_t row[70];
+            nn_kernels.to_half[format](row, mat_row(w, i), w.cols);
+            assert(memcmp(row, mat_row(h, i), w.cols * sizeof(half_t)) == 0);
+        }
+    }
+    // every batch either stepped or was dropped for overflowing
+    uint64_t batches = cfg.epochs * (train->count / cfg.batch_size);
+    assert(net->opt.steps + net->mixed.skipped == batches);
+    if (precision == TRAIN_BF16) assert(net->mixed.skipped == 0 && net->mixed.loss_scale == 1);
+    if (precision == TRAIN_FP16) assert(net->mixed.skipped < batches / 20 && net->mixed.loss_scale >= 1);
+    printf("%s (%s): full %zu/%zu, mixed %zu/%zu, %zu steps skipped, loss scale %g\n", name(precision), nn_kernels.hisa,
+        want.correct, want.count, got.correct, got.count, (size_t)net->mixed.skipped, (double)net->mixed.loss_scale);
+    evaluation_destroy(&want);
+    evaluation_destroy(&got);
+    network_destroy(full);
+    network_destroy(net);
+    dataset_destroy(train);
+    dataset_destroy(test);
+}
+
+// the gradients come out unscaled and within rounding of the full precision ones
+void test_backprop_unscaled(TrainPrecision precision) {
+    Dataset *set = class_set(40, 70, 10, 3, 0);
+    Network *net = make_net(), *mixed = make_net();
+    TrainConfig cfg = { .epochs = 1, .batch_size = 40, .lrate = 0, .threads = 1, .seed = 1, .precision = precision };
+    network_SGD(mixed, &cfg, set, NULL);
+    size_t *batch = NULL;
+    for (size_t e = 0; e < 40; ++e) arrpush(batch, e);
+    mat_t *gw = mixed->ws.grad_weights;
+    vec_t *gb = mixed->ws.grad_biases;
+    network_backprop_batch(net, set, batch, net->ws.grad_weights, net->ws.grad_biases);
+    network_backprop_batch(mixed, set, batch, gw, gb);
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        double err = 0, norm = 0;
+        for (size_t i = 0; i < gw[l].rows; ++i) {
+            for (size_t j = 0; j < gw[l].cols; ++j) {
+                double d = MAT_AT(gw[l], i, j) - MAT_AT(net->ws.grad_weights[l], i, j);
+                err += d * d, norm += MAT_AT(net->ws.grad_weights[l], i, j) * MAT_AT(net->ws.grad_weights[l], i, j);
+            }
+            double d = gb[l][i] - net->ws.grad_biases[l][i];
+            err += d * d, norm += net->ws.grad_biases[l][i] * net->ws.grad_biases[l][i];
+        }
+        assert(sqrt(err / norm) < (precision == TRAIN_FP16 ? 5e-3 : 2e-2));
+    }
+    arrfree(batch);
+    network_destroy(net);
+    network_destroy(mixed);
+    dataset_destroy(set);
+    printf("%s backprop test passed\n", name(precision));
+}
+
+// a scale the deltas overflow at drops those steps and comes down, a window of good steps
+// doubles it
+void test_loss_scale() {
+    Dataset *set = class_set(400, 70, 10, 3, 0);
+    Network *net = make_net();
+    TrainConfig cfg = { .epochs = 1, .batch_size = 8, .lrate = 0.002, .threads = 1, .seed = 1, .precision = TRAIN_FP16 };
+    network_SGD(net, &cfg, set, NULL);
+    atomic_store(&net->mixed.loss_scale, 0x1p24);
+    uint64_t steps = net->opt.steps, skipped = net->mixed.skipped;
+    network_SGD(net, &cfg, set, NULL);
+    // 0x1p24 times a delta of a tenth is far past 65504, at least 8 halvings to get under it
+    assert(net->mixed.skipped - skipped >= 8 && net->mixed.loss_scale <= 0x1p16);
+    assert(net->opt.steps - steps + net->mixed.skipped - skipped == 50);
+
+    atomic_store(&net->mixed.loss_scale, 1);
+    atomic_store(&net->mixed.good_steps, 0);
+    cfg.epochs = 21;
+    skipped = net->mixed.skipped;
+    network_SGD(net, &cfg, set, NULL);
+    assert(net->mixed.skipped == skipped && net->mixed.loss_scale == 2);
+    network_destroy(net);
+    dataset_destroy(set);
+    printf("loss scale test passed\n");
+}
+
+static bool same_weights(Network *a, Network *b) {
+    for (size_t l = 0; l < arrlen(a->weights); ++l) {
+        mat_t w = a->weights[l];
+        if (memcmp(w.data, b->weights[l].data, w.rows * w.stride * sizeof(real_t)) != 0) return false;
+        if (memcmp(a->biases[l], b->biases[l], w.rows * sizeof(real_t)) != 0) return false;
+    }
+    return true;
+}
+
+// the loss scale is part of the checkpoint, a resumed fp16 run replays the one never stopped.
+// the resumed network skips the warmup, the checkpoint brings its weights, moments and scale
+void test_resume(TrainPrecision precision) {
+    Dataset *set = class_set(400, 70, 10, 3, 0);
+    TrainConfig cfg = { .epochs = 4, .batch_size = 8, .lrate = 0.002, .threads = 2, .seed = 3, .precision = precision };
+    // a scale a fresh run would not start from, kept by the runs that follow
+    TrainConfig warmup = cfg;
+    warmup.epochs = 1;
+    Network *want = make_net();
+    network_SGD(want, &warmup, set, NULL);
+    if (precision == TRAIN_FP16) atomic_store(&want->mixed.loss_scale, 1024);
+    network_SGD(want, &cfg, set, NULL);
+    remove(PATH);
+    Network *first = make_net(), *resumed = make_net();
+    network_SGD(first, &warmup, set, NULL);
+    if (precision == TRAIN_FP16) atomic_store(&first->mixed.loss_scale, 1024);
+    TrainConfig half = cfg;
+    half.epochs = 2, half.checkpoint = PATH;
+    network_SGD(first, &half, set, NULL);
+    TrainConfig rest = cfg;
+    rest.checkpoint = PATH, rest.resume = true;
+    network_SGD(resumed, &rest, set, NULL);
+    assert(same_weights(resumed, want));
+    assert(resumed->mixed.skipped == want->mixed.skipped && resumed->mixed.loss_scale == want->mixed.loss_scale);
+    remove(PATH);
+    network_destroy(want), network_destroy(first), network_destroy(resumed);
+    dataset_destroy(set);
+    printf("%s resume test passed\n", name(precision));
+}
+
+int main() {
+    const char *detected = nn_kernels.isa;
+    // the bf16 dot products when the cpu has them, the widened panels otherwise
+    const char *isas[] = { "avx512", "avx2", "generic" };
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (!nn_kernels_use(isas[i])) continue;
+        test_trains(TRAIN_BF16);
+        test_trains(TRAIN_FP16);
+    }
+    assert(nn_kernels_use(detected));
+    test_loss_scale();
+    test_backprop_unscaled(TRAIN_BF16);
+    test_backprop_unscaled(TRAIN_FP16);
+    test_resume(TRAIN_BF16);
+    test_resume(TRAIN_FP16);
+    printf("ALL MIXED PRECISION TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <math.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+static Network *make_net(Optimizer opt) {
+    size_t *sizes = NULL;
+    arrpush(sizes, 6); arrpush(sizes, 16); arrpush(sizes, 4);
+    Network *net = network_create(sizes);
+    net->activations[0] = ACT_RELU;
+    net->activations[1] = ACT_SOFTMAX;
+    net->loss = LOSS_CROSS_ENTROPY;
+    net->optimizer = opt;
+    network_init(net, 3, 1);
+    return net;
+}
+
+static size_t correct(Network *net, Dataset *set) {
+    size_t ok = 0;
+    for (size_t e = 0; e < set->count; ++e) ok += network_test(net, set, e);
+    return ok;
+}
+
+static double weight_norm(Network *net) {
+    double sum = 0;
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        mat_t w = net->weights[l];
+        for (size_t i = 0; i < w.rows; ++i) {
+            for (size_t j = 0; j < w.cols; ++j) sum += MAT_AT(w, i, j) * MAT_AT(w, i, j);
+        }
+    }
+    return sqrt(sum);
+}
+
+void test_every_optimizer_trains(bool hogwild) {
+    struct { Optimizer opt; double lrate; } runs[] = {
+        { { .kind = OPT_SGD }, 0.02 },
+        { { .kind = OPT_MOMENTUM }, 0.005 },
+        { { .kind = OPT_NESTEROV }, 0.005 },
+        { { .kind = OPT_RMSPROP }, 0.002 },
+        { { .kind = OPT_ADAM }, 0.005 },
+        { { .kind = OPT_ADAMW, .weight_decay = 0.01 }, 0.005 },
+        { { .kind = OPT_MOMENTUM, .beta1 = 0.5, .weight_decay = 1e-3 }, 0.01 },
+    };
+    Dataset *set = class_set(40, 6, 4, 1, 0);
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); ++r) {
+        Network *net = make_net(runs[r].opt);
+        TrainConfig cfg = { .epochs = 100, .batch_size = 4, .lrate = runs[r].lrate, .threads = hogwild ? 3 : 1, .hogwild = hogwild, .seed = 1 };
+        network_SGD(net, &cfg, set, NULL);
+        assert(correct(net, set) == set->count);
+        assert(net->opt.steps == cfg.epochs * set->count / cfg.batch_size);
+        network_destroy(net);
+    }
+    dataset_destroy(set);
+    printf("every optimizer trains%s test passed\n", hogwild ? " (hogwild)" : "");
+}
+
+// l2 and decoupled decay both pull the weights towards zero
+void test_weight_decay_shrinks_weights() {
+    Dataset *set = class_set(40, 6, 4, 1, 0);
+    OptimizerKind kinds[] = { OPT_SGD, OPT_ADAM, OPT_ADAMW };
+    for (size_t k = 0; k < 3; ++k) {
+        double norm[2];
+        for (size_t d = 0; d < 2; ++d) {
+            Network *net = make_net((Optimizer){ .kind = kinds[k], .weight_decay = d ? 0.5 : 0 });
+            TrainConfig cfg = { .epochs = 30, .batch_size = 4, .lrate = 0.005, .threads = 1, .seed = 1 };
+            network_SGD(net, &cfg, set, NULL);
+            norm[d] = weight_norm(net);
+            network_destroy(net);
+        }
+        assert(norm[1] < norm[0] * 0.9);
+    }
+    dataset_destroy(set);
+    printf("weight decay test passed\n");
+}
+
+// the moments are allocated up front and cleared when the weights are redrawn
+void test_state_lifecycle() {
+    Network *net = make_net((Optimizer){ .kind = OPT_ADAM });
+    Dataset *set = class_set(8, 6, 4, 1, 0);
+    size_t *batch = NULL;
+    for (size_t e = 0; e < set->count; ++e) arrpush(batch, e);
+    network_reserve(net, arrlen(batch));
+    network_update_batch(net, set, batch, 0.01);
+    size_t before = nn_alloc_count;
+    for (size_t s = 0; s < 10; ++s) network_update_batch(net, set, batch, 0.01);
+    assert(nn_alloc_count == before);
+    assert(net->opt.steps == 11);
+    assert(net->opt.mb[1][0] != 0 && net->opt.vb[1][0] != 0);
+
+    network_init(net, 3, 1);
+    assert(net->opt.steps == 0);
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        for (size_t i = 0; i < net->opt.m[l].rows; ++i) {
+            for (size_t j = 0; j < net->opt.m[l].cols; ++j) assert(MAT_AT(net->opt.m[l], i, j) == 0 && MAT_AT(net->opt.v[l], i, j) == 0);
+            assert(net->opt.mb[l][i] == 0 && net->opt.vb[l][i] == 0);
+        }
+    }
+    arrfree(batch);
+    dataset_destroy(set);
+    network_destroy(net);
+    printf("optimizer state test passed\n");
+}
+
+int main() {
+    test_every_optimizer_trains(false);
+    test_every_optimizer_trains(true);
+    test_weight_decay_shrinks_weights();
+    test_state_lifecycle();
+    printf("ALL OPTIMIZER TESTS PASSED\n");
+    return 0;
+}
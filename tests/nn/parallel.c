@@ -0,0 +1,206 @@
+#include <math.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+static void copy_params(Network *dst, Network *src) {
+    for (size_t l = 0; l < arrlen(src->weights); ++l) {
+        mat_operate(dst->weights[l], 1, (MatOp){ LOAD, src->weights[l] });
+        vec_operate(dst->biases[l], 1, (VecOp){ LOAD, src->biases[l] });
+    }
+}
+
+static double max_diff(Network *a, Network *b) {
+    double diff = 0;
+    for (size_t l = 0; l < arrlen(a->weights); ++l) {
+        for (size_t i = 0; i < a->weights[l].rows; ++i) {
+            diff = fmax(diff, fabs(a->biases[l][i] - b->biases[l][i]));
+            for (size_t j = 0; j < a->weights[l].cols; ++j)
+                diff = fmax(diff, fabs(MAT_AT(a->weights[l], i, j) - MAT_AT(b->weights[l], i, j)));
+        }
+    }
+    return diff;
+}
+
+static Network *train_cfg(Network *init, Dataset *set, TrainConfig cfg) {
+    Network *net = network_create(init->sizes);
+    copy_params(net, init);
+    cfg.seed = 7;
+    network_SGD(net, &cfg, set, NULL);
+    return net;
+}
+
+static Network *train(Network *init, Dataset *set, size_t batch_size, size_t threads, bool hogwild) {
+    TrainConfig cfg = { .epochs = 1, .batch_size = batch_size, .lrate = 0.5, .threads = threads, .hogwild = hogwild };
+    return train_cfg(init, set, cfg);
+}
+
+void test_threads_match_serial(size_t batch_size, size_t threads) {
+    size_t *sizes = NULL;
+    arrpush(sizes, 12); arrpush(sizes, 9); arrpush(sizes, 3);
+    Network *init = network_create(sizes);
+    Dataset *set = pattern_set(40, 12, 3);
+
+    Network *serial = train(init, set, batch_size, 1, false);
+    Network *parallel = train(init, set, batch_size, threads, false);
+    Network *again = train(init, set, batch_size, threads, false);
+
+    // only the summation order differs from the serial run
+    assert(max_diff(serial, parallel) < (sizeof(real_t) == sizeof(float) ? 1e-5 : 1e-9));
+    // and it is the same order every time
+    assert(max_diff(parallel, again) == 0);
+    assert(max_diff(serial, init) > 0);
+
+    network_destroy(serial);
+    network_destroy(parallel);
+    network_destroy(again);
+    network_destroy(init);
+    dataset_destroy(set);
+    printf("batch %zu on %zu threads matches serial\n", batch_size, threads);
+}
+
+void test_hogwild() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 12); arrpush(sizes, 9); arrpush(sizes, 3);
+    Network *init = network_create(sizes);
+    Dataset *set = pattern_set(60, 12, 3);
+
+    // a single hogwild worker is plain sequential SGD
+    Network *serial = train(init, set, 6, 1, false);
+    Network *single = train(init, set, 6, 1, true);
+    assert(max_diff(serial, single) == 0);
+
+    // racing workers still apply every batch
+    Network *racing = train(init, set, 6, 4, true);
+    assert(max_diff(racing, init) > 0);
+    for (size_t l = 0; l < arrlen(racing->weights); ++l)
+        for (size_t i = 0; i < racing->weights[l].rows; ++i)
+            assert(isfinite(racing->biases[l][i]));
+
+    network_destroy(serial);
+    network_destroy(single);
+    network_destroy(racing);
+    network_destroy(init);
+    dataset_destroy(set);
+    printf("hogwild tests passed\n");
+}
+
+static _Atomic size_t augmented;
+
+static void flip(real_t *x, size_t features, Rng *rng, void *ctx) {
+    (void)rng, (void)ctx;
+    for (size_t i = 0; i < features / 2; ++i) {
+        real_t t = x[i];
+        x[i] = x[features - 1 - i], x[features - 1 - i] = t;
+    }
+    augmented++;
+}
+
+void test_prefetch() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 12); arrpush(sizes, 9); arrpush(sizes, 3);
+    Network *init = network_create(sizes);
+    Dataset *set = pattern_set(40, 12, 3);
+    TrainConfig cfg = { .epochs = 2, .batch_size = 8, .lrate = 0.5, .threads = 1 };
+
+    // the loader thread hands over exactly the batches the trainer would have gathered
+    Network *inline_ = train_cfg(init, set, cfg);
+    cfg.prefetch = 1;
+    Network *ahead = train_cfg(init, set, cfg);
+    cfg.prefetch = 3, cfg.threads = 3;
+    Network *wide = train_cfg(init, set, cfg);
+    cfg.prefetch = 0;
+    Network *wide_inline = train_cfg(init, set, cfg);
+    assert(max_diff(inline_, ahead) == 0);
+    assert(max_diff(wide, wide_inline) == 0);
+
+    cfg.threads = 1, cfg.hogwild = true, cfg.prefetch = 2;
+    Network *hogwild = train_cfg(init, set, cfg);
+    assert(max_diff(inline_, hogwild) == 0);
+
+    // augmentation runs once per gathered sample, on the loader or on the workers,
+    // and every epoch gathers each sample exactly once
+    cfg.hogwild = false, cfg.augment = flip;
+    augmented = 0;
+    Network *flipped = train_cfg(init, set, cfg);
+    size_t loader_calls = augmented;
+    cfg.prefetch = 0;
+    augmented = 0;
+    Network *flipped_inline = train_cfg(init, set, cfg);
+    assert(loader_calls == cfg.epochs * set->count && augmented == loader_calls);
+    assert(max_diff(flipped, flipped_inline) == 0 && max_diff(flipped, inline_) > 0);
+
+    network_destroy(inline_);
+    network_destroy(ahead);
+    network_destroy(wide);
+    network_destroy(wide_inline);
+    network_destroy(hogwild);
+    network_destroy(flipped);
+    network_destroy(flipped_inline);
+    network_destroy(init);
+    dataset_destroy(set);
+    printf("prefetch tests passed\n");
+}
+
+void test_partial_batch() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 12); arrpush(sizes, 9); arrpush(sizes, 3);
+    Network *init = network_create(sizes);
+    // 43 samples in batches of 8 leave a tail batch of 3
+    Dataset *set = pattern_set(43, 12, 3);
+    TrainConfig cfg = { .epochs = 1, .batch_size = 8, .lrate = 0.5, .threads = 1, .augment = flip };
+    augmented = 0;
+    Network *serial = train_cfg(init, set, cfg);
+    assert(augmented == set->count);
+    cfg.threads = 4, cfg.prefetch = 2;
+    Network *parallel = train_cfg(init, set, cfg);
+    assert(max_diff(serial, parallel) < (sizeof(real_t) == sizeof(float) ? 1e-5 : 1e-9));
+
+    network_destroy(serial);
+    network_destroy(parallel);
+    network_destroy(init);
+    dataset_destroy(set);
+    printf("partial batch test passed\n");
+}
+
+void test_seeded_init() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 40); arrpush(sizes, 150); arrpush(sizes, 3);
+    Network *a = network_create(sizes), *b = network_create(sizes);
+    // the blocks of rows draw from their own streams, so the thread count does not matter
+    network_init(a, 42, 1);
+    network_init(b, 42, 4);
+    assert(max_diff(a, b) == 0);
+    network_init(b, 43, 4);
+    assert(max_diff(a, b) > 0);
+
+    // and the same seed replays the same training run
+    Dataset *set = pattern_set(40, 40, 3);
+    TrainConfig cfg = { .epochs = 2, .batch_size = 8, .lrate = 0.5, .threads = 1, .seed = 5 };
+    network_init(b, 42, 1);
+    network_SGD(a, &cfg, set, NULL);
+    network_SGD(b, &cfg, set, NULL);
+    assert(max_diff(a, b) == 0);
+
+    network_destroy(a);
+    network_destroy(b);
+    dataset_destroy(set);
+    printf("seeded init test passed\n");
+}
+
+int main() {
+    test_threads_match_serial(8, 4);
+    test_threads_match_serial(10, 3);
+    // more threads than samples, some workers get empty slices
+    test_threads_match_serial(3, 5);
+    test_hogwild();
+    test_prefetch();
+    test_partial_batch();
+    test_seeded_init();
+    printf("ALL PARALLEL TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <math.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+// forward pass in double precision whatever real_t is
+static size_t predict_fp64(Network *net, Dataset *set, size_t e) {
+    double in[28 * 28], out[28 * 28];
+    size_t len = net->sizes[0];
+    for (size_t i = 0; i < len; ++i) in[i] = dataset_sample(set, e)[i] / 255.0;
+    for (size_t l = 0; l < arrlen(net->weights); ++l) {
+        mat_t w = net->weights[l];
+        for (size_t i = 0; i < w.rows; ++i) {
+            double z = net->biases[l][i];
+            for (size_t j = 0; j < w.cols; ++j) z += (double)MAT_AT(w, i, j) * in[j];
+            out[i] = 1 / (1 + exp(-z));
+        }
+        len = w.rows;
+        memcpy(in, out, len * sizeof(double));
+    }
+    size_t max = 0;
+    for (size_t i = 1; i < len; ++i) if (in[i] > in[max]) max = i;
+    return max;
+}
+
+void test_accuracy_matches_fp64() {
+    Dataset *train, *test;
+    srand(3);
+    if (access(TRAIN_SET_IMAGE, R_OK) == 0 && access(TEST_SET_IMAGE, R_OK) == 0) {
+        train = load_training_set();
+        test = load_test_set();
+        assert(train != NULL && test != NULL);
+    } else {
+        train = digit_set(2000);
+        test = digit_set(500);
+    }
+    size_t *sizes = NULL;
+    arrpush(sizes, 28 * 28); arrpush(sizes, 30); arrpush(sizes, Y_SIZE);
+    Network *net = network_create(sizes);
+    network_init(net, 3, 1);
+    // one pass over the data per epoch
+    TrainConfig cfg = { .epochs = 20, .batch_size = 10, .lrate = 3, .threads = 1 };
+    network_SGD(net, &cfg, train, NULL);
+
+    size_t ok = 0, ok64 = 0, agree = 0, n = test->count;
+    for (size_t t = 0; t < n; ++t) {
+        int right = network_test(net, test, t);
+        int right64 = predict_fp64(net, test, t) == test->labels[t];
+        ok += right, ok64 += right64, agree += right == right64;
+    }
+    printf("%s accuracy %zu/%zu, fp64 reference %zu/%zu, agreement %zu/%zu\n",
+        sizeof(real_t) == sizeof(float) ? "fp32" : "fp64", ok, n, ok64, n, agree, n);
+    assert(ok * 10 >= n * 8);
+    assert(agree * 1000 >= n * 995);
+    assert(ok + n / 200 >= ok64 && ok64 + n / 200 >= ok);
+
+    network_destroy(net);
+    dataset_destroy(train);
+    dataset_destroy(test);
+    printf("precision test passed\n");
+}
+
+int main() {
+    test_accuracy_matches_fp64();
+    printf("ALL PRECISION TESTS PASSED\n");
+    return 0;
+}
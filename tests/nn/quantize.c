@@ -0,0 +1,134 @@
+#include <math.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+static Network *make_net(Activation hidden, Dataset *set) {
+    size_t *sizes = NULL;
+    arrpush(sizes, 70); arrpush(sizes, 37); arrpush(sizes, 10);
+    Network *net = network_create(sizes);
+    net->activations[0] = hidden;
+    net->activations[1] = ACT_SOFTMAX;
+    net->loss = LOSS_CROSS_ENTROPY;
+    network_init(net, 5, 1);
+    TrainConfig cfg = { .epochs = 20, .batch_size = 8, .lrate = 0.02, .threads = 1, .seed = 1 };
+    network_SGD(net, &cfg, set, NULL);
+    return net;
+}
+
+// the float class of sample e, from the activations network_test leaves behind
+static size_t float_class(Network *net, Dataset *set, size_t e) {
+    network_test(net, set, e);
+    vec_t a = net->ws.a[arrlen(net->ws.a) - 1];
+    size_t max = 0;
+    for (size_t k = 1; k < arrlen(a); ++k) if (a[k] > a[max]) max = k;
+    return max;
+}
+
+void test_layers(Network *net, QuantNetwork *q) {
+    for (size_t l = 0; l < arrlen(q->layers); ++l) {
+        QuantLayer *ql = &q->layers[l];
+        mat_t w = net->weights[l];
+        assert(ql->rows == w.rows && ql->cols == w.cols && ql->stride % NN_ALIGN == 0);
+        assert(ql->in_zero >= 0 && ql->in_zero <= 255 && ql->in_scale > 0);
+        for (size_t c = 0; c < ql->rows; ++c) {
+            const int8_t *row = ql->weights + c * ql->stride;
+            int max = 0;
+            for (size_t i = 0; i < ql->stride; ++i) {
+                assert(abs(row[i]) <= QUANT_WEIGHT_MAX);
+                if (i >= ql->cols) assert(row[i] == 0);
+                if (abs(row[i]) > max) max = abs(row[i]);
+            }
+            // the largest weight of every channel takes the whole range, each one is within
+            // half a step of its float value
+            assert(max == QUANT_WEIGHT_MAX);
+            real_t s = ql->scale[c] / ql->in_scale;
+            for (size_t i = 0; i < ql->cols; ++i) assert(fabs(row[i] * s - MAT_AT(w, c, i)) <= s * 0.5001);
+        }
+    }
+    // pixels and relu outputs have no negative part, tanh's do
+    assert(q->layers[0].in_zero == 0);
+    if (net->activations[0] == ACT_RELU) assert(q->layers[1].in_zero == 0);
+    if (net->activations[0] == ACT_TANH) assert(q->layers[1].in_zero > 0);
+}
+
+void test_matches_float(Activation hidden) {
+    Dataset *train = class_set(400, 70, 10, 3, 0), *test = class_set(300, 70, 10, 3, 1000);
+    Network *net = make_net(hidden, train);
+    QuantNetwork *q = network_quantize(net, train, 100);
+    test_layers(net, q);
+
+    Evaluation fp = network_evaluate(net, test, NULL);
+    Evaluation ev = quant_network_evaluate(q, test, &(EvalOptions){ .batch_size = 64 });
+    assert(fp.accuracy > 0.95);
+    assert(fabs(ev.accuracy - fp.accuracy) <= 0.01);
+
+    // classify agrees with evaluate and almost always with the float network
+    mat_t X = mat_new(test->count, test->features);
+    for (size_t e = 0; e < test->count; ++e) dataset_load_x(test, e, mat_row(X, e));
+    size_t *classes = malloc(test->count * sizeof(size_t)), agree = 0, correct = 0;
+    quant_network_classify(q, X, classes);
+    for (size_t e = 0; e < test->count; ++e) {
+        agree += classes[e] == float_class(net, test, e);
+        correct += classes[e] == test->labels[e];
+    }
+    assert(correct == ev.correct);
+    assert(agree >= test->count * 98 / 100);
+
+    // close to 4 times smaller than float and 8 than double on wide layers, at these widths
+    // the per-channel scales and offsets and the row padding still weigh in
+    size_t floats = 0;
+    for (size_t l = 0; l < arrlen(net->weights); ++l) floats += net->weights[l].rows * (net->weights[l].stride + 1) * sizeof(real_t);
+    size_t padded = 0;
+    for (size_t l = 0; l < arrlen(q->layers); ++l) padded += q->layers[l].rows * q->layers[l].stride;
+    assert(quant_network_size(q) > padded && quant_network_size(q) * 2 < floats);
+
+    printf("%s hidden: float %zu/%zu, int8 %zu/%zu, agreement %zu/%zu (%s)\n", hidden == ACT_RELU ? "relu" : "tanh",
+        fp.correct, fp.count, ev.correct, ev.count, agree, test->count, nn_kernels.qisa);
+    free(classes);
+    mat_destroy(X);
+    evaluation_destroy(&fp);
+    evaluation_destroy(&ev);
+    quant_network_destroy(q);
+    network_destroy(net);
+    dataset_destroy(train);
+    dataset_destroy(test);
+}
+
+// every qgemm path and thread count gives the same counts
+void test_paths_agree() {
+    Dataset *train = class_set(400, 70, 10, 3, 0), *test = class_set(501, 70, 10, 3, 1000);
+    Network *net = make_net(ACT_RELU, train);
+    QuantNetwork *q = network_quantize(net, train, 0);
+    Evaluation want = quant_network_evaluate(q, test, NULL);
+    const char *detected = nn_kernels.isa;
+    const char *isas[] = { "generic", "avx2", "avx512", "neon" };
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (!nn_kernels_use(isas[i])) continue;
+        for (size_t threads = 1; threads <= 3; ++threads) {
+            Evaluation ev = quant_network_evaluate(q, test, &(EvalOptions){ .batch_size = 50, .threads = threads });
+            assert(ev.correct == want.correct);
+            assert(memcmp(ev.confusion, want.confusion, ev.classes * ev.classes * sizeof(size_t)) == 0);
+            evaluation_destroy(&ev);
+        }
+    }
+    assert(nn_kernels_use(detected));
+    evaluation_destroy(&want);
+    quant_network_destroy(q);
+    network_destroy(net);
+    dataset_destroy(train);
+    dataset_destroy(test);
+    printf("path agreement test passed\n");
+}
+
+int main() {
+    test_matches_float(ACT_RELU);
+    test_matches_float(ACT_TANH);
+    test_paths_agree();
+    printf("ALL QUANTIZE TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define NN_SERVE_IMPLEMENTATION
+#include "nn_serve.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+#define PATH "/tmp/nn_serve_test.sock"
+#define FEATURES 70
+#define CLASSES 10
+#define CLIENTS 8
+#define REQUESTS 50
+
+static Network *make_net() {
+    size_t *sizes = NULL;
+    arrpush(sizes, FEATURES); arrpush(sizes, 37); arrpush(sizes, CLASSES);
+    Network *net = network_create(sizes);
+    net->activations[0] = ACT_RELU;
+    net->activations[1] = ACT_SOFTMAX;
+    network_init(net, 5, 1);
+    return net;
+}
+
+static float input(size_t e, size_t i) {
+    return (float)((e * 7 + i * 13) % 23) / 23;
+}
+
+typedef struct {
+    size_t id;
+    const mat_t *want; // output activations of every request, in request order
+    size_t wrong;
+} Client;
+
+static void *client(void *arg) {
+    Client *c = (Client*)arg;
+    int fd = serve_connect(PATH);
+    assert(fd != -1);
+    float x[FEATURES], y[CLASSES];
+    for (size_t r = 0; r < REQUESTS; ++r) {
+        size_t e = c->id * REQUESTS + r;
+        for (size_t i = 0; i < FEATURES; ++i) x[i] = input(e, i);
+        uint32_t class = serve_classify(fd, x, FEATURES, y, CLASSES);
+        real_t *want = mat_row(*c->want, e);
+        size_t best = 0;
+        for (size_t k = 0; k < CLASSES; ++k) {
+            if (want[k] > want[best]) best = k;
+            // a row's products do not depend on the rows batched with it
+            c->wrong += y[k] != (float)want[k];
+        }
+        c->wrong += class != best;
+    }
+    close(fd);
+    return NULL;
+}
+
+// concurrent clients get the outputs of one forward pass over all their requests, and
+// share forward passes
+void test_batches() {
+    Network *net = make_net();
+    mat_t X = mat_new(CLIENTS * REQUESTS, FEATURES), want = mat_new(CLIENTS * REQUESTS, CLASSES);
+    for (size_t e = 0; e < X.rows; ++e)
+        for (size_t i = 0; i < FEATURES; ++i)
+            MAT_AT(X, e, i) = input(e, i);
+    network_predict(net, X, want);
+
+    Server *s = server_start(net, &(ServeConfig){ .path = PATH, .max_batch = 4, .max_wait = 0.01 });
+    assert(s != NULL);
+    Client clients[CLIENTS];
+    pthread_t threads[CLIENTS];
+    for (size_t t = 0; t < CLIENTS; ++t) {
+        clients[t] = (Client){ t, &want, 0 };
+        assert(pthread_create(&threads[t], NULL, client, &clients[t]) == 0);
+    }
+    for (size_t t = 0; t < CLIENTS; ++t) {
+        pthread_join(threads[t], NULL);
+        assert(clients[t].wrong == 0);
+    }
+    ServeStats st = server_stop(s);
+    assert(st.requests == CLIENTS * REQUESTS);
+    // never past max_batch, and well short of a pass per request
+    assert(st.batches * 4 >= st.requests && st.batches < st.requests / 2);
+    assert(st.p50 > 0 && st.p50 <= st.p99 && st.throughput > 0);
+    assert(access(PATH, F_OK) != 0);
+    printf("%llu requests in %llu batches, p50 %.3fms, p99 %.3fms\n", (unsigned long long)st.requests,
+        (unsigned long long)st.batches, st.p50 * 1e3, st.p99 * 1e3);
+    mat_destroy(X);
+    mat_destroy(want);
+    network_destroy(net);
+    printf("batches test passed\n");
+}
+
+// a lone request waits out max_wait for company, and is answered alone
+void test_max_wait() {
+    Network *net = make_net();
+    Server *s = server_start(net, &(ServeConfig){ .path = PATH, .max_wait = 0.02 });
+    int fd = serve_connect(PATH);
+    float x[FEATURES] = { 0 };
+    for (size_t r = 0; r < 3; ++r) assert(serve_classify(fd, x, FEATURES, NULL, 0) < CLASSES);
+    close(fd);
+    ServeStats st = server_stop(s);
+    assert(st.requests == 3 && st.batches == 3 && st.p50 >= 0.02);
+    network_destroy(net);
+    printf("max wait test passed\n");
+}
+
+// the wrong number of features is rejected and closes the connection, the others carry on
+void test_bad_request() {
+    Network *net = make_net();
+    Server *s = server_start(net, &(ServeConfig){ .path = PATH });
+    int good = serve_connect(PATH), bad = serve_connect(PATH);
+    float x[FEATURES + 1] = { 0 };
+    uint32_t n = FEATURES + 1, reply[2];
+    assert(write(bad, &n, sizeof(n)) == sizeof(n) && write(bad, x, sizeof(x)) == sizeof(x));
+    assert(read(bad, reply, sizeof(reply)) == sizeof(reply));
+    assert(reply[0] == SERVE_BAD_REQUEST && reply[1] == 0);
+    // closed with the rest of the request unread: an end of file or a reset
+    assert(read(bad, reply, 1) <= 0);
+    assert(serve_classify(good, x, FEATURES, NULL, 0) < CLASSES);
+    close(bad);
+    close(good);
+    assert(server_stop(s).requests == 1);
+    network_destroy(net);
+    printf("bad request test passed\n");
+}
+
+// stopping with idle clients connected returns, and they see the connection end
+void test_stop() {
+    Network *net = make_net();
+    Server *s = server_start(net, &(ServeConfig){ .path = PATH });
+    int fd[3];
+    for (size_t i = 0; i < 3; ++i) fd[i] = serve_connect(PATH);
+    float x[FEATURES] = { 0 };
+    assert(serve_classify(fd[0], x, FEATURES, NULL, 0) < CLASSES);
+    server_stop(s);
+    for (size_t i = 0; i < 3; ++i) {
+        assert(serve_classify(fd[i], x, FEATURES, NULL, 0) == SERVE_BAD_REQUEST);
+        close(fd[i]);
+    }
+    assert(serve_connect(PATH) == -1);
+    network_destroy(net);
+    printf("stop test passed\n");
+}
+
+int main() {
+    test_batches();
+    test_max_wait();
+    test_bad_request();
+    test_stop();
+    printf("ALL SERVE TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,45 @@
+#define NN_MATH_IMPLEMENTATION
+#include "nn.h"
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+#include "../fixtures.h"
+
+void test_steady_state_does_not_allocate() {
+    size_t *sizes = NULL;
+    arrpush(sizes, 16); arrpush(sizes, 8); arrpush(sizes, 4);
+    Network *net = network_create(sizes);
+    Dataset *set = pattern_set(10, 16, 4);
+    size_t *batch = NULL;
+    for (size_t e = 0; e < set->count; ++e) arrpush(batch, e);
+
+    // warm up: sizes the workspace and the gemm packing buffers
+    network_reserve(net, arrlen(batch));
+    network_update_batch(net, set, batch, 0.5);
+    network_test(net, set, 0);
+
+    size_t before = nn_alloc_count;
+    for (size_t s = 0; s < 100; ++s) {
+        network_update_batch(net, set, batch, 0.5);
+        network_backprop(net, set, s % 10, net->ws.grad_weights, net->ws.grad_biases);
+        for (size_t t = 0; t < set->count; ++t) network_test(net, set, t);
+    }
+    assert(nn_alloc_count == before);
+
+    // smaller batches reuse the same buffers
+    arrsetlen(batch, 3);
+    network_update_batch(net, set, batch, 0.5);
+    assert(nn_alloc_count == before);
+
+    arrfree(batch);
+    dataset_destroy(set);
+    network_destroy(net);
+    printf("steady state allocation test passed\n");
+}
+
+int main() {
+    test_steady_state_does_not_allocate();
+    printf("ALL WORKSPACE TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,236 @@
+#define NN_MATH_IMPLEMENTATION
+#define LOAD_MNIST_IMPLEMENTAION
+#include "nn_data_loader.h"
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+// idx header: two zero bytes, type, rank, then big-endian u32 dimensions
+static size_t write_typed_header(uint8_t *buf, uint8_t type, uint8_t rank, const uint32_t *dims) {
+    size_t off = 0;
+    buf[off++] = 0; buf[off++] = 0; buf[off++] = type; buf[off++] = rank;
+    for (uint8_t d = 0; d < rank; ++d) {
+        buf[off++] = dims[d] >> 24; buf[off++] = dims[d] >> 16;
+        buf[off++] = dims[d] >> 8; buf[off++] = dims[d];
+    }
+    return off;
+}
+
+static size_t write_header(uint8_t *buf, uint8_t rank, const uint32_t *dims) {
+    return write_typed_header(buf, IDX_U8, rank, dims);
+}
+
+static void write_be(uint8_t *dst, uint64_t v, size_t size) {
+    for (size_t b = 0; b < size; ++b) dst[b] = v >> (8 * (size - 1 - b));
+}
+
+#define SIDE 28
+#define FEATURES (SIDE * SIDE)
+
+void test_parse_digits_is_zero_copy() {
+    static uint8_t buf[16 + 3 * FEATURES];
+    uint32_t dims[] = { 3, SIDE, SIDE };
+    size_t off = write_header(buf, 3, dims);
+    for (size_t i = 0; i < 3 * FEATURES; ++i) buf[off + i] = i % 251;
+
+    Dataset set = { .classes = 10 };
+    parser_t p = { buf, sizeof(buf), 0 };
+    parse_samples(&p, &set);
+    assert(set.count == 3 && set.features == FEATURES);
+    // the samples are a view of the parsed buffer
+    assert(set.pixels == buf + off);
+    for (size_t e = 0; e < 3; ++e)
+        for (size_t i = 0; i < FEATURES; ++i)
+            assert(dataset_sample(&set, e)[i] == (e * FEATURES + i) % 251);
+
+    real_t x[FEATURES];
+    dataset_load_x(&set, 2, x);
+    assert(fabs(x[0] - (2 * FEATURES % 251) / 255.0) < 1e-6);
+    printf("digits test passed\n");
+}
+
+void test_parse_labels_keeps_class_index() {
+    uint8_t buf[8 + 10];
+    uint32_t dims[] = { 10 };
+    size_t off = write_header(buf, 1, dims);
+    for (size_t i = 0; i < 10; ++i) buf[off + i] = 9 - i;
+
+    Dataset set = { .count = 10, .classes = 10 };
+    parser_t p = { buf, sizeof(buf), 0 };
+    assert(parse_labels(&p, &set));
+    assert(set.labels == buf + off && set.classes == 10);
+    // digit 0 is a class like any other
+    for (size_t e = 0; e < 10; ++e) assert(set.labels[e] == 9 - e);
+    printf("labels test passed\n");
+}
+
+void test_parse_any_rank_and_type() {
+    // 5 samples of 2x3x2, neither 28x28 nor rank 3
+    uint8_t buf[4 + 4 * 4 + 5 * 12 * 8];
+    uint32_t dims[] = { 5, 2, 3, 2 };
+    size_t off = write_typed_header(buf, IDX_F64, 4, dims);
+    for (size_t i = 0; i < 5 * 12; ++i) {
+        double v = i * 0.25 - 3;
+        uint64_t bits;
+        memcpy(&bits, &v, 8);
+        write_be(buf + off + 8 * i, bits, 8);
+    }
+    Dataset set = { 0 };
+    parser_t p = { buf, sizeof(buf), 0 };
+    parse_samples(&p, &set);
+    assert(set.count == 5 && set.features == 12 && set.type == IDX_F64);
+    real_t x[12];
+    dataset_load_x(&set, 3, x);
+    for (size_t i = 0; i < 12; ++i) assert(x[i] == (real_t)((3 * 12 + i) * 0.25 - 3));
+
+    size_t f32_off = write_typed_header(buf, IDX_F32, 2, (uint32_t[]){ 2, 3 });
+    for (size_t i = 0; i < 6; ++i) {
+        float v = -1.5f * i;
+        uint32_t bits;
+        memcpy(&bits, &v, 4);
+        write_be(buf + f32_off + 4 * i, bits, 4);
+    }
+    p.off = 0;
+    parse_samples(&p, &set);
+    dataset_load_x(&set, 1, x);
+    assert(set.features == 3 && x[0] == -4.5 && x[2] == -7.5);
+
+    size_t i16_off = write_typed_header(buf, IDX_I16, 2, (uint32_t[]){ 2, 2 });
+    int16_t words[] = { 100, -32767, 32767, -5 };
+    for (size_t i = 0; i < 4; ++i) write_be(buf + i16_off + 2 * i, (uint16_t)words[i], 2);
+    p.off = 0;
+    parse_samples(&p, &set);
+    dataset_load_x(&set, 0, x);
+    assert(fabs(x[0] - 100.0 / 32767) < 1e-6 && x[1] == -1);
+    dataset_load_x(&set, 1, x);
+    assert(x[0] == 1 && fabs(x[1] + 5.0 / 32767) < 1e-6);
+
+    size_t i8_off = write_typed_header(buf, IDX_I8, 1, (uint32_t[]){ 3 });
+    buf[i8_off] = (uint8_t)-127, buf[i8_off + 1] = 0, buf[i8_off + 2] = 127;
+    p.off = 0;
+    parse_samples(&p, &set);
+    assert(set.features == 1);
+    dataset_load_x(&set, 0, x);
+    assert(x[0] == -1);
+    dataset_load_x(&set, 2, x);
+    assert(x[0] == 1);
+    printf("generic sample test passed\n");
+}
+
+void test_parse_wide_labels() {
+    uint8_t buf[8 + 6 * 4];
+    uint32_t dims[] = { 6 };
+    size_t off = write_typed_header(buf, IDX_I32, 1, dims);
+    for (size_t i = 0; i < 6; ++i) write_be(buf + off + 4 * i, i * 9, 4);
+
+    Dataset set = { .count = 6 };
+    parser_t p = { buf, sizeof(buf), 0 };
+    // wider labels are narrowed into a buffer the dataset owns
+    assert(!parse_labels(&p, &set));
+    for (size_t e = 0; e < 6; ++e) assert(set.labels[e] == e * 9);
+    assert(set.classes == 46);
+    free(set.labels);
+    printf("wide labels test passed\n");
+}
+
+static void write_file(const char *path, const uint8_t *buf, size_t size) {
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL && fwrite(buf, 1, size, f) == size);
+    fclose(f);
+}
+
+void test_load_set_maps_files() {
+    static uint8_t images[16 + 4 * FEATURES];
+    uint32_t image_dims[] = { 4, SIDE, SIDE };
+    size_t image_off = write_header(images, 3, image_dims);
+    for (size_t i = 0; i < 4 * FEATURES; ++i) images[image_off + i] = i * 7;
+    uint8_t labels[8 + 4];
+    uint32_t label_dims[] = { 4 };
+    size_t label_off = write_header(labels, 1, label_dims);
+    for (size_t i = 0; i < 4; ++i) labels[label_off + i] = i + 3;
+
+    char image_path[] = "/tmp/nn_images_XXXXXX", label_path[] = "/tmp/nn_labels_XXXXXX";
+    close(mkstemp(image_path));
+    close(mkstemp(label_path));
+    write_file(image_path, images, sizeof(images));
+    write_file(label_path, labels, sizeof(labels));
+
+    Dataset *set = load_set(image_path, label_path);
+    assert(set->maps[0] != NULL && set->maps[1] != NULL);
+    assert(memcmp(set->pixels, images + image_off, 4 * FEATURES) == 0);
+    for (size_t e = 0; e < 4; ++e) assert(set->labels[e] == e + 3);
+    dataset_advise(set, DATASET_RANDOM);
+    assert(dataset_sample(set, 3)[5] == (uint8_t)((3 * FEATURES + 5) * 7));
+    dataset_destroy(set);
+
+    // a missing or empty file is reported instead of mapped
+    assert(load_set("/tmp/nn_no_such_images", label_path) == NULL);
+    write_file(label_path, labels, 0);
+    assert(load_set(image_path, label_path) == NULL);
+    unlink(image_path);
+    unlink(label_path);
+    printf("mmap load test passed\n");
+}
+
+static void write_gz(const char *path, const uint8_t *buf, size_t size) {
+    gzFile f = gzopen(path, "wb");
+    assert(f != NULL && gzwrite(f, buf, size) == (int)size);
+    gzclose(f);
+}
+
+void test_load_set_streams_gzip() {
+    // more than one GZ_CHUNK of pixels so the inflate loop runs several times
+    enum { COUNT = 1500 };
+    static uint8_t images[16 + COUNT * FEATURES];
+    uint32_t image_dims[] = { COUNT, SIDE, SIDE };
+    size_t image_off = write_header(images, 3, image_dims);
+    for (size_t i = 0; i < COUNT * FEATURES; ++i) images[image_off + i] = (i * 13) ^ (i >> 9);
+    static uint8_t labels[8 + COUNT];
+    uint32_t label_dims[] = { COUNT };
+    size_t label_off = write_header(labels, 1, label_dims);
+    for (size_t i = 0; i < COUNT; ++i) labels[label_off + i] = i % 10;
+
+    char dir[] = "/tmp/nn_gz_XXXXXX";
+    assert(mkdtemp(dir) != NULL);
+    char image_path[64], label_path[64];
+    snprintf(image_path, sizeof(image_path), "%s/images.gz", dir);
+    snprintf(label_path, sizeof(label_path), "%s/labels.gz", dir);
+    write_gz(image_path, images, sizeof(images));
+    write_gz(label_path, labels, sizeof(labels));
+
+    Dataset *set = load_set(image_path, label_path);
+    assert(set->maps[0] == NULL && set->maps[1] == NULL);
+    assert(memcmp(set->pixels, images + image_off, COUNT * FEATURES) == 0);
+    assert(memcmp(set->labels, labels + label_off, COUNT) == 0);
+    dataset_destroy(set);
+
+    // the uncompressed names fall back to the .gz files next to them
+    snprintf(image_path, sizeof(image_path), "%s/images", dir);
+    snprintf(label_path, sizeof(label_path), "%s/labels", dir);
+    set = load_set(image_path, label_path);
+    assert(memcmp(set->pixels, images + image_off, COUNT * FEATURES) == 0);
+    dataset_destroy(set);
+
+    strcat(image_path, ".gz"), strcat(label_path, ".gz");
+    // a stream shorter than its header says, and a cut off file, are reported
+    write_gz(image_path, images, sizeof(images) / 2);
+    assert(load_set(image_path, label_path) == NULL);
+    write_gz(image_path, images, sizeof(images));
+    struct stat st;
+    assert(stat(image_path, &st) == 0 && truncate(image_path, st.st_size / 2) == 0);
+    assert(load_set(image_path, label_path) == NULL);
+    unlink(image_path);
+    unlink(label_path);
+    rmdir(dir);
+    printf("gzip load test passed\n");
+}
+
+int main() {
+    test_parse_digits_is_zero_copy();
+    test_parse_labels_keeps_class_index();
+    test_parse_any_rank_and_type();
+    test_parse_wide_labels();
+    test_load_set_maps_files();
+    test_load_set_streams_gzip();
+    printf("ALL LOADER TESTS PASSED\n");
+    return 0;
+}
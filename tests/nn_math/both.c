@@ -16,8 +16,8 @@ void test_vecT_vec_dot() {
     // Expected M = u * v^T =
     // [1*3, 1*4, 1*5]
     // [2*3, 2*4, 2*5]
-    assert(M[0][0] == 3 && M[0][1] == 4 && M[0][2] == 5);
-    assert(M[1][0] == 6 && M[1][1] == 8 && M[1][2] == 10);
+    assert(MAT_AT(M, 0, 0) == 3 && MAT_AT(M, 0, 1) == 4 && MAT_AT(M, 0, 2) == 5);
+    assert(MAT_AT(M, 1, 0) == 6 && MAT_AT(M, 1, 1) == 8 && MAT_AT(M, 1, 2) == 10);
 
     vec_destroy(u);
     vec_destroy(v);
@@ -30,8 +30,8 @@ void test_mat_vec_dot() {
     vec_t out = vec_new(2);
 
     // M = [[1,2,3],[4,5,6]]
-    M[0][0] = 1; M[0][1] = 2; M[0][2] = 3;
-    M[1][0] = 4; M[1][1] = 5; M[1][2] = 6;
+    MAT_AT(M, 0, 0) = 1; MAT_AT(M, 0, 1) = 2; MAT_AT(M, 0, 2) = 3;
+    MAT_AT(M, 1, 0) = 4; MAT_AT(M, 1, 1) = 5; MAT_AT(M, 1, 2) = 6;
     // v = [7,8,9]
     v[0] = 7; v[1] = 8; v[2] = 9; 
 
@@ -52,8 +52,8 @@ void test_matT_vec_dot() {
     vec_t out = vec_new(3);
 
     // M = [[1,2,3],[4,5,6]]
-    M[0][0] = 1; M[0][1] = 2; M[0][2] = 3;
-    M[1][0] = 4; M[1][1] = 5; M[1][2] = 6;
+    MAT_AT(M, 0, 0) = 1; MAT_AT(M, 0, 1) = 2; MAT_AT(M, 0, 2) = 3;
+    MAT_AT(M, 1, 0) = 4; MAT_AT(M, 1, 1) = 5; MAT_AT(M, 1, 2) = 6;
     // v = [7,8]
     v[0] = 7; v[1] = 8;
 
@@ -70,10 +70,81 @@ void test_matT_vec_dot() {
     vec_destroy(out);
 }
 
+void test_mat_mat_dot() {
+    mat_t A = mat_new(2, 3);
+    mat_t B = mat_new(3, 2);
+    mat_t out = mat_new(2, 2);
+
+    // A = [[1,2,3],[4,5,6]], B = [[7,8],[9,10],[11,12]]
+    MAT_AT(A, 0, 0) = 1; MAT_AT(A, 0, 1) = 2; MAT_AT(A, 0, 2) = 3;
+    MAT_AT(A, 1, 0) = 4; MAT_AT(A, 1, 1) = 5; MAT_AT(A, 1, 2) = 6;
+    MAT_AT(B, 0, 0) = 7; MAT_AT(B, 0, 1) = 8;
+    MAT_AT(B, 1, 0) = 9; MAT_AT(B, 1, 1) = 10;
+    MAT_AT(B, 2, 0) = 11; MAT_AT(B, 2, 1) = 12;
+
+    mat_mat_dot(out, A, B);
+
+    // Expected out = A*B = [[58,64],[139,154]]
+    assert(MAT_AT(out, 0, 0) == 58 && MAT_AT(out, 0, 1) == 64);
+    assert(MAT_AT(out, 1, 0) == 139 && MAT_AT(out, 1, 1) == 154);
+
+    mat_destroy(A);
+    mat_destroy(B);
+    mat_destroy(out);
+}
+
+void test_mat_matT_dot() {
+    mat_t A = mat_new(2, 3);
+    mat_t B = mat_new(2, 3);
+    mat_t out = mat_new(2, 2);
+
+    // A = [[1,2,3],[4,5,6]], B = [[1,0,1],[0,1,0]]
+    MAT_AT(A, 0, 0) = 1; MAT_AT(A, 0, 1) = 2; MAT_AT(A, 0, 2) = 3;
+    MAT_AT(A, 1, 0) = 4; MAT_AT(A, 1, 1) = 5; MAT_AT(A, 1, 2) = 6;
+    MAT_AT(B, 0, 0) = 1; MAT_AT(B, 0, 2) = 1;
+    MAT_AT(B, 1, 1) = 1;
+
+    mat_matT_dot(out, A, B);
+
+    // Expected out = A*B^T = [[4,2],[10,5]]
+    assert(MAT_AT(out, 0, 0) == 4 && MAT_AT(out, 0, 1) == 2);
+    assert(MAT_AT(out, 1, 0) == 10 && MAT_AT(out, 1, 1) == 5);
+
+    mat_destroy(A);
+    mat_destroy(B);
+    mat_destroy(out);
+}
+
+void test_matT_mat_dot() {
+    mat_t A = mat_new(2, 3);
+    mat_t B = mat_new(2, 2);
+    mat_t out = mat_new(3, 2);
+
+    // A = [[1,2,3],[4,5,6]], B = [[7,8],[9,10]]
+    MAT_AT(A, 0, 0) = 1; MAT_AT(A, 0, 1) = 2; MAT_AT(A, 0, 2) = 3;
+    MAT_AT(A, 1, 0) = 4; MAT_AT(A, 1, 1) = 5; MAT_AT(A, 1, 2) = 6;
+    MAT_AT(B, 0, 0) = 7; MAT_AT(B, 0, 1) = 8;
+    MAT_AT(B, 1, 0) = 9; MAT_AT(B, 1, 1) = 10;
+
+    matT_mat_dot(out, A, B);
+
+    // Expected out = A^T*B = [[43,48],[59,66],[75,84]]
+    assert(MAT_AT(out, 0, 0) == 43 && MAT_AT(out, 0, 1) == 48);
+    assert(MAT_AT(out, 1, 0) == 59 && MAT_AT(out, 1, 1) == 66);
+    assert(MAT_AT(out, 2, 0) == 75 && MAT_AT(out, 2, 1) == 84);
+
+    mat_destroy(A);
+    mat_destroy(B);
+    mat_destroy(out);
+}
+
 int main() {
     test_vecT_vec_dot();
     test_mat_vec_dot();
     test_matT_vec_dot();
+    test_mat_mat_dot();
+    test_mat_matT_dot();
+    test_matT_mat_dot();
     printf("All tests passed!\n");
     return 0;
 }
@@ -0,0 +1,94 @@
+#include <math.h>
+#define STB_DS_IMPLEMENTATION
+#define NN_MATH_IMPLEMENTATION
+#include "nn_math.h"
+
+static mat_t rand_mat(size_t rows, size_t cols) {
+    mat_t m = mat_new(rows, cols);
+    for (size_t i = 0; i < rows; ++i)
+        for (size_t j = 0; j < cols; ++j)
+            MAT_AT(m, i, j) = (real_t)(rand() % 17) - 8;
+    return m;
+}
+
+// naive reference: dst = alpha * op(a, b) + beta * dst
+static void ref_gemm(mat_t dst, GemmOp op, mat_t a, mat_t b, double alpha, double beta) {
+    size_t K = op == GEMM_TN ? a.rows : a.cols;
+    for (size_t i = 0; i < dst.rows; ++i) {
+        for (size_t j = 0; j < dst.cols; ++j) {
+            double val = 0;
+            for (size_t k = 0; k < K; ++k) {
+                double x = op == GEMM_TN ? MAT_AT(a, k, i) : MAT_AT(a, i, k);
+                double y = op == GEMM_NT ? MAT_AT(b, j, k) : MAT_AT(b, k, j);
+                val += x * y;
+            }
+            MAT_AT(dst, i, j) = alpha * val + beta * MAT_AT(dst, i, j);
+        }
+    }
+}
+
+static void check_gemm(GemmOp op, size_t M, size_t N, size_t K, double alpha, double beta) {
+    mat_t a = op == GEMM_TN ? rand_mat(K, M) : rand_mat(M, K);
+    mat_t b = op == GEMM_NT ? rand_mat(N, K) : rand_mat(K, N);
+    mat_t got = rand_mat(M, N);
+    mat_t want = mat_new(M, N);
+    mat_operate(want, 1, (MatOp){ LOAD, got });
+
+    mat_gemm(got, op, a, b, alpha, beta);
+    ref_gemm(want, op, a, b, alpha, beta);
+
+    // small integer inputs, every partial sum is exact
+    for (size_t i = 0; i < M; ++i)
+        for (size_t j = 0; j < N; ++j)
+            assert(MAT_AT(got, i, j) == MAT_AT(want, i, j));
+
+    mat_destroy(a);
+    mat_destroy(b);
+    mat_destroy(got);
+    mat_destroy(want);
+}
+
+void test_gemm_shapes() {
+    // tile edges, multiple k blocks and multiple row blocks
+    size_t dims[][3] = {
+        { 1, 1, 1 }, { 3, 5, 7 }, { 4, 8, 16 }, { 13, 17, 300 },
+        { 130, 9, 33 }, { 10, 784, 30 }, { 30, 10, 600 }, { 257, 65, 513 },
+    };
+    for (size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); ++d) {
+        for (GemmOp op = GEMM_NN; op <= GEMM_TN; ++op) {
+            check_gemm(op, dims[d][0], dims[d][1], dims[d][2], 1, 0);
+        }
+    }
+    printf("shape tests passed\n");
+}
+
+void test_gemm_alpha_beta() {
+    for (GemmOp op = GEMM_NN; op <= GEMM_TN; ++op) {
+        check_gemm(op, 19, 23, 290, 2, 1);
+        check_gemm(op, 19, 23, 29, -0.5, 3);
+    }
+    printf("alpha/beta tests passed\n");
+}
+
+void test_gemm_ignores_dst_when_beta_zero() {
+    mat_t a = rand_mat(3, 4), b = rand_mat(4, 5), out = mat_new(3, 5);
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 5; ++j)
+            MAT_AT(out, i, j) = NAN;
+    mat_gemm(out, GEMM_NN, a, b, 1, 0);
+    for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 5; ++j)
+            assert(!isnan(MAT_AT(out, i, j)));
+    mat_destroy(a);
+    mat_destroy(b);
+    mat_destroy(out);
+    printf("beta zero test passed\n");
+}
+
+int main() {
+    test_gemm_shapes();
+    test_gemm_alpha_beta();
+    test_gemm_ignores_dst_when_beta_zero();
+    printf("ALL GEMM TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <math.h>
+#include <stdbool.h>
+#define STB_DS_IMPLEMENTATION
+#define NN_MATH_IMPLEMENTATION
+#include "nn_math.h"
+
+static const char *isas[] = { "generic", "sse2", "avx2", "avx512", "neon" };
+
+static half_t to_half(real_t x, HalfFormat format) {
+    half_t h;
+    nn_kernels.to_half[format](&h, &x, 1);
+    return h;
+}
+
+static real_t from_half(half_t h, HalfFormat format) {
+    real_t x;
+    nn_kernels.from_half[format](&x, &h, 1);
+    return x;
+}
+
+static float from_bits(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+void test_rounding() {
+    // ties go to the even neighbour, everything else to the nearest one
+    assert(to_half(1, HALF_BF16) == 0x3F80);
+    assert(to_half(from_bits(0x3F808000), HALF_BF16) == 0x3F80);
+    assert(to_half(from_bits(0x3F818000), HALF_BF16) == 0x3F82);
+    assert(to_half(from_bits(0x3F808001), HALF_BF16) == 0x3F81);
+    assert(to_half(-2, HALF_BF16) == 0xC000);
+    assert(to_half(INFINITY, HALF_BF16) == 0x7F80);
+    assert(to_half(from_bits(0x7F7FFFFF), HALF_BF16) == 0x7F80);
+    assert(isnan(from_half(to_half(NAN, HALF_BF16), HALF_BF16)));
+    // float subnormals flush to a signed zero, as vcvtneps2bf16 does
+    assert(to_half(from_bits(0x00400000), HALF_BF16) == 0);
+    assert(to_half(from_bits(0x80400000), HALF_BF16) == 0x8000);
+
+    assert(to_half(1, HALF_FP16) == 0x3C00);
+    assert(to_half(-2, HALF_FP16) == 0xC000);
+    assert(to_half(65504, HALF_FP16) == 0x7BFF);
+    assert(to_half(65520, HALF_FP16) == 0x7C00);
+    assert(to_half(1 + 0x1p-11, HALF_FP16) == 0x3C00);
+    assert(to_half(1 + 3 * 0x1p-11, HALF_FP16) == 0x3C02);
+    // fp16 keeps its subnormals
+    assert(to_half(0x1p-24, HALF_FP16) == 0x0001);
+    assert(to_half(1e-7, HALF_FP16) == 0x0002);
+    assert(isnan(from_half(to_half(NAN, HALF_FP16), HALF_FP16)));
+    printf("rounding test passed\n");
+}
+
+// every 16-bit value widens and rounds back to itself, bar nan payloads and bf16 subnormals
+void test_roundtrip() {
+    for (uint32_t u = 0; u <= 0xFFFF; ++u) {
+        half_t h = (half_t)u;
+        real_t b = from_half(h, HALF_BF16), f = from_half(h, HALF_FP16);
+        assert((real_t)nn_float_from_bf16(h) == b || isnan(b));
+        if (isnan(b)) assert(isnan(from_half(to_half(b, HALF_BF16), HALF_BF16)));
+        else if ((u & 0x7F80) == 0) assert((to_half(b, HALF_BF16) & 0x7FFF) == 0);
+        else assert(to_half(b, HALF_BF16) == h);
+        if (isnan(f)) assert(isnan(from_half(to_half(f, HALF_FP16), HALF_FP16)));
+        else assert(to_half(f, HALF_FP16) == h);
+    }
+    printf("roundtrip test passed\n");
+}
+
+// the vector paths store the bits of the scalar conversions, at every length
+void test_paths_agree(const char *isa) {
+    enum { N = 77 };
+    real_t x[N], back[N];
+    half_t got[N];
+    for (size_t i = 0; i < N; ++i) x[i] = (real_t)(sin(i * 1.7) * pow(10, (double)(i % 13) - 6));
+    x[3] = 70000, x[4] = -1e-30, x[5] = INFINITY, x[6] = 0x1p-20;
+    for (HalfFormat f = HALF_BF16; f <= HALF_FP16; ++f) {
+        for (size_t n = 0; n <= N; ++n) {
+            nn_kernels.to_half[f](got, x, n);
+            for (size_t i = 0; i < n; ++i) {
+                assert(got[i] == (f == HALF_BF16 ? nn_bf16_from_float((float)x[i]) : nn_fp16_from_float((float)x[i])));
+            }
+            nn_kernels.from_half[f](back, got, n);
+            for (size_t i = 0; i < n; ++i) assert(back[i] == nn_half_to_real(got[i], f));
+        }
+    }
+    printf("%s: conversions (%s) agree\n", isa, nn_kernels.hisa);
+}
+
+static hmat_t rand_hmat(size_t rows, size_t cols, HalfFormat format) {
+    mat_t m = mat_new(rows, cols);
+    for (size_t i = 0; i < rows; ++i)
+        for (size_t j = 0; j < cols; ++j)
+            MAT_AT(m, i, j) = (real_t)(rand() % 17) - 8;
+    hmat_t h = hmat_new(rows, cols, format);
+    hmat_store(h, m);
+    mat_destroy(m);
+    return h;
+}
+
+// small integers: exact in both formats and in every partial sum, so the bf16 dot products
+// and the widened panels must both give the reference bit for bit
+static void check_hgemm(GemmOp op, size_t M, size_t N, size_t K, HalfFormat fa, HalfFormat fb, real_t alpha, real_t beta, bool epilogue) {
+    hmat_t a = op == GEMM_TN ? rand_hmat(K, M, fa) : rand_hmat(M, K, fa);
+    hmat_t b = op == GEMM_NT ? rand_hmat(N, K, fb) : rand_hmat(K, N, fb);
+    mat_t got = mat_new(M, N);
+    real_t *bias = malloc(N * sizeof(real_t));
+    for (size_t j = 0; j < N; ++j) bias[j] = (real_t)(j % 5) - 2;
+    for (size_t i = 0; i < M; ++i)
+        for (size_t j = 0; j < N; ++j)
+            MAT_AT(got, i, j) = (real_t)((i + j) % 3);
+    mat_t start = mat_new(M, N);
+    mat_operate(start, 1, (MatOp){ LOAD, got });
+    Epilogue epi = { .bias = bias, .act = ACT_RELU };
+    hmat_gemm_epilogue(got, op, a, b, alpha, beta, epilogue ? &epi : NULL);
+    for (size_t i = 0; i < M; ++i) {
+        for (size_t j = 0; j < N; ++j) {
+            double val = 0;
+            for (size_t k = 0; k < K; ++k) {
+                double x = nn_half_to_real(op == GEMM_TN ? MAT_AT(a, k, i) : MAT_AT(a, i, k), fa);
+                double y = nn_half_to_real(op == GEMM_NT ? MAT_AT(b, j, k) : MAT_AT(b, k, j), fb);
+                val += x * y;
+            }
+            double want = alpha * val + beta * MAT_AT(start, i, j);
+            if (epilogue) want = fmax(want + bias[j], 0);
+            assert(MAT_AT(got, i, j) == (real_t)want);
+        }
+    }
+    free(bias);
+    hmat_destroy(a);
+    hmat_destroy(b);
+    mat_destroy(got);
+    mat_destroy(start);
+}
+
+void test_hgemm(const char *isa) {
+    // tile edges, odd depths the pairs pad, several k blocks and row blocks
+    size_t dims[][3] = {
+        { 1, 1, 1 }, { 3, 5, 7 }, { 4, 16, 16 }, { 13, 17, 301 },
+        { 130, 9, 33 }, { 10, 100, 785 }, { 257, 65, 513 },
+    };
+    for (size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); ++d) {
+        for (GemmOp op = GEMM_NN; op <= GEMM_TN; ++op) {
+            check_hgemm(op, dims[d][0], dims[d][1], dims[d][2], HALF_BF16, HALF_BF16, 1, 0, false);
+            check_hgemm(op, dims[d][0], dims[d][1], dims[d][2], HALF_FP16, HALF_FP16, 1, 0, false);
+        }
+    }
+    for (GemmOp op = GEMM_NN; op <= GEMM_TN; ++op) {
+        check_hgemm(op, 19, 23, 290, HALF_BF16, HALF_BF16, 2, 1, true);
+        check_hgemm(op, 19, 23, 29, HALF_FP16, HALF_FP16, -0.5, 3, true);
+        check_hgemm(op, 19, 23, 29, HALF_BF16, HALF_FP16, 1, 0, true);
+    }
+    hmat_t a = rand_hmat(3, 0, HALF_BF16), b = rand_hmat(5, 0, HALF_BF16);
+    mat_t out = mat_new(3, 5);
+    hmat_gemm_epilogue(out, GEMM_NT, a, b, 1, 0, NULL);
+    for (size_t i = 0; i < 3; ++i) for (size_t j = 0; j < 5; ++j) assert(MAT_AT(out, i, j) == 0);
+    hmat_destroy(a);
+    hmat_destroy(b);
+    mat_destroy(out);
+    printf("%s: hgemm (%s) tests passed\n", isa, nn_kernels.gemm_micro_bf16 ? "bf16 pairs" : "widened panels");
+}
+
+int main() {
+    printf("detected: %s, 16-bit: %s\n", nn_kernels.isa, nn_kernels.hisa);
+    test_rounding();
+    test_roundtrip();
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (!nn_kernels_use(isas[i])) continue;
+        test_paths_agree(isas[i]);
+        test_hgemm(isas[i]);
+    }
+    printf("ALL HALF TESTS PASSED\n");
+    return 0;
+}
@@ -4,21 +4,23 @@
 
 void test_create_destroy() {
     mat_t m = mat_new(3, 3);
-    assert(m != NULL);
+    assert(m.data != NULL);
+    assert(m.rows == 3 && m.cols == 3 && m.stride >= 3);
+    assert((size_t)m.data % NN_ALIGN == 0);
     mat_destroy(m);
 }
 
 void test_scale_identity() {
     mat_t m = mat_new(2, 2);
-    m[0][0] = 1; m[0][1] = 2;
-    m[1][0] = 3; m[1][1] = 4;
+    MAT_AT(m, 0, 0) = 1; MAT_AT(m, 0, 1) = 2;
+    MAT_AT(m, 1, 0) = 3; MAT_AT(m, 1, 1) = 4;
 
     mat_scale(m, 2);
 
-    assert(m[0][0] == 2);
-    assert(m[0][1] == 4);
-    assert(m[1][0] == 6);
-    assert(m[1][1] == 8);
+    assert(MAT_AT(m, 0, 0) == 2);
+    assert(MAT_AT(m, 0, 1) == 4);
+    assert(MAT_AT(m, 1, 0) == 6);
+    assert(MAT_AT(m, 1, 1) == 8);
 
     mat_destroy(m);
 }
@@ -27,18 +29,18 @@ void test_addition() {
     mat_t a = mat_new(2, 2);
     mat_t b = mat_new(2, 2);
 
-    a[0][0] = 1; a[0][1] = 2;
-    a[1][0] = 3; a[1][1] = 4;
+    MAT_AT(a, 0, 0) = 1; MAT_AT(a, 0, 1) = 2;
+    MAT_AT(a, 1, 0) = 3; MAT_AT(a, 1, 1) = 4;
 
-    b[0][0] = 5; b[0][1] = 6;
-    b[1][0] = 7; b[1][1] = 8;
+    MAT_AT(b, 0, 0) = 5; MAT_AT(b, 0, 1) = 6;
+    MAT_AT(b, 1, 0) = 7; MAT_AT(b, 1, 1) = 8;
 
     mat_operate(a, 2, (MatOp){ LOAD, a }, (MatOp){ ADD, b });
 
-    assert(a[0][0] == 6);
-    assert(a[0][1] == 8);
-    assert(a[1][0] == 10);
-    assert(a[1][1] == 12);
+    assert(MAT_AT(a, 0, 0) == 6);
+    assert(MAT_AT(a, 0, 1) == 8);
+    assert(MAT_AT(a, 1, 0) == 10);
+    assert(MAT_AT(a, 1, 1) == 12);
 
     mat_destroy(a);
     mat_destroy(b);
@@ -48,18 +50,18 @@ void test_subtraction() {
     mat_t a = mat_new(2, 2);
     mat_t b = mat_new(2, 2);
 
-    a[0][0] = 5; a[0][1] = 7;
-    a[1][0] = 9; a[1][1] = 11;
+    MAT_AT(a, 0, 0) = 5; MAT_AT(a, 0, 1) = 7;
+    MAT_AT(a, 1, 0) = 9; MAT_AT(a, 1, 1) = 11;
 
-    b[0][0] = 1; b[0][1] = 2;
-    b[1][0] = 3; b[1][1] = 4;
+    MAT_AT(b, 0, 0) = 1; MAT_AT(b, 0, 1) = 2;
+    MAT_AT(b, 1, 0) = 3; MAT_AT(b, 1, 1) = 4;
 
     mat_operate(a, 2, (MatOp){ LOAD, a }, (MatOp){ SUB, b });
 
-    assert(a[0][0] == 4);
-    assert(a[0][1] == 5);
-    assert(a[1][0] == 6);
-    assert(a[1][1] == 7);
+    assert(MAT_AT(a, 0, 0) == 4);
+    assert(MAT_AT(a, 0, 1) == 5);
+    assert(MAT_AT(a, 1, 0) == 6);
+    assert(MAT_AT(a, 1, 1) == 7);
 
     mat_destroy(a);
     mat_destroy(b);
@@ -69,16 +71,16 @@ void test_multiplication() {
     mat_t a = mat_new(2, 2);
     mat_t b = mat_new(2, 2);
 
-    a[0][0] = 2; a[0][1] = 3;
-    a[1][0] = 4; a[1][1] = 5;
+    MAT_AT(a, 0, 0) = 2; MAT_AT(a, 0, 1) = 3;
+    MAT_AT(a, 1, 0) = 4; MAT_AT(a, 1, 1) = 5;
 
-    b[0][0] = 6; b[0][1] = 7;
-    b[1][0] = 8; b[1][1] = 9;
+    MAT_AT(b, 0, 0) = 6; MAT_AT(b, 0, 1) = 7;
+    MAT_AT(b, 1, 0) = 8; MAT_AT(b, 1, 1) = 9;
 
     mat_operate(a, 2, (MatOp){ LOAD, a }, (MatOp){ MUL, b });
 
-    assert(a[0][0] == 12); assert(a[0][1] == 21);
-    assert(a[1][0] == 32); assert(a[1][1] == 45);
+    assert(MAT_AT(a, 0, 0) == 12); assert(MAT_AT(a, 0, 1) == 21);
+    assert(MAT_AT(a, 1, 0) == 32); assert(MAT_AT(a, 1, 1) == 45);
 
     mat_destroy(a);
     mat_destroy(b);
@@ -88,18 +90,18 @@ void test_division() {
     mat_t a = mat_new(2, 2);
     mat_t b = mat_new(2, 2);
 
-    a[0][0] = 10; a[0][1] = 20;
-    a[1][0] = 30; a[1][1] = 40;
+    MAT_AT(a, 0, 0) = 10; MAT_AT(a, 0, 1) = 20;
+    MAT_AT(a, 1, 0) = 30; MAT_AT(a, 1, 1) = 40;
 
-    b[0][0] = 2; b[0][1] = 4;
-    b[1][0] = 5; b[1][1] = 8;
+    MAT_AT(b, 0, 0) = 2; MAT_AT(b, 0, 1) = 4;
+    MAT_AT(b, 1, 0) = 5; MAT_AT(b, 1, 1) = 8;
 
     mat_operate(a, 2, (MatOp){ LOAD, a }, (MatOp){ DIV, b });
 
-    assert(a[0][0] == 5);
-    assert(a[0][1] == 5);
-    assert(a[1][0] == 6);
-    assert(a[1][1] == 5);
+    assert(MAT_AT(a, 0, 0) == 5);
+    assert(MAT_AT(a, 0, 1) == 5);
+    assert(MAT_AT(a, 1, 0) == 6);
+    assert(MAT_AT(a, 1, 1) == 5);
 
     mat_destroy(a);
     mat_destroy(b);
@@ -110,22 +112,22 @@ void test_chained_operations() {
     mat_t b = mat_new(2, 2);
     mat_t c = mat_new(2, 2);
 
-    a[0][0] = 1; a[0][1] = 2;
-    a[1][0] = 3; a[1][1] = 4;
+    MAT_AT(a, 0, 0) = 1; MAT_AT(a, 0, 1) = 2;
+    MAT_AT(a, 1, 0) = 3; MAT_AT(a, 1, 1) = 4;
 
-    b[0][0] = 5; b[0][1] = 6;
-    b[1][0] = 7; b[1][1] = 8;
+    MAT_AT(b, 0, 0) = 5; MAT_AT(b, 0, 1) = 6;
+    MAT_AT(b, 1, 0) = 7; MAT_AT(b, 1, 1) = 8;
 
-    c[0][0] = 2; c[0][1] = 2;
-    c[1][0] = 2; c[1][1] = 2;
+    MAT_AT(c, 0, 0) = 2; MAT_AT(c, 0, 1) = 2;
+    MAT_AT(c, 1, 0) = 2; MAT_AT(c, 1, 1) = 2;
 
     mat_operate(a, 4, (MatOp){ LOAD, a }, (MatOp){ ADD, b }, (MatOp){ MUL, c }, (MatOp){ SUB, c });
 
     // (a+b)*c - c
-    assert(a[0][0] == ((1+5)*2 - 2)); // 10
-    assert(a[0][1] == ((2+6)*2 - 2)); // 14
-    assert(a[1][0] == ((3+7)*2 - 2)); // 18
-    assert(a[1][1] == ((4+8)*2 - 2)); // 22
+    assert(MAT_AT(a, 0, 0) == ((1+5)*2 - 2)); // 10
+    assert(MAT_AT(a, 0, 1) == ((2+6)*2 - 2)); // 14
+    assert(MAT_AT(a, 1, 0) == ((3+7)*2 - 2)); // 18
+    assert(MAT_AT(a, 1, 1) == ((4+8)*2 - 2)); // 22
 
     mat_destroy(a);
     mat_destroy(b);
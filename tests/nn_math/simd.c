@@ -0,0 +1,254 @@
+#include <math.h>
+#define STB_DS_IMPLEMENTATION
+#define NN_MATH_IMPLEMENTATION
+#include "nn_math.h"
+
+static const char *isas[] = { "generic", "sse2", "avx2", "avx512", "neon" };
+
+static void fill(real_t *v, size_t n, size_t seed) {
+    for (size_t i = 0; i < n; ++i) v[i] = (real_t)((i * 7 + seed) % 13) + 1;
+}
+
+// every length up to a few vectors so the remainder loops are covered
+void test_elementwise(const char *isa) {
+    for (size_t n = 0; n < 70; ++n) {
+        real_t a[70], b[70], want[70];
+        for (OpType o = LOAD; o <= DIV; ++o) {
+            fill(a, n, 3); fill(b, n, 5);
+            for (size_t i = 0; i < n; ++i) {
+                switch (o) {
+                    case LOAD: want[i] = b[i]; break;
+                    case ADD: want[i] = a[i] + b[i]; break;
+                    case SUB: want[i] = a[i] - b[i]; break;
+                    case MUL: want[i] = a[i] * b[i]; break;
+                    case DIV: want[i] = a[i] / b[i]; break;
+                }
+            }
+            nn_kernels.operate[o](a, b, n);
+            for (size_t i = 0; i < n; ++i) assert(a[i] == want[i]);
+        }
+        fill(a, n, 3);
+        nn_kernels.scale(a, -2, n);
+        for (size_t i = 0; i < n; ++i) assert(a[i] == -2 * (real_t)((i * 7 + 3) % 13 + 1));
+
+        fill(a, n, 3); fill(b, n, 5);
+        nn_kernels.axpy(a, b, 3, n);
+        for (size_t i = 0; i < n; ++i) assert(a[i] == (real_t)((i * 7 + 3) % 13 + 1) + 3 * b[i]);
+
+        fill(a, n, 3);
+        real_t dot = 0;
+        for (size_t i = 0; i < n; ++i) dot += a[i] * b[i];
+        assert(nn_kernels.dot(a, b, n) == dot);
+    }
+    printf("%s: elementwise tests passed\n", isa);
+}
+
+void test_gemm(const char *isa) {
+    mat_t a = mat_new(37, 301), b = mat_new(301, 29), got = mat_new(37, 29);
+    for (size_t i = 0; i < a.rows; ++i) fill(mat_row(a, i), a.cols, i);
+    for (size_t i = 0; i < b.rows; ++i) fill(mat_row(b, i), b.cols, i + 1);
+    mat_mat_dot(got, a, b);
+    for (size_t i = 0; i < got.rows; ++i) {
+        for (size_t j = 0; j < got.cols; ++j) {
+            real_t val = 0;
+            for (size_t k = 0; k < a.cols; ++k) val += MAT_AT(a, i, k) * MAT_AT(b, k, j);
+            assert(MAT_AT(got, i, j) == val);
+        }
+    }
+    mat_destroy(a);
+    mat_destroy(b);
+    mat_destroy(got);
+    printf("%s: gemm tests passed\n", isa);
+}
+
+// against libm evaluated in double, including the clamped range and every tail length
+void test_sigmoid(const char *isa) {
+    double bound = sizeof(real_t) == sizeof(float) ? 1.5e-7 : 5e-16, worst = 0;
+    enum { N = 4096 };
+    static real_t x[N], y[N];
+    for (double lo = -120; lo < 120; lo += N * 0.0029) {
+        for (size_t i = 0; i < N; ++i) x[i] = (real_t)(lo + i * 0.0029);
+        nn_kernels.sigmoid(y, x, N);
+        for (size_t i = 0; i < N; ++i) worst = fmax(worst, fabs(y[i] - 1 / (1 + exp(-(double)x[i]))));
+    }
+    assert(worst < bound);
+    for (size_t n = 0; n < 70; ++n) {
+        for (size_t i = 0; i < n; ++i) x[i] = (real_t)i / 7 - 5;
+        y[n] = 42;
+        nn_kernels.sigmoid(y, x, n);
+        for (size_t i = 0; i < n; ++i) assert(fabs(y[i] - 1 / (1 + exp(-(double)x[i]))) < bound);
+        assert(y[n] == 42);
+        // sigmoid'(z) = a * (1 - a) from the activations
+        real_t d[70];
+        for (size_t i = 0; i < n; ++i) d[i] = 2;
+        nn_kernels.sigmoid_grad(d, y, n);
+        for (size_t i = 0; i < n; ++i) assert(d[i] == 2 * (y[i] * (1 - y[i])));
+    }
+    printf("%s: sigmoid tests passed, max error %.3g\n", isa, worst);
+}
+
+static double ref_act(Activation act, double x) {
+    switch (act) {
+        case ACT_SIGMOID: return 1 / (1 + exp(-x));
+        case ACT_TANH: return tanh(x);
+        case ACT_RELU: return x > 0 ? x : 0;
+        case ACT_LEAKY_RELU: return x > 0 ? x : LEAKY_RELU_SLOPE * x;
+        default: return x;
+    }
+}
+
+// the fused epilogue against a plain product followed by the bias and the activation. the
+// pre-activation is the same sum rounded the same way, so z must match exactly
+void test_epilogue(const char *isa) {
+    double tol = sizeof(real_t) == sizeof(float) ? 5e-7 : 1e-15;
+    Activation acts[] = { ACT_SIGMOID, ACT_TANH, ACT_RELU, ACT_LEAKY_RELU, ACT_IDENTITY };
+    // k spans two packed blocks, the columns end in a partial tile
+    mat_t a = mat_new(37, GEMM_KC + 45), b = mat_new(45, GEMM_KC + 45);
+    mat_t c = mat_new(37, 45), want = mat_new(37, 45), z = mat_new(37, 45);
+    for (size_t i = 0; i < a.rows; ++i) {
+        for (size_t k = 0; k < a.cols; ++k) MAT_AT(a, i, k) = (real_t)((i * 7 + k) % 13) / 64 - (real_t)0.09;
+    }
+    for (size_t j = 0; j < b.rows; ++j) {
+        for (size_t k = 0; k < b.cols; ++k) MAT_AT(b, j, k) = (real_t)((j * 5 + k * 3) % 11) / 64 - (real_t)0.07;
+    }
+    real_t bias[45], x[GEMM_KC + 45], yz[45];
+    for (size_t j = 0; j < 45; ++j) bias[j] = (real_t)((int)j % 9 - 4) / 4;
+    for (size_t k = 0; k < a.cols; ++k) x[k] = MAT_AT(a, 3, k);
+    for (size_t t = 0; t < sizeof(acts) / sizeof(acts[0]); ++t) {
+        for (real_t beta = 0; beta <= 1; beta += 1) {
+            for (size_t i = 0; i < c.rows; ++i) {
+                for (size_t j = 0; j < c.cols; ++j) MAT_AT(c, i, j) = MAT_AT(want, i, j) = (real_t)(i % 3);
+            }
+            mat_gemm(want, GEMM_NT, a, b, 2, beta);
+            Epilogue epi = { bias, acts[t], z.data, z.stride };
+            mat_gemm_epilogue(c, GEMM_NT, a, b, 2, beta, &epi);
+            for (size_t i = 0; i < c.rows; ++i) {
+                for (size_t j = 0; j < c.cols; ++j) {
+                    real_t pre = MAT_AT(want, i, j) + bias[j];
+                    assert(MAT_AT(z, i, j) == pre);
+                    assert(fabs(MAT_AT(c, i, j) - ref_act(acts[t], pre)) <= tol * fmax(1, fabs(pre)));
+                }
+            }
+        }
+        // one row of the same product as a gemv
+        vec_t yv = NULL, y = NULL, xv = NULL;
+        arrsetlen(yv, 45); arrsetlen(y, 45); arrsetlen(xv, a.cols);
+        memcpy(xv, x, sizeof(x));
+        mat_vec_dot_epilogue(yv, b, xv, &(Epilogue){ .bias = bias, .act = acts[t], .z = yz });
+        mat_vec_dot(y, b, xv);
+        for (size_t j = 0; j < 45; ++j) {
+            assert(yz[j] == y[j] + bias[j]);
+            assert(fabs(yv[j] - ref_act(acts[t], yz[j])) <= tol * fmax(1, fabs(yz[j])));
+        }
+        arrfree(yv); arrfree(y); arrfree(xv);
+    }
+    mat_destroy(a); mat_destroy(b); mat_destroy(c); mat_destroy(want); mat_destroy(z);
+    printf("%s: epilogue tests passed\n", isa);
+}
+
+// the update rules written out in double, one parameter at a time
+static void ref_optimize(OptimizerKind kind, double *p, double g, double *m, double *v, const OptStep *s) {
+    g = s->grad_scale * g + s->l2 * *p;
+    switch (kind) {
+        case OPT_SGD: *p -= s->lr * g; break;
+        case OPT_MOMENTUM: *m = s->beta1 * *m + g; *p -= s->lr * *m; break;
+        case OPT_NESTEROV: *m = s->beta1 * *m + g; *p -= s->lr * (g + s->beta1 * *m); break;
+        case OPT_RMSPROP:
+            *v = s->beta2 * *v + (1 - s->beta2) * g * g;
+            *p -= s->lr * g / (sqrt(*v) + s->eps);
+            break;
+        case OPT_ADAM: case OPT_ADAMW:
+            *m = s->beta1 * *m + (1 - s->beta1) * g;
+            *v = s->beta2 * *v + (1 - s->beta2) * g * g;
+            *p -= s->lr * (*m * s->bias1 / (sqrt(*v * s->bias2) + s->eps) + s->decay * *p);
+            break;
+    }
+}
+
+// a few steps of every rule over every tail length, moments start at zero like in training
+void test_optimizers(const char *isa) {
+    double tol = sizeof(real_t) == sizeof(float) ? 1e-5 : 1e-13;
+    for (OptimizerKind kind = OPT_SGD; kind <= OPT_ADAMW; ++kind) {
+        for (size_t n = 0; n < 70; ++n) {
+            real_t p[71], g[70], m[70] = { 0 }, v[70] = { 0 };
+            double rp[70], rm[70] = { 0 }, rv[70] = { 0 };
+            for (size_t i = 0; i < n; ++i) rp[i] = p[i] = (real_t)i / 9 - 3;
+            p[n] = 42;
+            for (uint64_t t = 1; t <= 4; ++t) {
+                OptStep s = { .lr = 0.05, .grad_scale = 0.25, .l2 = kind == OPT_ADAMW ? 0 : 1e-2,
+                    .decay = kind == OPT_ADAMW ? 1e-2 : 0, .beta1 = 0.9, .beta2 = 0.999, .eps = 1e-8 };
+                s.bias1 = 1 / (1 - pow(s.beta1, t)), s.bias2 = 1 / (1 - pow(s.beta2, t));
+                // gradients change sign and include zero, which adam's sqrt must survive
+                for (size_t i = 0; i < n; ++i) g[i] = (real_t)((i * 5 + t * 3) % 11) - 5;
+                nn_kernels.optimize[kind](p, g, m, v, n, &s);
+                for (size_t i = 0; i < n; ++i) ref_optimize(kind, &rp[i], g[i], &rm[i], &rv[i], &s);
+                for (size_t i = 0; i < n; ++i) {
+                    assert(fabs(p[i] - rp[i]) <= tol * fmax(1, fabs(rp[i])));
+                    assert(fabs(m[i] - rm[i]) <= tol * fmax(1, fabs(rm[i])));
+                    assert(fabs(v[i] - rv[i]) <= tol * fmax(1, fabs(rv[i])));
+                }
+            }
+            assert(p[n] == 42);
+        }
+    }
+    // stateless rules never touch the moments
+    real_t p[5] = { 1, 2, 3, 4, 5 }, g[5] = { 1, 1, 1, 1, 1 };
+    OptStep s = { .lr = 1, .grad_scale = 1 };
+    nn_kernels.optimize[OPT_SGD](p, g, NULL, NULL, 5, &s);
+    for (size_t i = 0; i < 5; ++i) assert(p[i] == i);
+    printf("%s: optimizer tests passed\n", isa);
+}
+
+// every sample and row count around the tiles, with the extremes maddubs could saturate on
+void test_qgemm(const char *isa) {
+    enum { K = 3 * NN_ALIGN, ROWS = 11, N = 9 };
+    uint8_t x[N * K];
+    int8_t w[ROWS * K];
+    for (size_t b = 0; b < N; ++b) {
+        for (size_t i = 0; i < K; ++i) x[b * K + i] = i < 64 ? 255 : (b * 53 + i * 37 + 11) % 256;
+    }
+    for (size_t r = 0; r < ROWS; ++r) {
+        for (size_t i = 0; i < K; ++i) {
+            w[r * K + i] = r == 0 ? QUANT_WEIGHT_MAX : r == 1 ? -QUANT_WEIGHT_MAX : (int8_t)((r * 13 + i * 5) % (2 * QUANT_WEIGHT_MAX + 1)) - QUANT_WEIGHT_MAX;
+        }
+    }
+    for (size_t n = 0; n <= N; ++n) {
+        for (size_t rows = 0; rows <= ROWS; ++rows) {
+            // ldd wider than rows, the column past them must stay untouched
+            int32_t got[N * (ROWS + 1)];
+            for (size_t j = 0; j < N * (ROWS + 1); ++j) got[j] = 12345;
+            nn_kernels.qgemm(got, ROWS + 1, x, K, n, w, K, rows, K);
+            for (size_t b = 0; b < N; ++b) {
+                for (size_t r = 0; r <= ROWS; ++r) {
+                    int32_t want = 12345;
+                    if (b < n && r < rows) {
+                        want = 0;
+                        for (size_t i = 0; i < K; ++i) want += (int32_t)x[b * K + i] * w[r * K + i];
+                    }
+                    assert(got[b * (ROWS + 1) + r] == want);
+                }
+            }
+        }
+    }
+    printf("%s: qgemm (%s) tests passed\n", isa, nn_kernels.qisa);
+}
+
+int main() {
+    printf("detected: %s\n", nn_kernels.isa);
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (!nn_kernels_use(isas[i])) {
+            printf("%s: not supported, skipped\n", isas[i]);
+            continue;
+        }
+        assert(strcmp(nn_kernels.isa, isas[i]) == 0);
+        test_elementwise(isas[i]);
+        test_gemm(isas[i]);
+        test_sigmoid(isas[i]);
+        test_optimizers(isas[i]);
+        test_epilogue(isas[i]);
+        test_qgemm(isas[i]);
+    }
+    assert(!nn_kernels_use("bogus"));
+    printf("ALL SIMD TESTS PASSED\n");
+    return 0;
+}
@@ -83,14 +83,14 @@ void test_vector_integration() {
         d[i] = -10 + i;
     }
     vec_scale(a, 10);
-    vec_operate(a, 5,
+    vec_operate(a, 4,
         (VecOp){ LOAD, a },
         (VecOp){ ADD, b },
         (VecOp){ SUB, c },
         (VecOp){ MUL, d }
     );
     for (size_t i = 1; i < arrlen(a); ++i) {
-	double expected = (10*(i+1) + b[i] - c[i]) * d[i];
+	real_t expected = (10*(i+1) + b[i] - c[i]) * d[i];
 	assert(a[i] == expected);
     }
     vec_destroy(a);
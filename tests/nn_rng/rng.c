@@ -0,0 +1,79 @@
+#include <math.h>
+#define STB_DS_IMPLEMENTATION
+#define NN_MATH_IMPLEMENTATION
+#include "nn_rng.h"
+
+void test_streams() {
+    Rng a, b, c;
+    rng_seed(&a, 9, 1);
+    rng_seed(&b, 9, 1);
+    rng_seed(&c, 9, 2);
+    size_t same = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        uint64_t x = rng_next(&a);
+        assert(x == rng_next(&b));
+        same += x == rng_next(&c);
+    }
+    // another stream of the same seed is another sequence
+    assert(same == 0);
+    printf("stream test passed\n");
+}
+
+void test_uniform_and_bounded() {
+    Rng rng;
+    rng_seed(&rng, 1, 0);
+    size_t counts[7] = { 0 }, n = 700000;
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double u = rng_uniform(&rng);
+        assert(u > 0 && u < 1);
+        sum += u;
+        counts[rng_bounded(&rng, 7)]++;
+    }
+    assert(fabs(sum / n - 0.5) < 0.005);
+    for (size_t k = 0; k < 7; ++k) assert(fabs(counts[k] - n / 7.0) < n / 7.0 * 0.02);
+    printf("uniform test passed\n");
+}
+
+void test_normal() {
+    Rng rng;
+    rng_seed(&rng, 2, 0);
+    size_t n = 200001; // odd, the last pair is half used
+    real_t *v = (real_t*)malloc(n * sizeof(real_t));
+    rng_normal(&rng, v, n, 3, 2);
+    double mean = 0, var = 0;
+    for (size_t i = 0; i < n; ++i) mean += v[i];
+    mean /= n;
+    for (size_t i = 0; i < n; ++i) var += (v[i] - mean) * (v[i] - mean);
+    var /= n - 1;
+    assert(fabs(mean - 3) < 0.02 && fabs(var - 4) < 0.05);
+    // blocks do not depend on how the request is split
+    Rng again;
+    rng_seed(&again, 2, 0);
+    real_t first[300];
+    rng_normal(&again, first, 300, 3, 2);
+    for (size_t i = 0; i < 300; ++i) assert(first[i] == v[i]);
+    free(v);
+    printf("normal test passed\n");
+}
+
+void test_shuffle() {
+    Rng rng;
+    rng_seed(&rng, 3, 0);
+    size_t idx[50], seen[50] = { 0 }, moved = 0;
+    for (size_t i = 0; i < 50; ++i) idx[i] = i;
+    rng_shuffle(&rng, idx, 50);
+    for (size_t i = 0; i < 50; ++i) seen[idx[i]]++, moved += idx[i] != i;
+    for (size_t i = 0; i < 50; ++i) assert(seen[i] == 1);
+    assert(moved > 0);
+    printf("shuffle test passed\n");
+}
+
+int main() {
+    test_streams();
+    test_uniform_and_bounded();
+    test_normal();
+    test_shuffle();
+    printf("ALL RNG TESTS PASSED\n");
+    return 0;
+}